@@ -0,0 +1,168 @@
+// adrbench.cpp
+//
+// Time to sync a batch of messages between two nodes at growing distance,
+// at the fixed 2400 bps the link used to hard-code and with adaptive rate
+// selection. Each node has its own LoraRadio and LoraLink on a shared
+// SimChannel with packet RSSI enabled, running `speedup` times faster than
+// wall time; every figure below is in simulated time and includes the rate
+// negotiation itself.
+//
+// Usage: ./adrbench [messages] [message-bytes] [speedup] [distance]
+//   Without a distance, sweeps 100 m to 4 km.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "lora.h"
+#include "simradio.h"
+
+using namespace std;
+
+struct RunResult
+{
+    double distance;
+    bool adaptive;
+    size_t delivered;
+    double elapsed;
+    double goodput;
+    int airSpeed, power;
+    LinkStats sender;
+    SimRadioStats channel;
+};
+
+static RunResult runOnce(int messages, size_t messageBytes, double speedup, double distance, bool adaptive)
+{
+    SimRadioParams params;
+    params.speedup = speedup;
+    params.shadowingDb = 2;
+    SimChannel channel(params);
+
+    RadioConfig config;
+    config.rssi = true;
+    LoraRadio senderRadio(channel.factory(0, 0));
+    LoraRadio receiverRadio(channel.factory(distance, 0));
+    config.addr = 0x0001;
+    senderRadio.configure(config);
+    config.addr = 0x0002;
+    receiverRadio.configure(config);
+    senderRadio.setDutyCycle(1);
+    receiverRadio.setDutyCycle(1);
+
+    // Let both radios open and take their addresses before the first packet
+    this_thread::sleep_for(chrono::milliseconds(static_cast<int>(2000 / speedup) + 1));
+
+    LoraLink sender(senderRadio);
+    LoraLink receiver(receiverRadio);
+    sender.setAdaptiveRate(adaptive);
+    receiver.setAdaptiveRate(adaptive);
+
+    atomic<int> received{0};
+    atomic<bool> sending{true};
+    auto idle = chrono::milliseconds(static_cast<int>(60000 / speedup) + 1);
+    double lastAt = 0;
+    thread rx([&] {
+        vector<bool> seen(messages, false);
+        vector<uint8_t> message;
+        while (received < messages)
+        {
+            if (!receiver.receive(message, idle))
+            {
+                if (!sending)
+                    break;
+                continue;
+            }
+            if (message.size() < 4)
+                continue;
+            uint32_t seq = message[0] << 24 | message[1] << 16 | message[2] << 8 | message[3];
+            if (seq < (uint32_t)messages && !seen[seq])
+            {
+                seen[seq] = true;
+                lastAt = channel.now();
+                received++;
+            }
+        }
+    });
+
+    double begin = channel.now();
+    for (int seq = 0; seq < messages; seq++)
+    {
+        vector<uint8_t> message(messageBytes, 0x5A);
+        message[0] = seq >> 24;
+        message[1] = seq >> 16;
+        message[2] = seq >> 8;
+        message[3] = seq;
+        sender.send(message, 0x0002, TxPriority::Bulk);
+    }
+    sending = false;
+    rx.join();
+
+    RunResult result{};
+    result.distance = distance;
+    result.adaptive = adaptive;
+    result.delivered = received;
+    result.elapsed = received ? max(lastAt - begin, 1e-9) : 0;
+    result.goodput = received ? received * messageBytes / result.elapsed : 0;
+    result.airSpeed = senderRadio.config().airSpeed;
+    result.power = senderRadio.config().power;
+    result.sender = sender.stats();
+    result.channel = channel.stats();
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    int messages = argc > 1 ? stoi(argv[1]) : 20;
+    size_t messageBytes = argc > 2 ? stoul(argv[2]) : 2000;
+    double speedup = argc > 3 ? stod(argv[3]) : 50;
+    messageBytes = max<size_t>(messageBytes, 4);
+
+    vector<double> distances = {100, 500, 1000, 2000, 4000};
+    if (argc > 4)
+        distances = {stod(argv[4])};
+
+    cout << messages << " messages x " << messageBytes << " B" << endl;
+
+    ostringstream json;
+    json << "[";
+    bool first = true;
+    for (double distance : distances)
+    {
+        double fixedTime = 0;
+        for (bool adaptive : {false, true})
+        {
+            // The driver logs every packet it handles; keep the report readable
+            streambuf *console = cout.rdbuf(nullptr);
+            RunResult r = runOnce(messages, messageBytes, speedup, distance, adaptive);
+            cout.rdbuf(console);
+            cout.clear();
+
+            if (!adaptive)
+                fixedTime = r.elapsed;
+            double speedupOverFixed = adaptive && r.elapsed > 0 && r.delivered == (size_t)messages ? fixedTime / r.elapsed : 1;
+            cout << distance << " m, " << (adaptive ? "adaptive" : "fixed") << ": delivered " << r.delivered << "/"
+                 << messages << " in " << r.elapsed << " s, goodput " << r.goodput << " B/s, ended at " << r.airSpeed
+                 << " bps / " << r.power << " dBm after " << r.sender.rateChanges << " changes";
+            if (adaptive)
+                cout << ", " << speedupOverFixed << "x fixed";
+            cout << endl;
+
+            json << (first ? "" : ",") << "{\"distance_m\":" << r.distance << ",\"mode\":\""
+                 << (adaptive ? "adaptive" : "fixed") << "\",\"messages\":" << messages
+                 << ",\"message_bytes\":" << messageBytes << ",\"delivered\":" << r.delivered
+                 << ",\"sync_s\":" << r.elapsed << ",\"goodput_Bps\":" << r.goodput
+                 << ",\"air_speed\":" << r.airSpeed << ",\"power_dbm\":" << r.power
+                 << ",\"rate_changes\":" << r.sender.rateChanges
+                 << ",\"retransmitted\":" << r.sender.fragmentsRetransmitted
+                 << ",\"channel_sent\":" << r.channel.sent << ",\"delivered_packets\":" << r.channel.delivered
+                 << ",\"weak\":" << r.channel.weak << ",\"collided\":" << r.channel.collided
+                 << ",\"deaf\":" << r.channel.deaf << "}";
+            first = false;
+        }
+    }
+    json << "]";
+    cout << "RESULT " << json.str() << endl;
+    return 0;
+}
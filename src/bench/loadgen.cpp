@@ -0,0 +1,230 @@
+// loadgen.cpp
+//
+// Loopback load generator for the node's TCP server.
+// Opens many concurrent non-blocking connections, sends one Tangle update
+// on each (one MSG_SNAPSHOT frame, then half-close) and waits for the
+// server to close the connection after applying and acknowledging it.
+// The transactions are signed by a meter and the grid, so a node that
+// requires signatures (the default) applies them rather than dropping them.
+//
+// Usage: ./loadgen [host] [port] [connections] [transactions-per-update] [hold-ms]
+//   hold-ms > 0 keeps every connection open and silent for that long before
+//   sending, to exercise the server's idle timeout and connection cap.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "frame.h"
+#include "tangle.h"
+#include "signature.h"
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+struct Client
+{
+    int fd = -1;
+    size_t sent = 0;
+    bool connected = false;
+    bool done = false;
+    bool failed = false;
+    Clock::time_point start;
+    double latencyMs = 0;
+};
+
+// Signed transactions, serialized the way a node sends its Tangle
+static string makeUpdate(int transactions)
+{
+    SigningKey meterKey = SigningKey::generate();
+    SigningKey gridKey = SigningKey::generate();
+    Tangle tangle;
+    for (int i = 0; i < transactions; i++)
+    {
+        Transaction tx;
+        tx.transaction_id = "txload" + to_string(i);
+        tx.timestamp = to_string(time(nullptr));
+        tx.timestampInt = static_cast<int>(time(nullptr));
+        tx.sender = "Meter_001";
+        tx.receiver = "Grid";
+        tx.amount = 1.5;
+        tx.unit = "kWh";
+        tx.price_per_unit = 0.25;
+        tx.currency = "USD";
+        tx.cumulative_weight = 0;
+        tx.proof_of_work = "00ab";
+        tx.previous_transactions = {"tx0"};
+        signAsSender(tx, meterKey);
+        signAsReceiver(tx, gridKey);
+        tangle.addTransaction(tx);
+    }
+    return encodeFrame(MSG_SNAPSHOT, tangle.serialize());
+}
+
+static void raiseFileLimit()
+{
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    string host = argc > 1 ? argv[1] : "127.0.0.1";
+    int port = argc > 2 ? stoi(argv[2]) : 8080;
+    int total = argc > 3 ? stoi(argv[3]) : 2000;
+    int txPerUpdate = argc > 4 ? stoi(argv[4]) : 10;
+    int holdMs = argc > 5 ? stoi(argv[5]) : 0;
+
+    raiseFileLimit();
+    string message = makeUpdate(txPerUpdate);
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+
+    int epollFd = epoll_create1(0);
+    vector<Client> clients(total);
+    auto begin = Clock::now();
+
+    for (int i = 0; i < total; i++)
+    {
+        Client &c = clients[i];
+        c.start = Clock::now();
+        c.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (c.fd < 0 || (connect(c.fd, (sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS))
+        {
+            c.failed = c.done = true;
+            continue;
+        }
+        epoll_event ev{};
+        ev.events = EPOLLOUT | EPOLLIN | EPOLLRDHUP;
+        ev.data.u32 = i;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, c.fd, &ev);
+    }
+    cout << "Opened " << total << " connections in "
+         << chrono::duration<double, milli>(Clock::now() - begin).count() << " ms" << endl;
+
+    if (holdMs > 0)
+    {
+        this_thread::sleep_for(chrono::milliseconds(holdMs));
+    }
+
+    int remaining = count_if(clients.begin(), clients.end(), [](const Client &c) { return !c.done; });
+    vector<epoll_event> events(256);
+    char sink[4096];
+
+    while (remaining > 0)
+    {
+        int ready = epoll_wait(epollFd, events.data(), events.size(), 5000);
+        if (ready == 0)
+            break; // server stopped responding; the rest count as failures
+
+        for (int e = 0; e < ready; e++)
+        {
+            Client &c = clients[events[e].data.u32];
+            if (c.done)
+                continue;
+
+            if (!c.connected && (events[e].events & EPOLLOUT))
+            {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                c.connected = (err == 0);
+                c.failed = !c.connected;
+            }
+
+            // Closed before we sent anything: the server refused us (connection cap or idle timeout)
+            if (c.connected && c.sent == 0 && (events[e].events & (EPOLLRDHUP | EPOLLHUP)))
+            {
+                c.failed = true;
+            }
+
+            while (c.connected && !c.failed && c.sent < message.size())
+            {
+                ssize_t n = send(c.fd, message.data() + c.sent, message.size() - c.sent, MSG_NOSIGNAL);
+                if (n <= 0)
+                {
+                    c.failed = (n < 0 && errno != EAGAIN);
+                    break;
+                }
+                c.sent += n;
+                if (c.sent == message.size())
+                {
+                    shutdown(c.fd, SHUT_WR);
+                    epoll_event ev{};
+                    ev.events = EPOLLIN | EPOLLRDHUP;
+                    ev.data.u32 = events[e].data.u32;
+                    epoll_ctl(epollFd, EPOLL_CTL_MOD, c.fd, &ev);
+                }
+            }
+
+            // The server closes once it has applied the update
+            if (!c.failed && (events[e].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)))
+            {
+                ssize_t n;
+                while ((n = read(c.fd, sink, sizeof(sink))) > 0)
+                {
+                }
+                if (n == 0)
+                {
+                    c.latencyMs = chrono::duration<double, milli>(Clock::now() - c.start).count();
+                    c.done = true;
+                    c.failed = c.sent < message.size(); // closed before we finished: refused
+                }
+                else if (errno != EAGAIN)
+                {
+                    c.failed = true;
+                }
+            }
+
+            if (c.failed)
+                c.done = true;
+            if (c.done)
+            {
+                close(c.fd);
+                c.fd = -1;
+                remaining--;
+            }
+        }
+    }
+
+    double elapsedMs = chrono::duration<double, milli>(Clock::now() - begin).count();
+    vector<double> latencies;
+    int failed = 0;
+    for (auto &c : clients)
+    {
+        if (c.fd >= 0)
+            close(c.fd);
+        if (c.failed || !c.done)
+            failed++;
+        else
+            latencies.push_back(c.latencyMs);
+    }
+    sort(latencies.begin(), latencies.end());
+
+    auto percentile = [&](double p) {
+        return latencies.empty() ? 0.0 : latencies[min(latencies.size() - 1, (size_t)(p * latencies.size()))];
+    };
+    cout << "Completed " << latencies.size() << "/" << total << " updates (" << failed << " failed) in "
+         << elapsedMs << " ms" << endl
+         << "Throughput: " << latencies.size() / (elapsedMs / 1000.0) << " updates/s, "
+         << (latencies.size() * message.size()) / (elapsedMs / 1000.0) / 1e6 << " MB/s" << endl
+         << "Latency p50 " << percentile(0.50) << " ms, p99 " << percentile(0.99)
+         << " ms, max " << (latencies.empty() ? 0.0 : latencies.back()) << " ms" << endl;
+    return failed == 0 ? 0 : 1;
+}
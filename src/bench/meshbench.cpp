@@ -0,0 +1,218 @@
+// meshbench.cpp
+//
+// Hop count and end-to-end latency of messages across a multi-hop LoRa
+// mesh, with distance-vector routing and with plain flooding (every node
+// rebroadcasting every message once). The nodes sit on a grid, each with
+// its own LoraRadio, LoraLink and LoraMesh on a shared SimChannel, spaced
+// so that only grid neighbours hear each other. After the routes have had
+// time to settle, the corner node sends numbered messages to every other
+// node in turn; each node timestamps a message when it arrives. The
+// channel runs `speedup` times faster than wall time; every figure below
+// is in simulated time.
+//
+// Usage: ./meshbench [width] [height] [messages] [message-bytes] [speedup] [spacing-m]
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include "mesh.h"
+#include "simradio.h"
+
+using namespace std;
+
+static const double WARMUP_S = 90;   // for the first advertisements to spread
+static const double INTERVAL_S = 20; // between messages, so each crosses the mesh on its own
+
+struct Node
+{
+    unique_ptr<LoraRadio> radio;
+    unique_ptr<LoraLink> link;
+    unique_ptr<LoraMesh> mesh;
+};
+
+struct RunResult
+{
+    bool routing;
+    size_t delivered;
+    double meanHops;
+    int maxHops;
+    double p50, p99;
+    map<int, pair<int, double>> byHops; // hops -> messages, mean latency ms
+    MeshStats mesh;
+    SimRadioStats channel;
+};
+
+static RunResult runOnce(int width, int height, int messages, size_t messageBytes, double speedup, double spacing,
+                         bool routing)
+{
+    SimRadioParams params;
+    params.speedup = speedup;
+    params.shadowingDb = 2;
+    SimChannel channel(params);
+
+    int count = width * height;
+    vector<Node> nodes(count);
+    for (int i = 0; i < count; i++)
+    {
+        nodes[i].radio = make_unique<LoraRadio>(channel.factory((i % width) * spacing, (i / width) * spacing));
+        RadioConfig config;
+        config.addr = static_cast<uint16_t>(i + 1);
+        nodes[i].radio->configure(config);
+        nodes[i].radio->setDutyCycle(1); // measures the mesh, not the regulatory budget
+    }
+    // Let every radio open and take its address before the first packet
+    this_thread::sleep_for(chrono::milliseconds(static_cast<int>(2000 / speedup) + 1));
+    for (auto &node : nodes)
+    {
+        node.link = make_unique<LoraLink>(*node.radio);
+        node.mesh = make_unique<LoraMesh>(*node.link, *node.radio);
+        node.mesh->setRouting(routing);
+    }
+    this_thread::sleep_for(chrono::duration<double>(WARMUP_S / speedup));
+    SimRadioStats warm = channel.stats();
+
+    vector<double> sentAt(messages, -1), receivedAt(messages, -1);
+    vector<int> hops(messages, 0);
+    atomic<bool> running{true};
+    vector<thread> receivers;
+    for (int i = 1; i < count; i++)
+    {
+        receivers.emplace_back([&, i] {
+            MeshMessage message;
+            while (running)
+            {
+                if (!nodes[i].mesh->receive(message, chrono::milliseconds(100)) || message.payload.size() < 4)
+                    continue;
+                const vector<uint8_t> &p = message.payload;
+                uint32_t seq = p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+                if (seq < (uint32_t)messages && seq % (count - 1) + 1 == (uint32_t)i && receivedAt[seq] < 0)
+                {
+                    hops[seq] = message.hops;
+                    receivedAt[seq] = channel.now();
+                }
+            }
+        });
+    }
+
+    for (int seq = 0; seq < messages; seq++)
+    {
+        vector<uint8_t> message(messageBytes, 0x5A);
+        message[0] = seq >> 24;
+        message[1] = seq >> 16;
+        message[2] = seq >> 8;
+        message[3] = seq;
+        sentAt[seq] = channel.now();
+        nodes[0].mesh->send(message, static_cast<uint16_t>(seq % (count - 1) + 2));
+        this_thread::sleep_for(chrono::duration<double>(INTERVAL_S / speedup));
+    }
+    // Stragglers still waiting for a route, then a flood
+    this_thread::sleep_for(chrono::duration<double>(30 / speedup));
+    running = false;
+    for (auto &receiver : receivers)
+        receiver.join();
+
+    RunResult result{};
+    result.routing = routing;
+    vector<double> latencies;
+    double hopSum = 0;
+    for (int seq = 0; seq < messages; seq++)
+    {
+        if (receivedAt[seq] < 0)
+            continue;
+        double ms = (receivedAt[seq] - sentAt[seq]) * 1000;
+        latencies.push_back(ms);
+        hopSum += hops[seq];
+        result.maxHops = max(result.maxHops, hops[seq]);
+        auto &bucket = result.byHops[hops[seq]];
+        bucket.second += (ms - bucket.second) / ++bucket.first;
+    }
+    sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies.empty() ? 0.0 : latencies[min(latencies.size() - 1, (size_t)(p * latencies.size()))];
+    };
+    result.delivered = latencies.size();
+    result.meanHops = latencies.empty() ? 0 : hopSum / latencies.size();
+    result.p50 = percentile(0.50);
+    result.p99 = percentile(0.99);
+    for (auto &node : nodes)
+    {
+        MeshStats s = node.mesh->stats();
+        result.mesh.forwarded += s.forwarded;
+        result.mesh.flooded += s.flooded;
+        result.mesh.suppressed += s.suppressed;
+        result.mesh.duplicates += s.duplicates;
+        result.mesh.advertisements += s.advertisements;
+        result.mesh.retransmitted += s.retransmitted;
+        result.mesh.routes += s.routes;
+    }
+    // Packets on air while the messages were sent, warm-up advertisements excluded
+    result.channel = channel.stats();
+    result.channel.sent -= warm.sent;
+    result.channel.airtime -= warm.airtime;
+    result.channel.collided -= warm.collided;
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    int width = argc > 1 ? stoi(argv[1]) : 4;
+    int height = argc > 2 ? stoi(argv[2]) : 4;
+    int messages = argc > 3 ? stoi(argv[3]) : 30;
+    size_t messageBytes = argc > 4 ? stoul(argv[4]) : 100;
+    double speedup = argc > 5 ? stod(argv[5]) : 50;
+    double spacing = argc > 6 ? stod(argv[6]) : 4000;
+    messageBytes = max<size_t>(messageBytes, 4);
+    width = max(width, 1);
+    height = max(height, 2 / width + 1);
+
+    cout << width << "x" << height << " nodes " << spacing << " m apart, " << messages << " messages x " << messageBytes
+         << " B from the corner at 2400 bps" << endl;
+
+    ostringstream json;
+    json << "[";
+    for (bool routing : {false, true})
+    {
+        // The driver logs every packet it handles; keep the report readable
+        streambuf *console = cout.rdbuf(nullptr);
+        RunResult r = runOnce(width, height, messages, messageBytes, speedup, spacing, routing);
+        cout.rdbuf(console);
+        cout.clear();
+
+        cout << (routing ? "routed" : "flooded") << ": delivered " << r.delivered << "/" << messages << ", hops mean "
+             << r.meanHops << " max " << r.maxHops << ", latency p50 " << r.p50 << " ms, p99 " << r.p99
+             << " ms, packets on air " << r.channel.sent << " (" << r.channel.airtime << " s), forwarded "
+             << r.mesh.forwarded << ", flooded " << r.mesh.flooded << ", suppressed " << r.mesh.suppressed
+             << ", duplicates " << r.mesh.duplicates << ", retransmitted " << r.mesh.retransmitted
+             << ", advertisements " << r.mesh.advertisements << ", collided " << r.channel.collided << endl;
+        for (const auto &[h, bucket] : r.byHops)
+            cout << "  " << h << " hops: " << bucket.first << " messages, mean latency " << bucket.second << " ms"
+                 << endl;
+
+        json << (routing ? "," : "") << "{\"mode\":\"" << (routing ? "routed" : "flooded") << "\""
+             << ",\"nodes\":" << width * height << ",\"messages\":" << messages
+             << ",\"message_bytes\":" << messageBytes << ",\"delivered\":" << r.delivered
+             << ",\"hops_mean\":" << r.meanHops << ",\"hops_max\":" << r.maxHops
+             << ",\"latency_p50_ms\":" << r.p50 << ",\"latency_p99_ms\":" << r.p99
+             << ",\"packets_on_air\":" << r.channel.sent << ",\"airtime_s\":" << r.channel.airtime
+             << ",\"forwarded\":" << r.mesh.forwarded << ",\"flooded\":" << r.mesh.flooded
+             << ",\"suppressed\":" << r.mesh.suppressed << ",\"duplicates\":" << r.mesh.duplicates
+             << ",\"retransmitted\":" << r.mesh.retransmitted << ",\"advertisements\":" << r.mesh.advertisements
+             << ",\"collided\":" << r.channel.collided << ",\"latency_by_hops\":{";
+        bool first = true;
+        for (const auto &[h, bucket] : r.byHops)
+        {
+            json << (first ? "" : ",") << "\"" << h << "\":" << bucket.second;
+            first = false;
+        }
+        json << "}}";
+    }
+    json << "]";
+    cout << "RESULT " << json.str() << endl;
+    return 0;
+}
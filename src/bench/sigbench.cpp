@@ -0,0 +1,203 @@
+// sigbench.cpp
+//
+// Signature verification throughput for an incoming sync payload. Signs
+// `transactions` transactions from `meters` meters to one receiver, then
+// verifies them three ways:
+//   naive     one signature at a time, setting up keys and contexts for each
+//   cached    verifyTransaction() on one thread, contexts and keys reused
+//   pipeline  SignatureVerifier with 1, 2, 4, ... workers up to `workers`
+//   resend    the payload and a tampered copy of it through a verifier with
+//             a ValidationCache of `cache` entries, each sent twice as
+//             snapshots resend it; the second time is answered from the cache
+// It reports verifications per second of wall time and per core (CPU time
+// of the verifying threads), checks that the tampered copy is rejected in
+// full every time, and reports the cache's hit rate and footprint.
+//
+// Usage: ./sigbench [transactions] [meters] [workers] [cache]
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <ctime>
+#include <cmath>
+#include <openssl/evp.h>
+#include "signature.h"
+#include "codec.h"
+
+using namespace std;
+
+static double processCpuSeconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static string fromHex(const string &hex)
+{
+    string raw(hex.size() / 2, '\0');
+    for (size_t i = 0; i < raw.size(); i++)
+        raw[i] = static_cast<char>(stoi(hex.substr(2 * i, 2), nullptr, 16));
+    return raw;
+}
+
+// What verification costs without the per-thread contexts: every key parsed and every context made anew
+static bool naiveVerify(const Transaction &tx)
+{
+    auto check = [](const string &keyHex, const string &message, const string &signatureHex)
+    {
+        string key = fromHex(keyHex), signature = fromHex(signatureHex);
+        EVP_PKEY *pkey = EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, nullptr,
+                                                     reinterpret_cast<const unsigned char *>(key.data()), key.size());
+        EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+        bool ok = pkey && ctx && EVP_DigestVerifyInit(ctx, nullptr, nullptr, nullptr, pkey) == 1 &&
+                  EVP_DigestVerify(ctx, reinterpret_cast<const unsigned char *>(signature.data()), signature.size(),
+                                   reinterpret_cast<const unsigned char *>(message.data()), message.size()) == 1;
+        EVP_MD_CTX_free(ctx);
+        EVP_PKEY_free(pkey);
+        return ok;
+    };
+    // The same body transactionHash() signs, digested by name each time
+    string body;
+    auto field = [&](const string &value)
+    {
+        body += to_string(value.size()) + ":" + value;
+    };
+    field(tx.transaction_id);
+    field(tx.timestamp);
+    field(tx.sender);
+    field(tx.receiver);
+    field(to_string(llround(tx.amount * AMOUNT_SCALE)));
+    field(tx.unit);
+    field(to_string(llround(tx.price_per_unit * PRICE_SCALE)));
+    field(tx.currency);
+    field(to_string(tx.previous_transactions.size()));
+    for (const auto &parent : tx.previous_transactions)
+        field(parent);
+    field(tx.sender_key);
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    EVP_Digest(body.data(), body.size(), digest, &length, EVP_get_digestbyname("SHA3-256"), nullptr);
+    string hash(reinterpret_cast<char *>(digest), length);
+
+    return check(tx.sender_key, hash, tx.sender_signature) &&
+           check(tx.receiver_key, hash + fromHex(tx.receiver_nonce), tx.receiver_signature);
+}
+
+struct Measurement
+{
+    string name;
+    size_t workers;
+    double perSecond;
+    double perCore;
+    size_t valid;
+};
+
+int main(int argc, char *argv[])
+{
+    size_t total = argc > 1 ? stoul(argv[1]) : 10000;
+    size_t meters = argc > 2 ? max<size_t>(stoul(argv[2]), 1) : 20;
+    size_t maxWorkers = argc > 3 ? max<size_t>(stoul(argv[3]), 1) : max(thread::hardware_concurrency(), 1u);
+    size_t cacheEntries = argc > 4 ? max<size_t>(stoul(argv[4]), 1) : DEFAULT_VALIDATION_CACHE_ENTRIES;
+
+    vector<SigningKey> meterKeys;
+    for (size_t m = 0; m < meters; m++)
+        meterKeys.push_back(SigningKey::fromSeed(string(31, '\x01') + static_cast<char>(m)));
+    SigningKey gridKey = SigningKey::fromSeed(string(32, '\x7f'));
+
+    vector<Transaction> payload(total);
+    for (size_t i = 0; i < total; i++)
+    {
+        Transaction &tx = payload[i];
+        tx.transaction_id = "tx" + to_string(i + 1);
+        tx.timestamp = to_string(1700000000 + i);
+        tx.sender = "Meter_" + to_string(i % meters + 1);
+        tx.receiver = "Grid";
+        tx.amount = 0.5 + (i % 450) / 100.0;
+        tx.unit = "kWh";
+        tx.price_per_unit = 0.1 + (i % 40) / 100.0;
+        tx.currency = "USD";
+        tx.cumulative_weight = 1;
+        tx.previous_transactions = {"tx" + to_string(i), "tx" + to_string(i / 2)};
+        signAsSender(tx, meterKeys[i % meters]);
+        signAsReceiver(tx, gridKey);
+    }
+
+    vector<Measurement> results;
+    auto measure = [&](const string &name, size_t workers, auto verifyAll)
+    {
+        double cpu = processCpuSeconds();
+        auto begin = chrono::steady_clock::now();
+        size_t valid = verifyAll();
+        double wall = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+        cpu = processCpuSeconds() - cpu;
+        results.push_back({name, workers, total / wall, total / cpu, valid});
+    };
+
+    measure("naive", 1, [&]
+            { return (size_t)count_if(payload.begin(), payload.end(), naiveVerify); });
+    measure("cached", 1, [&]
+            { return (size_t)count_if(payload.begin(), payload.end(), verifyTransaction); });
+    for (size_t workers = 1;; workers = min(workers * 2, maxWorkers))
+    {
+        SignatureVerifier verifier(workers);
+        measure("pipeline", workers, [&]
+                {
+                    vector<bool> valid = verifier.verify(payload);
+                    return (size_t)count(valid.begin(), valid.end(), true); });
+        if (workers == maxWorkers)
+            break;
+    }
+
+    // Every transaction of the tampered payload must fail
+    vector<Transaction> tampered = payload;
+    for (size_t i = 0; i < tampered.size(); i++)
+    {
+        if (i % 2)
+            tampered[i].amount += 1;
+        else
+            tampered[i].previous_transactions[0] = "tx-forged";
+    }
+    ValidationCache cache(cacheEntries);
+    SignatureVerifier cached(maxWorkers, &cache);
+    size_t accepted = 0;
+    for (int round = 1; round <= 2; round++)
+    {
+        measure("resend " + to_string(round), maxWorkers, [&]
+                {
+                    vector<bool> valid = cached.verify(payload);
+                    vector<bool> forged = cached.verify(tampered);
+                    accepted += count(forged.begin(), forged.end(), true);
+                    return (size_t)count(valid.begin(), valid.end(), true); });
+        // Both payloads went through: twice the transactions
+        results.back().perSecond *= 2;
+        results.back().perCore *= 2;
+    }
+    ValidationCacheStats cacheStats = cache.stats();
+
+    cout << total << " transactions from " << meters << " meters, " << thread::hardware_concurrency()
+         << " hardware threads" << endl;
+    ostringstream json;
+    json << "{\"transactions\":" << total << ",\"meters\":" << meters << ",\"runs\":[";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Measurement &m = results[i];
+        cout << "  " << m.name << " (" << m.workers << " workers): " << m.perSecond << " verifications/s, "
+             << m.perCore << " per core, " << m.valid << " valid" << endl;
+        json << (i ? "," : "") << "{\"mode\":\"" << m.name << "\",\"workers\":" << m.workers
+             << ",\"per_second\":" << m.perSecond << ",\"per_core\":" << m.perCore << ",\"valid\":" << m.valid << "}";
+    }
+    cout << "  tampered payload: " << accepted << " of " << 2 * tampered.size() << " accepted" << endl;
+    cout << "  validation cache: hit rate " << cacheStats.hitRate() << ", " << cacheStats.entries << " of "
+         << cacheStats.capacity << " entries, " << cacheStats.evictions << " evictions, "
+         << cacheStats.memoryBytes / 1024 << " kB" << endl;
+    json << "],\"tampered_accepted\":" << accepted << ",\"cache_hit_rate\":" << cacheStats.hitRate()
+         << ",\"cache_entries\":" << cacheStats.entries << ",\"cache_evictions\":" << cacheStats.evictions
+         << ",\"cache_bytes\":" << cacheStats.memoryBytes << "}";
+    cout << "RESULT " << json.str() << endl;
+    return accepted == 0 && results.back().valid == total ? 0 : 1;
+}
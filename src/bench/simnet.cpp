@@ -0,0 +1,389 @@
+// simnet.cpp
+//
+// Multi-node loopback simulation. Forks N full nodes, each with its own
+// Tangle, TCP server, peer connections and gossip, bound to 127.0.0.(i+1)
+// on the same port with every other node as a peer. Each node runs a
+// synthetic smart-meter workload, and outgoing frames go through the
+// configured link latency, bandwidth and loss. No radio is used.
+//
+// Reports time to full propagation (a transaction seen by every node),
+// per-node CPU time and peak memory, the duplicate-delivery ratio and the
+// tip count over time, followed by one machine-readable RESULT line.
+//
+// Usage: ./simnet [nodes] [tx-per-node] [tx-per-sec] [latency-ms] [bandwidth-kBps] [loss] [port] [sync-every]
+//   bandwidth-kBps 0 means unlimited; sync-every > 0 also broadcasts the
+//   full Tangle every that many transactions, as the meter loop does.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <random>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "network.h"
+#include "pow.h"
+#include "tsa.h"
+#include "signature.h"
+
+using namespace std;
+
+struct Options
+{
+    int nodes = 8;
+    int transactions = 50;
+    double rate = 5;
+    int latencyMs = 20;
+    double bandwidthKBps = 0;
+    double loss = 0;
+    int port = 9100;
+    int syncEvery = 0;
+};
+
+static const int TIP_SAMPLE_MS = 100;
+static const int SETTLE_MS = 3000; // quiet period after the last transaction
+
+static long long nowMicros()
+{
+    return chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static string nodeAddress(int i)
+{
+    return "127.0.0." + to_string(i + 1);
+}
+
+// Transactions no other transaction references as a parent
+static size_t countTips(const Tangle &tangle)
+{
+    unordered_set<string> referenced;
+    for (const auto &pair : tangle.transactions())
+    {
+        for (const auto &parent : pair.second.previous_transactions)
+            referenced.insert(parent);
+    }
+    size_t tips = 0;
+    for (const auto &pair : tangle.transactions())
+    {
+        if (!referenced.count(pair.first))
+            tips++;
+    }
+    return tips;
+}
+
+// One node; writes its measurements as text lines to out and never returns
+static void runNode(int index, const Options &opt, long long startAt, int out)
+{
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, STDOUT_FILENO);
+    dup2(devNull, STDERR_FILENO);
+
+    NetworkConfig config;
+    config.bindAddress = nodeAddress(index);
+    config.port = opt.port;
+    config.nodes.clear();
+    for (int i = 0; i < opt.nodes; i++)
+    {
+        if (i != index)
+            config.nodes.push_back(nodeAddress(i));
+    }
+    config.loraFallback = false;
+    config.link.latencyMs = opt.latencyMs;
+    config.link.bytesPerSecond = opt.bandwidthKBps * 1000;
+    config.link.lossRate = opt.loss;
+    configureNetwork(config);
+
+    Tangle tangle;
+    Transaction genesis = {"tx0", "0", 0, "node_A", "node_B", 5.0, "kWh", 0.12, "USD", {}, {}, 1, "0", "", "", "", "", ""};
+    tangle.addTransaction(genesis);
+
+    mutex recordMutex;
+    unordered_map<string, long long> firstSeen;
+    onTransactionAccepted([&](const Transaction &tx)
+                          {
+                              lock_guard<mutex> lock(recordMutex);
+                              firstSeen.emplace(tx.transaction_id, nowMicros());
+                          });
+    thread(startServer, ref(tangle)).detach();
+    gossipStats(); // connect to the peers before the workload starts
+
+    this_thread::sleep_for(chrono::microseconds(max(0LL, startAt - nowMicros())));
+
+    mt19937 gen(index);
+    SigningKey meterKey = SigningKey::generate();
+    SigningKey gridKey = SigningKey::generate();
+    uniform_real_distribution<> energyDist(0.5, 5.0);
+    uniform_real_distribution<> priceDist(0.1, 0.5);
+    vector<pair<string, long long>> created;
+    vector<pair<long long, size_t>> tips;
+
+    auto interval = chrono::microseconds(static_cast<long long>(1e6 / opt.rate));
+    auto next = chrono::steady_clock::now();
+    auto nextSample = next;
+    long long endAt = startAt + static_cast<long long>(opt.transactions / opt.rate * 1e6) + SETTLE_MS * 1000LL;
+
+    for (int k = 0; k < opt.transactions || nowMicros() < endAt;)
+    {
+        auto now = chrono::steady_clock::now();
+        if (now >= nextSample)
+        {
+            lock_guard<mutex> lock(tangleMutex);
+            tips.push_back({nowMicros(), countTips(tangle)});
+            nextSample += chrono::milliseconds(TIP_SAMPLE_MS);
+        }
+        if (k >= opt.transactions || now < next)
+        {
+            this_thread::sleep_until(k < opt.transactions ? min(next, nextSample) : nextSample);
+            continue;
+        }
+        next += interval;
+        k++;
+
+        Transaction tx;
+        tx.transaction_id = "tx" + to_string((index + 1) * 1000000 + k);
+        tx.timestamp = to_string(time(nullptr));
+        tx.timestampInt = static_cast<int>(time(nullptr));
+        tx.sender = "Meter_" + to_string(index + 1);
+        tx.receiver = "Grid";
+        tx.amount = energyDist(gen);
+        tx.unit = "kWh";
+        tx.price_per_unit = priceDist(gen);
+        tx.currency = "USD";
+        tx.cumulative_weight = 1;
+        tx.proof_of_work = performPoW(tx.transaction_id, 1);
+
+        lock_guard<mutex> lock(tangleMutex);
+        tx.previous_transactions = selectTips(tangle);
+        signAsSender(tx, meterKey);
+        signAsReceiver(tx, gridKey);
+        for (const string &parent : tx.previous_transactions)
+            tangle.updateCumulativeWeight(parent);
+        tangle.addTransaction(tx);
+        created.push_back({tx.transaction_id, nowMicros()});
+        gossipTransaction(tangle, tx);
+        if (opt.syncEvery > 0 && k % opt.syncEvery == 0)
+            broadcastTangle(tangle);
+    }
+
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    GossipStats stats = gossipStats();
+    ValidationCacheStats cache = validationCacheStats();
+
+    ostringstream report;
+    for (const auto &[id, at] : created)
+        report << "made " << id << " " << at << "\n";
+    {
+        lock_guard<mutex> lock(recordMutex);
+        for (const auto &[id, at] : firstSeen)
+            report << "seen " << id << " " << at << "\n";
+    }
+    for (const auto &[at, count] : tips)
+        report << "tips " << at << " " << count << "\n";
+    report << "stat " << (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+                             (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0
+           << " " << usage.ru_maxrss << " " << stats.published << " " << stats.received << " "
+           << stats.duplicates << " " << stats.frames << " " << cache.hits << " " << cache.misses << " "
+           << cache.memoryBytes << "\n";
+
+    string data = report.str();
+    for (size_t off = 0; off < data.size();)
+    {
+        ssize_t n = write(out, data.data() + off, data.size() - off);
+        if (n <= 0)
+            break;
+        off += n;
+    }
+    close(out);
+    _exit(0);
+}
+
+struct NodeResult
+{
+    vector<pair<string, long long>> created;
+    unordered_map<string, long long> seen;
+    vector<pair<long long, size_t>> tips;
+    double cpuMs = 0;
+    long maxRssKb = 0;
+    GossipStats stats{};
+    ValidationCacheStats cache{};
+};
+
+static NodeResult parseResult(const string &data)
+{
+    NodeResult r;
+    istringstream in(data);
+    string kind;
+    while (in >> kind)
+    {
+        if (kind == "made")
+        {
+            string id;
+            long long at;
+            in >> id >> at;
+            r.created.push_back({id, at});
+        }
+        else if (kind == "seen")
+        {
+            string id;
+            long long at;
+            in >> id >> at;
+            r.seen[id] = at;
+        }
+        else if (kind == "tips")
+        {
+            long long at;
+            size_t count;
+            in >> at >> count;
+            r.tips.push_back({at, count});
+        }
+        else if (kind == "stat")
+        {
+            in >> r.cpuMs >> r.maxRssKb >> r.stats.published >> r.stats.received >> r.stats.duplicates >>
+                r.stats.frames >> r.cache.hits >> r.cache.misses >> r.cache.memoryBytes;
+        }
+    }
+    return r;
+}
+
+int main(int argc, char *argv[])
+{
+    Options opt;
+    if (argc > 1) opt.nodes = stoi(argv[1]);
+    if (argc > 2) opt.transactions = stoi(argv[2]);
+    if (argc > 3) opt.rate = stod(argv[3]);
+    if (argc > 4) opt.latencyMs = stoi(argv[4]);
+    if (argc > 5) opt.bandwidthKBps = stod(argv[5]);
+    if (argc > 6) opt.loss = stod(argv[6]);
+    if (argc > 7) opt.port = stoi(argv[7]);
+    if (argc > 8) opt.syncEvery = stoi(argv[8]);
+
+    cout << "Simulating " << opt.nodes << " nodes x " << opt.transactions << " transactions at " << opt.rate
+         << " tx/s, link " << opt.latencyMs << " ms, " << opt.bandwidthKBps << " kB/s, " << opt.loss * 100
+         << "% loss" << endl;
+
+    long long startAt = nowMicros() + 1000000; // one second for servers to bind and peers to connect
+    vector<pid_t> children;
+    vector<int> pipes;
+    for (int i = 0; i < opt.nodes; i++)
+    {
+        int fds[2];
+        if (pipe(fds) < 0)
+        {
+            cerr << "[ERROR] pipe failed" << endl;
+            return 1;
+        }
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(fds[0]);
+            runNode(i, opt, startAt, fds[1]);
+        }
+        close(fds[1]);
+        children.push_back(pid);
+        pipes.push_back(fds[0]);
+    }
+
+    vector<NodeResult> results;
+    for (int i = 0; i < opt.nodes; i++)
+    {
+        string data;
+        char buffer[65536];
+        ssize_t n;
+        while ((n = read(pipes[i], buffer, sizeof(buffer))) > 0)
+            data.append(buffer, n);
+        close(pipes[i]);
+        waitpid(children[i], nullptr, 0);
+        results.push_back(parseResult(data));
+    }
+
+    // Full propagation: the last node to see a transaction, relative to its creation
+    vector<double> propagationMs;
+    size_t total = 0;
+    for (int i = 0; i < opt.nodes; i++)
+    {
+        for (const auto &[id, createdAt] : results[i].created)
+        {
+            total++;
+            long long last = createdAt;
+            bool everywhere = true;
+            for (int j = 0; j < opt.nodes && everywhere; j++)
+            {
+                if (j == i)
+                    continue;
+                auto it = results[j].seen.find(id);
+                if (it == results[j].seen.end())
+                    everywhere = false;
+                else
+                    last = max(last, it->second);
+            }
+            if (everywhere)
+                propagationMs.push_back((last - createdAt) / 1000.0);
+        }
+    }
+    sort(propagationMs.begin(), propagationMs.end());
+    auto percentile = [&](double p) {
+        return propagationMs.empty() ? 0.0 : propagationMs[min(propagationMs.size() - 1, (size_t)(p * propagationMs.size()))];
+    };
+
+    uint64_t received = 0, duplicates = 0, frames = 0, cacheHits = 0, cacheLookups = 0;
+    double cpuMs = 0;
+    long maxRss = 0;
+    for (int i = 0; i < opt.nodes; i++)
+    {
+        const NodeResult &r = results[i];
+        received += r.stats.received;
+        duplicates += r.stats.duplicates;
+        frames += r.stats.frames;
+        cacheHits += r.cache.hits;
+        cacheLookups += r.cache.hits + r.cache.misses;
+        cpuMs += r.cpuMs;
+        maxRss = max(maxRss, r.maxRssKb);
+        cout << "Node " << nodeAddress(i) << ": cpu " << r.cpuMs << " ms, max rss " << r.maxRssKb
+             << " kB, received " << r.stats.received << " (" << r.stats.duplicates << " duplicate), frames sent "
+             << r.stats.frames << ", validation cache hit rate " << r.cache.hitRate() << " ("
+             << r.cache.memoryBytes / 1024 << " kB)" << endl;
+    }
+    double fullFraction = total ? double(propagationMs.size()) / total : 0;
+    double duplicateRatio = received ? double(duplicates) / received : 0;
+    double cacheHitRate = cacheLookups ? double(cacheHits) / cacheLookups : 0;
+
+    cout << "Fully propagated " << propagationMs.size() << "/" << total << " transactions" << endl
+         << "Propagation p50 " << percentile(0.50) << " ms, p99 " << percentile(0.99) << " ms, max "
+         << (propagationMs.empty() ? 0.0 : propagationMs.back()) << " ms" << endl
+         << "Duplicate deliveries: " << duplicateRatio * 100 << "% of " << received << " arrivals" << endl
+         << "Validation cache: " << cacheHitRate * 100 << "% of " << cacheLookups << " lookups hit" << endl;
+
+    // Tip count over time, per sample period, from node 0's view
+    const auto &tips = results.empty() ? vector<pair<long long, size_t>>() : results[0].tips;
+    cout << "Tips over time (node 0, every " << TIP_SAMPLE_MS << " ms):";
+    for (size_t i = 0; i < tips.size(); i += max<size_t>(1, tips.size() / 20))
+        cout << " " << tips[i].second;
+    cout << endl;
+
+    ostringstream json;
+    json << "{\"nodes\":" << opt.nodes << ",\"transactions\":" << total << ",\"latency_ms\":" << opt.latencyMs
+         << ",\"bandwidth_kBps\":" << opt.bandwidthKBps << ",\"loss\":" << opt.loss
+         << ",\"full_propagation\":" << fullFraction << ",\"propagation_p50_ms\":" << percentile(0.50)
+         << ",\"propagation_p99_ms\":" << percentile(0.99)
+         << ",\"propagation_max_ms\":" << (propagationMs.empty() ? 0.0 : propagationMs.back())
+         << ",\"duplicate_ratio\":" << duplicateRatio << ",\"frames\":" << frames
+         << ",\"cpu_ms_per_node\":" << (opt.nodes ? cpuMs / opt.nodes : 0) << ",\"max_rss_kb\":" << maxRss
+         << ",\"validation_cache_hit_rate\":" << cacheHitRate
+         << ",\"tips\":[";
+    for (size_t i = 0; i < tips.size(); i++)
+        json << (i ? "," : "") << tips[i].second;
+    json << "]}";
+    cout << "RESULT " << json.str() << endl;
+    return 0;
+}
@@ -0,0 +1,224 @@
+// tsabench.cpp
+//
+// Tip-selection latency as the Tangle deepens. Builds reproducible
+// synthetic tangles in which every transaction approves two tips of the
+// Tangle as it was `delay` transactions earlier (the ones still in flight
+// are unknown to its issuer), then times MCMC tip selection on a
+// WalkExecutor with the walks starting at genesis and at the entry points
+// `depth` levels below the highest transaction. Besides latency, reports
+// how the selected tips are spread: how many distinct tips were reached
+// against how many are on the frontier (within `depth` levels of the
+// highest transaction), how far below the highest transaction they sit on
+// average, and the total variation distance between the two tip
+// distributions.
+//
+// Usage: ./tsabench [transactions] [calls] [delay] [workers] [depth] [seed]
+//   Without transactions, sweeps 10^4 to 10^6. Each measurement stops
+//   after `calls` calls or 10 seconds, whichever comes first.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <unordered_map>
+#include <cmath>
+#include <cstdint>
+#include "tsa.h"
+
+using namespace std;
+
+struct Options
+{
+    int calls = 200;
+    size_t delay = 20;
+    size_t workers = max(thread::hardware_concurrency(), 2u);
+    size_t depth = DEFAULT_ENTRY_DEPTH;
+    uint64_t seed = 1;
+};
+
+struct Latency
+{
+    double p50, p99, max;
+};
+
+static Latency summarize(vector<double> samples)
+{
+    sort(samples.begin(), samples.end());
+    auto at = [&](double p) { return samples[min(samples.size() - 1, (size_t)(p * samples.size()))]; };
+    return {at(0.50), at(0.99), samples.back()};
+}
+
+// Transaction i approves two tips among the transactions issued before i - delay, as they stood then;
+// every approval adds to the parent's weight
+static void buildTangle(Tangle &tangle, size_t count, size_t delay, uint64_t seed)
+{
+    const size_t NEVER = SIZE_MAX;
+    mt19937_64 rng(seed);
+    vector<string> ids;
+    vector<size_t> approvedBy; // first approver of each transaction
+    ids.reserve(count + 1);
+    approvedBy.reserve(count + 1);
+
+    Transaction genesis{};
+    genesis.transaction_id = "tx0";
+    genesis.cumulative_weight = 1;
+    tangle.addTransaction(genesis);
+    ids.push_back(genesis.transaction_id);
+    approvedBy.push_back(NEVER);
+
+    vector<size_t> candidates;
+    for (size_t i = 1; i <= count; i++)
+    {
+        Transaction tx{};
+        tx.transaction_id = "tx" + to_string(i);
+        tx.cumulative_weight = 1;
+        // Tips of the view are almost always among its last few delays' worth of transactions
+        size_t seen = i > delay ? i - delay : 1;
+        size_t from = seen > 4 * delay ? seen - 4 * delay : 0;
+        candidates.clear();
+        for (size_t j = from; j < seen; j++)
+        {
+            if (approvedBy[j] == NEVER || approvedBy[j] >= seen)
+                candidates.push_back(j);
+        }
+        if (candidates.empty())
+            candidates.push_back(seen - 1);
+        uniform_int_distribution<size_t> pick(0, candidates.size() - 1);
+        size_t a = candidates[pick(rng)], b = candidates[pick(rng)];
+        tx.previous_transactions.push_back(ids[a]);
+        if (b != a)
+            tx.previous_transactions.push_back(ids[b]);
+        for (size_t parent : {a, b})
+            approvedBy[parent] = min(approvedBy[parent], i);
+        tangle.addTransaction(tx);
+        for (const auto &parent : tx.previous_transactions)
+            tangle.updateCumulativeWeight(parent);
+        ids.push_back(tx.transaction_id);
+        approvedBy.push_back(NEVER);
+    }
+}
+
+struct Selection
+{
+    Latency latency;
+    size_t calls = 0;
+    unordered_map<string, size_t> hits; // tip -> times selected
+    double lag = 0;                     // levels below the highest transaction, mean over selections
+};
+
+static Selection timeSelection(const Tangle &tangle, WalkExecutor &executor, int calls)
+{
+    const double BUDGET_US = 10e6;
+    Selection out;
+    executor.walk(tangle, 2, WalkBias::Exponential); // builds the transition tables
+    vector<double> samples;
+    double spent = 0;
+    for (int i = 0; i < calls && spent < BUDGET_US; i++)
+    {
+        auto begin = chrono::steady_clock::now();
+        vector<string> tips = executor.walk(tangle, 2, WalkBias::Exponential);
+        samples.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - begin).count());
+        spent += samples.back();
+        for (const auto &tip : tips)
+        {
+            out.hits[tip]++;
+            out.lag += tangle.height() - tangle.heightOf(tip);
+        }
+    }
+    out.calls = samples.size();
+    out.latency = summarize(samples);
+    out.lag /= 2.0 * out.calls;
+    return out;
+}
+
+// Half the summed difference between the two selection frequencies of every tip
+static double variationDistance(const Selection &a, const Selection &b)
+{
+    double distance = 0;
+    for (const auto &[tip, n] : a.hits)
+    {
+        auto other = b.hits.find(tip);
+        distance += fabs(double(n) / (2 * a.calls) - (other != b.hits.end() ? double(other->second) / (2 * b.calls) : 0));
+    }
+    for (const auto &[tip, n] : b.hits)
+    {
+        if (!a.hits.count(tip))
+            distance += double(n) / (2 * b.calls);
+    }
+    return distance / 2;
+}
+
+int main(int argc, char *argv[])
+{
+    Options opt;
+    vector<size_t> sizes = {10000, 100000, 1000000};
+    if (argc > 1)
+        sizes = {stoul(argv[1])};
+    if (argc > 2)
+        opt.calls = stoi(argv[2]);
+    if (argc > 3)
+        opt.delay = stoul(argv[3]);
+    if (argc > 4)
+        opt.workers = max<size_t>(stoul(argv[4]), 1);
+    if (argc > 5)
+        opt.depth = stoul(argv[5]);
+    if (argc > 6)
+        opt.seed = stoull(argv[6]);
+
+    cout << "MCMC tip selection, " << opt.delay << " transactions in flight, " << opt.workers
+         << " workers, entry points " << opt.depth << " levels down, " << opt.calls << " calls each" << endl;
+
+    ostringstream json;
+    json << "[";
+    bool first = true;
+    for (size_t size : sizes)
+    {
+        Tangle tangle;
+        buildTangle(tangle, size, opt.delay, opt.seed);
+        size_t tips = 0, frontier = 0; // frontier: tips no more than depth levels below the highest
+        for (const auto &[id, tx] : tangle.transactions())
+        {
+            if (tangle.approversOf(id).empty())
+            {
+                tips++;
+                frontier += tangle.height() - tangle.heightOf(id) <= opt.depth;
+            }
+        }
+
+        WalkExecutor executor(opt.workers, opt.seed);
+        tangle.setEntryDepth(SIZE_MAX);
+        Selection genesis = timeSelection(tangle, executor, opt.calls);
+        tangle.setEntryDepth(opt.depth);
+        Selection entry = timeSelection(tangle, executor, opt.calls);
+        double distance = variationDistance(genesis, entry);
+
+        cout << size << " transactions, height " << tangle.height() << ", " << tips << " tips (" << frontier << " on the frontier), "
+             << tangle.entryPoints().size() << " entry points" << endl;
+        for (const auto &[name, sel] : {make_pair("genesis", &genesis), make_pair("entry", &entry)})
+        {
+            cout << "  " << name << ": p50 " << sel->latency.p50 << " us p99 " << sel->latency.p99 << " us over "
+                 << sel->calls << " calls, " << sel->hits.size() << " distinct tips, mean lag " << sel->lag
+                 << " levels" << endl;
+        }
+        cout << "  tip distribution distance " << distance << endl;
+
+        json << (first ? "" : ",") << "{\"transactions\":" << size << ",\"height\":" << tangle.height()
+             << ",\"tips\":" << tips << ",\"frontier_tips\":" << frontier << ",\"delay\":" << opt.delay << ",\"workers\":" << opt.workers
+             << ",\"depth\":" << opt.depth;
+        for (const auto &[name, sel] : {make_pair("genesis", &genesis), make_pair("entry", &entry)})
+        {
+            json << ",\"" << name << "_p50_us\":" << sel->latency.p50 << ",\"" << name
+                 << "_p99_us\":" << sel->latency.p99 << ",\"" << name << "_calls\":" << sel->calls << ",\""
+                 << name << "_distinct_tips\":" << sel->hits.size() << ",\"" << name << "_mean_lag\":" << sel->lag;
+        }
+        json << ",\"tip_distance\":" << distance << "}";
+        first = false;
+    }
+    json << "]";
+    cout << "RESULT " << json.str() << endl;
+    return 0;
+}
@@ -0,0 +1,286 @@
+// tsasuite.cpp
+//
+// Compares the tip-selection algorithms by growing a synthetic Tangle with
+// each of them. Transactions are issued at Poisson arrival times at `rate`
+// per second. Each one approves `parents` tips that the algorithm picks on
+// the Tangle as the network knew it when it was issued. It reaches the
+// Tangle `delay-ms` later. Arrival times are drawn from the seed and are
+// the same for every algorithm; every figure below is in simulated time
+// except the per-call latency.
+//
+// The walk algorithms run on a WalkExecutor seeded from the seed, with the
+// bias the TSA function uses, so the runs are reproducible and can take
+// any number of parents. selectTips takes maxParents from `parents`.
+//
+// For each algorithm and size, reports:
+//   per-call latency     p50 and p99 wall time to choose one transaction's parents
+//   allocations          operator new calls and bytes per selection, on every thread
+//   tips                 unapproved transactions the Tangle held at each tenth of the run
+//   orphan rate          share of transactions not approved within orphan-s of being issued
+//   approval latency     p50 and p99 time from issue to the first approver reaching the Tangle
+//
+// Usage: ./tsasuite [transactions] [rate] [parents] [delay-ms] [orphan-s] [seed]
+//   Without transactions, sweeps 10^3 to 10^6.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <random>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+#include <algorithm>
+#include <functional>
+#include <unordered_set>
+#include "tsa.h"
+
+using namespace std;
+
+static atomic<uint64_t> allocations{0};
+static atomic<uint64_t> allocatedBytes{0};
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, memory_order_relaxed);
+    allocatedBytes.fetch_add(size, memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+struct Options
+{
+    double rate = 20;
+    size_t parents = 2;
+    double delay = 0.5; // seconds
+    double orphanAfter = 30;
+    uint64_t seed = 1;
+    size_t workers = 1;
+};
+
+using Clock = TipPool::Clock;
+using Selector = function<vector<string>(Tangle &, Clock::time_point)>;
+
+struct Algorithm
+{
+    const char *name;
+    WalkBias bias;
+    bool walk; // false: selectTips
+};
+
+// The biases selectTipsMCMC, selectTipsGWW, selectTipsURW and selectTipsWRW walk with
+static const Algorithm ALGORITHMS[] = {
+    {"default", WalkBias::Uniform, false},
+    {"mcmc", WalkBias::Exponential, true},
+    {"gww", WalkBias::Weight, true},
+    {"urw", WalkBias::Uniform, true},
+    {"wrw", WalkBias::Weight, true},
+};
+
+struct Percentiles
+{
+    double p50 = 0, p99 = 0;
+};
+
+static Percentiles percentiles(vector<double> samples)
+{
+    Percentiles out;
+    if (samples.empty())
+        return out;
+    sort(samples.begin(), samples.end());
+    out.p50 = samples[samples.size() / 2];
+    out.p99 = samples[min(samples.size() - 1, (size_t)(0.99 * samples.size()))];
+    return out;
+}
+
+struct RunResult
+{
+    Percentiles latencyUs;
+    double allocationsPerCall = 0;
+    double bytesPerCall = 0;
+    vector<size_t> tips; // at each tenth of the run
+    double orphanRate = 0;
+    Percentiles approvalS;
+    double meanParents = 0;
+};
+
+struct InFlight
+{
+    Transaction tx;
+    double visibleAt;
+};
+
+static RunResult run(const Algorithm &algorithm, size_t count, const Options &opt)
+{
+    mt19937_64 arrivals(opt.seed);
+    exponential_distribution<double> gap(opt.rate);
+    WalkExecutor executor(opt.workers, opt.seed);
+    Clock::time_point epoch = Clock::now();
+    auto at = [&](double t) { return epoch + chrono::duration_cast<Clock::duration>(chrono::duration<double>(t)); };
+
+    Selector select;
+    if (algorithm.walk)
+        select = [&](Tangle &t, Clock::time_point) { return executor.walk(t, opt.parents, algorithm.bias); };
+    else
+        select = [](Tangle &t, Clock::time_point now) { return selectTips(t, now); };
+
+    Tangle tangle;
+    tangle.tips().setMaxParents(opt.parents);
+    tangle.tips().seed(opt.seed);
+    vector<double> issuedAt{0};    // by transaction number; 0 is genesis
+    vector<double> approvedAt{-1}; // first approver reached the Tangle; -1: not yet
+    size_t unapproved = 1;
+    Transaction genesis{};
+    genesis.transaction_id = "tx0";
+    genesis.cumulative_weight = 1;
+    tangle.addTransaction(genesis, at(0));
+
+    RunResult result;
+    vector<double> latency;
+    latency.reserve(count);
+    uint64_t allocationCount = 0, allocationBytes = 0, parentCount = 0;
+    deque<InFlight> inFlight;
+
+    // Every transaction issued so far reaches the Tangle, in issue order
+    auto deliver = [&](double until)
+    {
+        while (!inFlight.empty() && inFlight.front().visibleAt <= until)
+        {
+            InFlight &next = inFlight.front();
+            for (const auto &parent : next.tx.previous_transactions)
+            {
+                size_t n = stoul(parent.substr(2));
+                if (approvedAt[n] < 0)
+                {
+                    approvedAt[n] = next.visibleAt;
+                    unapproved--;
+                }
+                tangle.updateCumulativeWeight(parent);
+            }
+            tangle.addTransaction(next.tx, at(next.visibleAt));
+            unapproved++;
+            inFlight.pop_front();
+        }
+    };
+
+    double now = 0;
+    for (size_t i = 1; i <= count; i++)
+    {
+        now += gap(arrivals);
+        deliver(now);
+
+        uint64_t allocationsBefore = allocations.load(), bytesBefore = allocatedBytes.load();
+        auto begin = chrono::steady_clock::now();
+        vector<string> parents = select(tangle, at(now));
+        latency.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - begin).count());
+        allocationCount += allocations.load() - allocationsBefore;
+        allocationBytes += allocatedBytes.load() - bytesBefore;
+
+        // Walks may meet on the same tip; it is approved once
+        unordered_set<string> seen;
+        Transaction tx{};
+        tx.transaction_id = "tx" + to_string(i);
+        tx.cumulative_weight = 1;
+        for (auto &parent : parents)
+        {
+            if (seen.insert(parent).second)
+                tx.previous_transactions.push_back(move(parent));
+        }
+        parentCount += tx.previous_transactions.size();
+        inFlight.push_back({move(tx), now + opt.delay});
+        issuedAt.push_back(now);
+        approvedAt.push_back(-1);
+
+        if (i % max<size_t>(count / 10, 1) == 0)
+            result.tips.push_back(unapproved);
+    }
+    deliver(now + opt.delay);
+
+    // Only transactions old enough to have had orphanAfter seconds count toward the orphan rate
+    size_t old = 0, orphans = 0;
+    vector<double> approval;
+    for (size_t n = 0; n < issuedAt.size(); n++)
+    {
+        if (approvedAt[n] >= 0)
+            approval.push_back(approvedAt[n] - issuedAt[n]);
+        if (issuedAt[n] + opt.orphanAfter <= now)
+        {
+            old++;
+            orphans += approvedAt[n] < 0 || approvedAt[n] - issuedAt[n] > opt.orphanAfter;
+        }
+    }
+
+    result.latencyUs = percentiles(move(latency));
+    result.allocationsPerCall = double(allocationCount) / count;
+    result.bytesPerCall = double(allocationBytes) / count;
+    result.orphanRate = old ? double(orphans) / old : 0;
+    result.approvalS = percentiles(move(approval));
+    result.meanParents = double(parentCount) / count;
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    Options opt;
+    vector<size_t> sizes = {1000, 10000, 100000, 1000000};
+    if (argc > 1)
+        sizes = {stoul(argv[1])};
+    if (argc > 2)
+        opt.rate = stod(argv[2]);
+    if (argc > 3)
+        opt.parents = max<size_t>(stoul(argv[3]), 1);
+    if (argc > 4)
+        opt.delay = stod(argv[4]) / 1000;
+    if (argc > 5)
+        opt.orphanAfter = stod(argv[5]);
+    if (argc > 6)
+        opt.seed = stoull(argv[6]);
+
+    cout << "Tip selection at " << opt.rate << " tx/s, " << opt.parents << " parents, " << opt.delay * 1000
+         << " ms delay, orphaned after " << opt.orphanAfter << " s" << endl;
+
+    ostringstream json;
+    json << "[";
+    bool first = true;
+    for (size_t size : sizes)
+    {
+        for (const auto &algorithm : ALGORITHMS)
+        {
+            RunResult r = run(algorithm, size, opt);
+
+            cout << size << " " << algorithm.name << ": p50 " << r.latencyUs.p50 << " us p99 " << r.latencyUs.p99
+                 << " us, " << r.allocationsPerCall << " allocs (" << r.bytesPerCall << " B) per call, "
+                 << r.meanParents << " parents, " << (r.tips.empty() ? 0 : r.tips.back()) << " tips, orphan rate "
+                 << r.orphanRate << ", approval p50 " << r.approvalS.p50 << " s p99 " << r.approvalS.p99 << " s"
+                 << endl;
+
+            json << (first ? "" : ",") << "{\"algorithm\":\"" << algorithm.name << "\",\"transactions\":" << size
+                 << ",\"rate\":" << opt.rate << ",\"parents\":" << opt.parents << ",\"delay_ms\":" << opt.delay * 1000
+                 << ",\"seed\":" << opt.seed << ",\"latency_p50_us\":" << r.latencyUs.p50
+                 << ",\"latency_p99_us\":" << r.latencyUs.p99 << ",\"allocations_per_call\":" << r.allocationsPerCall
+                 << ",\"bytes_per_call\":" << r.bytesPerCall << ",\"mean_parents\":" << r.meanParents << ",\"tips\":[";
+            for (size_t i = 0; i < r.tips.size(); i++)
+                json << (i ? "," : "") << r.tips[i];
+            json << "],\"orphan_rate\":" << r.orphanRate << ",\"approval_p50_s\":" << r.approvalS.p50
+                 << ",\"approval_p99_s\":" << r.approvalS.p99 << "}";
+            first = false;
+        }
+    }
+    json << "]";
+    cout << "RESULT " << json.str() << endl;
+    return 0;
+}
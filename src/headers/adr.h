@@ -0,0 +1,80 @@
+#ifndef ADR_H
+#define ADR_H
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+
+// Every node can always fall back to this and hear the others
+static const int BASE_AIR_SPEED = 2400;
+static const int BASE_POWER = 22;
+
+struct NeighbourQuality {
+    double rssi = 0;    // smoothed packet RSSI, dBm
+    size_t samples = 0;
+    std::chrono::steady_clock::time_point lastHeard;
+};
+
+/**
+ * What this node hears of each neighbour: smoothed packet RSSI per source
+ * address and the channel noise floor. Links are assumed symmetric, so a
+ * neighbour's RSSI here also stands for how well it hears us.
+ */
+class LinkQuality {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void observe(uint16_t src, int rssi, Clock::time_point now);
+    void setNoise(int noiseDbm) { noise = noiseDbm; }
+    // Moves every neighbour's RSSI by db, after the network changes transmit power
+    void shift(double db);
+
+    // dB the neighbour's signal clears sensitivity at airSpeed by, after dropping `powerDrop` dB of
+    // transmit power and allowing for noise above a quiet channel
+    double margin(uint16_t src, int airSpeed, int powerDrop) const;
+
+    // Neighbours heard within `recent` with at least minSamples RSSI readings
+    std::vector<uint16_t> active(Clock::time_point now, Clock::duration recent, size_t minSamples) const;
+    // Last time anything was heard from anyone
+    Clock::time_point lastHeard() const { return heardAny; }
+    const std::unordered_map<uint16_t, NeighbourQuality>& neighbours() const { return table; }
+
+private:
+    std::unordered_map<uint16_t, NeighbourQuality> table;
+    Clock::time_point heardAny;
+    int noise = 0;
+};
+
+/**
+ * Picks the fastest air speed, then the lowest power, at which every active
+ * neighbour keeps a target link margin. The margin grows while the observed
+ * fragment loss is above target and relaxes again once it falls, so a link
+ * that looks good on RSSI but still loses packets slows down. Speeding up
+ * needs a few dB of headroom beyond the margin, so the rate does not flap.
+ */
+class AdrPolicy {
+public:
+    explicit AdrPolicy(double lossTarget = 0.1);
+
+    // Adjusts the required margin from the latest loss estimate
+    void updateLoss(double loss);
+
+    // Settings to propose, or false to keep the current ones
+    bool choose(const LinkQuality& links, const std::vector<uint16_t>& neighbours, int airSpeed, int power,
+                int& newAirSpeed, int& newPower) const;
+
+    // Whether this node can follow a neighbour's proposal: it keeps the margin, or at least does not
+    // lose any compared with the current setting
+    bool acceptable(const LinkQuality& links, uint16_t proposer, int airSpeed, int power, int currentAirSpeed,
+                    int currentPower) const;
+
+    double requiredMargin() const { return baseMargin + penalty; }
+
+private:
+    double lossTarget;
+    double baseMargin;
+    double penalty;
+};
+
+#endif // ADR_H
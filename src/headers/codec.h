@@ -0,0 +1,58 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include "transaction.h"
+
+// First byte of a compact radio message; never starts a text serialization
+static const uint8_t COMPACT_MAGIC = 0xC7;
+
+// Fixed-point scales used on the radio (amount in 1e-5 units, price in 1e-6 units)
+static const double AMOUNT_SCALE = 100000.0;
+static const double PRICE_SCALE = 1000000.0;
+
+/**
+ * Packs transactions into a compact binary message for LoRa.
+ *
+ * Strings go through a static dictionary shared by all nodes plus an adaptive
+ * dictionary that both ends grow in the same order while walking one message,
+ * so a lost frame never desynchronises later ones. Timestamps are delta-encoded,
+ * amounts and prices are fixed-point varints, "tx<number>" ids are stored as
+ * numbers and parents already in the message are back-references. Public keys
+ * are sent as raw bytes the first time in a message and as adaptive
+ * dictionary indices after that; signatures and nonces are packed hex.
+ */
+class CompactEncoder {
+public:
+    explicit CompactEncoder(size_t limit);
+
+    // Appends tx if it fits within limit (the first record is always accepted)
+    bool add(const Transaction& tx);
+    bool empty() const { return records == 0; }
+    const std::vector<uint8_t>& data() const { return buffer; }
+    void reset();
+
+private:
+    void putString(const std::string& str);
+    void putId(const std::string& id);
+    void putHex(const std::string& str);
+    void putKey(const std::string& key);
+
+    size_t limit;
+    size_t records;
+    int64_t lastTimestamp;
+    std::vector<uint8_t> buffer;
+    std::vector<std::string> adaptive;
+    std::unordered_map<std::string, size_t> positions;
+};
+
+// Encodes all transactions into messages of at most limit bytes each
+std::vector<std::vector<uint8_t>> encodeCompact(const std::vector<const Transaction*>& txs, size_t limit);
+
+// Decodes one compact message, returns false if it is malformed
+bool decodeCompact(const uint8_t* data, size_t length, std::vector<Transaction>& out);
+
+#endif // CODEC_H
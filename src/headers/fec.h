@@ -0,0 +1,47 @@
+#ifndef FEC_H
+#define FEC_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Reed-Solomon over GF(256) limits a coded message to 255 fragments
+static const size_t FEC_MAX_BLOCKS = 255;
+
+/**
+ * Systematic Reed-Solomon erasure code over GF(256). The k data blocks are
+ * sent as they are, followed by parity blocks from the rows of a Cauchy
+ * matrix; every k x k submatrix of [I; Cauchy] is invertible, so the data
+ * comes back from any k of the k + parity blocks.
+ */
+
+// Parity blocks for k equal-length data blocks
+std::vector<std::vector<uint8_t>> encodeParity(const std::vector<std::vector<uint8_t>>& data, size_t parity);
+
+// blocks holds all n blocks (data first), present[i] telling which arrived; rebuilds the missing
+// data blocks in place. Fails if fewer than k blocks are present or they differ in length.
+bool decodeErasures(std::vector<std::vector<uint8_t>>& blocks, const std::vector<bool>& present, size_t k);
+
+// Parity blocks needed for k data blocks to arrive with about 85% confidence at the given loss rate;
+// none below 1% loss, which an estimator that has seen no loss for a while still reports
+size_t parityFor(size_t k, double loss);
+
+/**
+ * Fragment loss seen by a sender, from the fragments it sends and the ones
+ * NACKs report missing. Both counts decay with every message so the
+ * estimate follows a changing channel.
+ */
+class LossEstimator {
+public:
+    explicit LossEstimator(double initial = 0.1);
+
+    void sent(size_t fragments);
+    void lost(size_t fragments);
+    double rate() const;
+
+private:
+    double sentCount;
+    double lostCount;
+};
+
+#endif // FEC_H
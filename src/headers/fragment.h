@@ -0,0 +1,187 @@
+#ifndef FRAGMENT_H
+#define FRAGMENT_H
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <chrono>
+#include "fec.h"
+
+// Packet types for framing
+enum PacketType : uint8_t {
+    PT_START = 0x01,
+    PT_MIDDLE = 0x02,
+    PT_END = 0x03,
+    PT_NACK = 0x04,
+    PT_CODED = 0x05, // erasure-coded fragment, data or parity
+    PT_RATE = 0x06   // air speed and power negotiation, see adr.h
+};
+
+#pragma pack(push, 1)
+// Leads every data fragment; totalPackets is repeated in each so any fragment can open an assembly
+struct PacketHeader {
+    PacketType type;
+    uint16_t messageId;
+    uint16_t packetId;
+    uint16_t totalPackets;
+};
+
+// Leads every fragment of an erasure-coded message: dataPackets data blocks, then parity blocks.
+// The data blocks are padded to equal length; padding bytes are dropped from the end on rebuild.
+struct CodedHeader {
+    PacketType type;
+    uint16_t messageId;
+    uint16_t packetId;
+    uint16_t totalPackets;
+    uint8_t dataPackets;
+    uint8_t padding;
+};
+
+// Leads a NACK; followed by a bitmap of totalPackets bits, bit i set when fragment i is missing
+struct NackHeader {
+    PacketType type;
+    uint16_t messageId;
+    uint16_t origin; // address of the node that sent the message
+    uint16_t totalPackets;
+};
+
+enum RatePhase : uint8_t {
+    RATE_HELLO = 0,   // beacon so neighbours keep measuring us
+    RATE_PROPOSE = 1, // proposer asks every neighbour to move to airSpeed/power
+    RATE_ACK = 2,     // neighbour can follow
+    RATE_REJECT = 3,  // neighbour would lose the proposer
+    RATE_COMMIT = 4   // everyone acked; switch now
+};
+
+// A whole rate negotiation packet
+struct RateHeader {
+    PacketType type;
+    uint8_t proposal;
+    RatePhase phase;
+    uint16_t airSpeed;
+    int8_t power;
+};
+#pragma pack(pop)
+
+static const size_t MAX_FRAGMENTS = 1024; // larger messages are refused
+
+// Splits a message into fragments of at most maxPayload data bytes, each led by a PacketHeader
+std::vector<std::vector<uint8_t>> fragmentMessage(uint16_t messageId, const uint8_t* data, size_t length,
+                                                  size_t maxPayload);
+
+// Same, erasure coded with enough parity for the expected loss rate; the message can be rebuilt from
+// any dataPackets of its fragments. Empty if the message needs more than FEC_MAX_BLOCKS fragments.
+std::vector<std::vector<uint8_t>> fragmentCoded(uint16_t messageId, const uint8_t* data, size_t length,
+                                                size_t maxPayload, double loss);
+
+struct Nack {
+    uint16_t origin;
+    uint16_t messageId;
+    uint16_t totalPackets;
+    std::vector<uint8_t> missing; // bitmap, bit i set when fragment i is missing
+};
+
+std::vector<uint8_t> encodeNack(const Nack& nack);
+bool decodeNack(const uint8_t* data, size_t length, Nack& nack);
+
+struct ReassemblyStats {
+    uint64_t completed = 0;
+    uint64_t duplicates = 0; // fragments of messages already held or already completed
+    uint64_t expired = 0;    // messages dropped after the timeout
+    uint64_t evicted = 0;    // messages dropped to stay within the memory bound
+    size_t assemblies = 0;
+    size_t bytes = 0;
+};
+
+/**
+ * Rebuilds messages from fragments that may arrive lost, duplicated or out
+ * of order; erasure-coded messages complete as soon as enough fragments
+ * are in. Memory is bounded: at most maxAssemblies partial messages and
+ * maxBytes of buffered fragment data, the least recently active assembly
+ * being evicted first. Partial messages are dropped by expire(), and
+ * recently completed ones are remembered so retransmissions for them are
+ * ignored.
+ */
+class Reassembler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Reassembler(size_t maxAssemblies, size_t maxBytes);
+
+    // Adds one fragment (header included) from src; returns true when it completes a message,
+    // which is moved into message
+    bool add(uint16_t src, const uint8_t* fragment, size_t length, std::vector<uint8_t>& message,
+             Clock::time_point now);
+
+    // NACKs for partial messages that have been quiet for `quiet`, at most maxRounds in a row without progress
+    std::vector<Nack> stalled(Clock::time_point now, Clock::duration quiet, int maxRounds);
+
+    // Drops partial messages whose first fragment arrived more than `timeout` ago
+    void expire(Clock::time_point now, Clock::duration timeout);
+
+    ReassemblyStats stats() const;
+
+private:
+    struct Assembly {
+        uint16_t src;
+        uint16_t messageId;
+        uint16_t total;
+        uint16_t needed;     // fragments that complete the message: all of them, or the data count if coded
+        uint8_t padding = 0;
+        bool coded = false;
+        size_t blockSize = 0; // coded: the longest block seen, which every fragment should carry
+        std::vector<std::vector<uint8_t>> parts;
+        std::vector<bool> present;
+        size_t received = 0;
+        size_t bytes = 0;
+        Clock::time_point first;
+        Clock::time_point last;
+        int nackRounds = 0;
+    };
+
+    static uint32_t key(uint16_t src, uint16_t messageId) { return static_cast<uint32_t>(src) << 16 | messageId; }
+    static bool rebuild(Assembly& assembly, std::vector<uint8_t>& message);
+    void drop(std::unordered_map<uint32_t, Assembly>::iterator it);
+    void rememberCompleted(uint32_t id);
+    void enforceLimits(uint32_t keep);
+
+    size_t maxAssemblies;
+    size_t maxBytes;
+    std::unordered_map<uint32_t, Assembly> assemblies;
+    std::deque<uint32_t> completedOrder;
+    std::unordered_set<uint32_t> completed;
+    ReassemblyStats counters;
+};
+
+/**
+ * Fragments of the most recently sent messages, kept so a NACK can be
+ * answered with just the fragments it lists.
+ */
+class SendWindow {
+public:
+    explicit SendWindow(size_t maxMessages);
+
+    void store(uint16_t messageId, std::vector<std::vector<uint8_t>> fragments);
+    // The fragments to resend for the NACK: every one it marks missing, or for a coded message just
+    // enough of them to make up its data count, plus parity for the loss rate. Empty if the message
+    // has left the window.
+    std::vector<std::vector<uint8_t>> missing(const Nack& nack, double loss) const;
+    // True for the first NACK seen for a message, so its losses are counted once
+    bool firstNack(const Nack& nack);
+
+private:
+    struct Sent {
+        uint16_t messageId;
+        std::vector<std::vector<uint8_t>> fragments;
+        bool nacked = false;
+    };
+
+    size_t find(const Nack& nack) const;
+
+    size_t maxMessages;
+    std::deque<Sent> messages;
+};
+
+#endif // FRAGMENT_H
@@ -0,0 +1,55 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Message types carried over persistent TCP connections
+enum MessageType : uint8_t {
+    MSG_SNAPSHOT    = 0x01, // full serialized Tangle
+    MSG_DELTA       = 0x02, // serialized subset of transactions
+    MSG_TRANSACTION = 0x03, // one serialized transaction
+    MSG_SKETCH      = 0x04, // reserved for set reconciliation; not sent, and refused as unknown
+    MSG_ACK         = 0x05  // type + CRC of the acknowledged frame
+};
+
+static const uint16_t FRAME_MAGIC = 0x5447; // "TG"
+static const uint8_t FRAME_VERSION = 1;
+
+// All fields big endian; crc covers the first 8 header bytes and the payload
+#pragma pack(push, 1)
+struct FrameHeader {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t type;
+    uint32_t length;
+    uint32_t crc;
+};
+#pragma pack(pop)
+
+struct Frame {
+    MessageType type;
+    uint32_t crc;
+    std::string payload;
+};
+
+enum FrameStatus {
+    FRAME_INCOMPLETE, // need more bytes
+    FRAME_OK,
+    FRAME_INVALID     // bad magic, version, length or CRC: the stream cannot be resynchronised
+};
+
+uint32_t crc32(uint32_t crc, const void* data, size_t length);
+
+std::string encodeFrame(MessageType type, const std::string& payload);
+
+// Decodes the frame at the start of data; on FRAME_OK, consumed is its total size
+FrameStatus decodeFrame(const char* data, size_t size, size_t maxPayload, Frame& frame, size_t& consumed);
+
+// Payload of the ACK for frame
+std::string ackPayload(const Frame& frame);
+// Payload of the ACK the receiver of an encodeFrame() result will send back
+std::string ackPayload(const std::string& encoded);
+
+#endif // FRAME_H
@@ -0,0 +1,86 @@
+#ifndef GOSSIP_H
+#define GOSSIP_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <condition_variable>
+#include "transaction.h"
+#include "peer.h"
+
+/**
+ * Bloom filter of recently seen transaction ids in two generations.
+ * Inserts go to the current generation; when it holds `capacity` ids the
+ * previous one is dropped and the current one takes its place, so memory
+ * stays fixed while every id is remembered for at least `capacity` inserts.
+ */
+class SeenFilter {
+public:
+    SeenFilter(size_t capacity, double falsePositiveRate);
+
+    // Returns true if id was (probably) seen before, and records it either way
+    bool checkAndInsert(const std::string& id);
+    bool contains(const std::string& id) const;
+
+private:
+    void positions(const std::string& id, std::vector<size_t>& out) const;
+
+    size_t capacity;
+    size_t bits;
+    size_t hashes;
+    size_t count;
+    std::vector<uint64_t> current;
+    std::vector<uint64_t> previous;
+};
+
+struct GossipStats {
+    uint64_t published;  // transactions forwarded (local or relayed)
+    uint64_t received;   // transactions that arrived by gossip
+    uint64_t duplicates; // arrivals that were already seen
+    uint64_t frames;     // frames sent
+};
+
+/**
+ * Per-transaction gossip. Each new transaction is forwarded to a random
+ * `fanout` of peers (never back to the node it came from), so the load per
+ * transaction is O(fanout) and a transaction reaches all N nodes in
+ * O(log N) rounds. Transactions bound for the same peer are batched for up
+ * to BATCH_DELAY_MS into one delta frame.
+ */
+class Gossip {
+public:
+    Gossip(PeerManager& peers, size_t fanout);
+    ~Gossip();
+
+    // Returns true if the transaction is new, and marks it as seen
+    bool markSeen(const std::string& id);
+
+    // Queues a validated transaction (one serialized line) for a random fanout of peers
+    void publish(const std::string& serialized, const std::string& from = "");
+
+    void recordArrival(bool duplicate);
+    GossipStats stats() const;
+
+private:
+    void flushLoop();
+    void flush();
+
+    PeerManager& peers;
+    size_t fanout;
+    SeenFilter seen;
+    std::mt19937 rng;
+    std::map<std::string, std::string> pending; // peer -> batched serialized lines
+    size_t pendingBytes;
+
+    mutable std::mutex gossipMutex;
+    std::condition_variable wake;
+    std::thread flusher;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> published, received, duplicates, frames;
+};
+
+#endif // GOSSIP_H
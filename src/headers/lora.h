@@ -3,33 +3,154 @@
 
 #include <vector>
 #include <cstdint>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
 #include "sx126x.h"
+#include "radio.h"
+#include "fragment.h"
+#include "adr.h"
+#include "tangle.h"
 
 // Maximum payload size per packet
 static const size_t MAX_PAYLOAD = 200;
 
-// Packet types for framing
-enum PacketType : uint8_t {
-    PT_START = 0x01,
-    PT_MIDDLE = 0x02,
-    PT_END = 0x03
-};
+static const uint16_t LORA_BROADCAST = 0xFFFF;
 
-#pragma pack(push, 1)
-struct PacketHeader {
-    PacketType type;
-    uint16_t messageId;
-    uint16_t packetId;
-    uint16_t totalPackets;
+struct LinkStats {
+    uint64_t messagesSent = 0;
+    uint64_t messagesReceived = 0;
+    uint64_t fragmentsSent = 0;
+    uint64_t fragmentsRetransmitted = 0;
+    uint64_t fragmentsLost = 0; // reported missing by NACKs; on a busy channel, mostly collisions
+    uint64_t parityFragments = 0;
+    uint64_t nacksSent = 0;
+    uint64_t nacksReceived = 0;
+    double lossEstimate = 0; // fragment loss the sender currently codes for
+    uint64_t rateChanges = 0;
+    ReassemblyStats reassembly;
 };
-#pragma pack(pop)
 
+/**
+ * Message layer over a LoraRadio. Messages are split into fragments of at
+ * most MAX_PAYLOAD bytes; with erasure coding on, Reed-Solomon parity
+ * fragments are added so any k of the n fragments rebuild the message, the
+ * amount of parity following the loss rate the sender observes through
+ * NACKs. The receiver reassembles with bounded memory and, when a message
+ * stops making progress, sends the sender a NACK bitmap of the fragments
+ * it is missing. The sender keeps its recent messages and retransmits only
+ * those fragments, or for a coded message just enough of them. A service thread handles incoming
+ * fragments and NACKs, so a node answers NACKs without anyone calling
+ * receive().
+ *
+ * With adaptive rate on, every packet's RSSI (RadioConfig::rssi must be
+ * set) feeds a per-neighbour link-quality table and an AdrPolicy picks the
+ * fastest air speed and lowest power all active neighbours can keep. The
+ * setting is network-wide, since modules at different air speeds cannot
+ * hear each other: the node with the lowest address proposes a change,
+ * every neighbour acks or rejects it from its own measurements, and only
+ * when all have acked does everyone switch. Nodes that hear nobody for a
+ * while fall back to BASE_AIR_SPEED and BASE_POWER.
+ *
+ * Every node needs its own radio address (RadioConfig::addr) for NACKs to
+ * reach the right sender.
+ */
+class LoraLink {
+public:
+    explicit LoraLink(LoraRadio& radio);
+    ~LoraLink();
+
+    // Fragments and transmits the message; returns once every fragment is on its way.
+    // NACKs and retransmissions always go as TxPriority::Control.
+    bool send(const std::vector<uint8_t>& message, uint16_t dest = LORA_BROADCAST,
+              TxPriority priority = TxPriority::Interactive);
+
+    // Waits up to timeout for the next complete message
+    bool receive(std::vector<uint8_t>& message, std::chrono::milliseconds timeout);
+    // Same, with the address of the neighbour it came from
+    bool receive(std::vector<uint8_t>& message, uint16_t& src, std::chrono::milliseconds timeout);
+
+    // Unanswered NACKs per message before waiting out the timeout; 0 disables selective retransmission
+    void setNackRounds(int rounds);
+    // Reed-Solomon parity over the fragments of each message (on by default)
+    void setErasureCoding(bool enabled);
+    // Air speed and power negotiation with the neighbours (off by default)
+    void setAdaptiveRate(bool enabled);
+
+    LinkStats stats() const;
+
+private:
+    void serve();
+    void handlePacket(const LoraPacket& packet);
+    void sendNacks();
+    std::chrono::milliseconds nackQuiet() const;
+    void handleRate(const LoraPacket& packet);
+    void adaptRate(bool heard);
+    void sendRate(RatePhase phase, uint8_t proposal, int airSpeed, int power, uint16_t dest, int copies = 1);
+    void switchRate(int airSpeed, int power);
+    bool transmitFragments(const std::vector<std::vector<uint8_t>>& fragments, uint16_t dest, TxPriority priority);
+    std::chrono::steady_clock::duration radioTime(std::chrono::milliseconds duration) const;
 
+    LoraRadio& radio;
+    Reassembler reassembler;
+    SendWindow window;
+    uint16_t nextMessageId;
+    std::atomic<int> nackRounds;
+    std::atomic<bool> erasureCoding;
+    LossEstimator loss;
 
-// Send a large message over LoRa
+    // Adaptive rate, with linkMutex held
+    struct RateProposal {
+        uint8_t id = 0;
+        int airSpeed = 0;
+        int power = 0;
+        std::vector<uint16_t> waiting; // neighbours yet to ack
+        std::chrono::steady_clock::time_point sentAt;
+        bool active = false;
+        // Once committed, what to go back to if no neighbour is heard at the new rate
+        int previousAirSpeed = 0;
+        int previousPower = 0;
+        bool probation = false;
+    };
+    std::atomic<bool> adaptiveRate;
+    LinkQuality links;
+    AdrPolicy adr;
+    RateProposal proposal;
+    uint8_t nextProposal;
+    int failedProposals;
+    std::chrono::steady_clock::time_point nextEvaluation;
+    std::chrono::steady_clock::time_point lastTransmit;
+    std::chrono::steady_clock::time_point rateChangedAt;
+
+    struct Received {
+        uint16_t src;
+        std::vector<uint8_t> message;
+    };
+    std::deque<Received> inbox;
+    mutable std::mutex linkMutex;
+    std::condition_variable inboxReady;
+    LinkStats counters;
+    std::atomic<bool> running;
+    std::thread service;
+};
+
+// The link on the process-wide radio, under the mesh (mesh.h) the functions below go through
+LoraLink& loraLink();
+
+// Send a large message over LoRa to every node of the mesh
 bool sendOverLora(std::string message);
 
-// Receive a full message over LoRa
-bool receiveOverLora();
+// Every transaction of the Tangle in the compact radio encoding, packed one frame at a time. Cheap:
+// called with tangleMutex held, so the send can happen after it is released
+std::vector<std::vector<uint8_t>> encodeTransactionsForLora(const Tangle& tangle);
+// Sends the frames as bulk traffic behind single messages. Blocks until the duty-cycle budget has let
+// every frame out, which can take minutes; never call it holding tangleMutex
+bool sendEncodedOverLora(const std::vector<std::vector<uint8_t>>& messages);
+
+// Receive a full message over LoRa; compact messages are merged into the Tangle
+bool receiveOverLora(Tangle& tangle);
 
 #endif // LORA_H
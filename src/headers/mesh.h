@@ -0,0 +1,237 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include "lora.h"
+
+// First byte of a mesh message; never starts a compact or text message
+static const uint8_t MESH_MAGIC = 0xA7;
+
+// Longest path a message may take
+static const uint8_t MESH_MAX_HOPS = 8;
+// Route cost of one perfect link; a lossy link costs more, as many times as it needs sending
+static const uint8_t MESH_LINK_COST = 10;
+// Routes costing more count as unreachable
+static const uint8_t MESH_MAX_COST = 250;
+
+enum MeshKind : uint8_t {
+    MESH_DATA = 0,  // application message, routed or flooded
+    MESH_ROUTES = 1, // distance vector for the neighbours; never forwarded
+    MESH_ACK = 2     // the next hop has a routed message, named by its origin and seq
+};
+
+enum MeshFlags : uint8_t {
+    MESH_FLOODED = 0x01,       // sent to every neighbour, the sender having no route
+    MESH_PRIORITY_SHIFT = 1,   // bits 1-2 carry the originator's TxPriority
+    MESH_PRIORITY_MASK = 0x06
+};
+
+#pragma pack(push, 1)
+// Leads every mesh message
+struct MeshHeader {
+    uint8_t magic;
+    MeshKind kind;
+    uint8_t flags;
+    uint16_t origin;
+    uint16_t dest; // LORA_BROADCAST reaches every node
+    uint16_t seq;  // per origin, for duplicate suppression; advertisements are numbered apart
+    uint8_t ttl;   // hops the message may still take
+    uint8_t hops;  // hops taken before the current one
+};
+
+// One route of a MESH_ROUTES message
+struct RouteEntry {
+    uint16_t dest;
+    uint16_t nextHop; // lets the neighbour apply split horizon
+    uint8_t hops;
+    uint8_t cost;
+};
+#pragma pack(pop)
+
+struct Route {
+    uint16_t nextHop;
+    uint8_t hops;
+    uint8_t cost;
+    std::chrono::steady_clock::time_point updated;
+};
+
+/**
+ * Distance-vector routing table. Neighbours are learned from their
+ * advertisements: one becomes a route of one hop once three of its last
+ * four advertisements came through, and stops being one when fewer than
+ * two did, so a node heard now and then at the edge of range does not
+ * pass for a link. Each link costs MESH_LINK_COST divided by the square of
+ * the share of the neighbour's recent advertisements heard (expected
+ * transmissions, a message and its ack crossing the link both ways), and
+ * longer routes come from the neighbours' advertisements through whichever
+ * neighbour offers the cheapest path, so two good hops beat one marginal
+ * one. Routes a neighbour stops advertising, or that point back at this
+ * node, are dropped, and everything expires unless refreshed.
+ * Each neighbour's own neighbours are kept too, so a node can tell
+ * whether rebroadcasting a flood would reach anyone new.
+ */
+class RouteTable {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit RouteTable(uint16_t self);
+
+    // A message arrived from src; keeps a link to it fresh
+    void heard(uint16_t src, Clock::time_point now);
+    // Merges advertisement `seq` of a neighbour; true when a destination became reachable or
+    // unreachable (shorter or longer paths wait for the next routine advertisement)
+    bool merge(uint16_t neighbour, uint16_t seq, const std::vector<RouteEntry>& entries, Clock::time_point now);
+    // Drops routes not refreshed within timeout and those through neighbours that are gone;
+    // true when any route was dropped
+    bool expire(Clock::time_point now, Clock::duration timeout);
+
+    // Next hop towards dest, or false when no route is known
+    bool nextHop(uint16_t dest, uint16_t& hop) const;
+    // Whether rebroadcasting a flood heard from `from` reaches a neighbour other than the origin
+    // that `from` does not reach itself
+    bool extendsFlood(uint16_t from, uint16_t origin) const;
+    // Routes to advertise, cheapest first
+    std::vector<RouteEntry> advertisement(size_t maxEntries) const;
+
+    size_t neighbours() const;
+    size_t size() const { return routes.size(); }
+
+private:
+    struct Link {
+        uint16_t lastSeq = 0;
+        uint8_t history = 0; // bit i set when the advertisement i before the last was heard
+        int samples = 0;     // advertisements the history covers, up to 8
+        bool up = false;
+        Clock::time_point lastHeard;
+    };
+
+    static uint8_t linkCost(const Link& link);
+
+    // Forgets routes through neighbour; true if there were any
+    bool dropVia(uint16_t neighbour);
+
+    uint16_t self;
+    std::unordered_map<uint16_t, Route> routes;
+    std::unordered_map<uint16_t, Link> links; // every node whose advertisements are heard, up or not
+    std::unordered_map<uint16_t, std::unordered_set<uint16_t>> reach; // each neighbour's neighbours
+};
+
+struct MeshStats {
+    uint64_t originated = 0;
+    uint64_t delivered = 0;    // messages handed to receive()
+    uint64_t forwarded = 0;    // sent to the next hop of a route, own messages included
+    uint64_t retransmitted = 0; // sent to the next hop again for want of an ack
+    uint64_t flooded = 0;      // rebroadcast without a route, own messages included
+    uint64_t suppressed = 0;   // floods not rebroadcast because every neighbour already had them
+    uint64_t duplicates = 0;
+    uint64_t expired = 0;      // out of hops
+    uint64_t dropped = 0;      // pushed out of a full store-and-forward queue
+    uint64_t advertisements = 0;
+    size_t neighbours = 0;
+    size_t routes = 0;
+};
+
+// A message that reached this node
+struct MeshMessage {
+    uint16_t origin;
+    int hops;
+    std::vector<uint8_t> payload;
+};
+
+/**
+ * Multi-hop messaging over a LoraLink. Every node advertises its routing
+ * table to its neighbours now and then, and again soon after it gains or
+ * loses a destination.
+ * A message for one node goes hop by hop along the shortest known route,
+ * each relay reassembling it (so every hop gets the link's NACK and parity
+ * recovery) and queueing it for the next. A relay keeps the message until
+ * the next hop acks it, sending it again if the ack does not come, and
+ * floods it once the route has failed a few times. Without a route, a relay
+ * holds the message for a while in case one appears, then floods it. Messages
+ * for every node are flooded. A flood is rebroadcast only by nodes with a
+ * neighbour the previous sender does not reach, so dense areas do not
+ * repeat everything, and after a random delay, so the nodes that do repeat
+ * it hear each other instead of colliding. Every message carries its
+ * origin and a sequence number, and each node forwards and delivers it at
+ * most once; a hop limit bounds the rest.
+ *
+ * Every node needs its own radio address (RadioConfig::addr).
+ */
+class LoraMesh {
+public:
+    LoraMesh(LoraLink& link, LoraRadio& radio);
+    ~LoraMesh();
+
+    // Sends the message towards dest, or to every node for LORA_BROADCAST. Returns once it is on its
+    // way, or queued until a route to dest is known.
+    bool send(const std::vector<uint8_t>& message, uint16_t dest = LORA_BROADCAST,
+              TxPriority priority = TxPriority::Interactive);
+
+    // Waits up to timeout for the next message for this node
+    bool receive(MeshMessage& message, std::chrono::milliseconds timeout);
+
+    // Distance-vector routing and flood suppression (on by default); off, every node rebroadcasts
+    // every message once
+    void setRouting(bool enabled);
+
+    MeshStats stats() const;
+
+private:
+    struct Pending {
+        std::vector<uint8_t> message; // header included
+        std::chrono::steady_clock::time_point queuedAt;
+        std::chrono::steady_clock::time_point notBefore;
+        int attempts = 0; // sends to a next hop without an ack
+    };
+
+    void serve();
+    void handleMessage(uint16_t src, const std::vector<uint8_t>& message);
+    // Queues a message to forward, no sooner than `delay` from now; with meshMutex held
+    void enqueue(std::vector<uint8_t> message, std::chrono::steady_clock::duration delay);
+    void flushQueue();
+    void advertise();
+    void queueAck(const MeshHeader& data, uint16_t to, std::chrono::steady_clock::duration delay);
+    // How long to wait before acking a message of `bytes` just received
+    std::chrono::steady_clock::duration ackDelay(size_t bytes) const;
+    bool seen(uint16_t origin, uint16_t seq);
+    std::chrono::steady_clock::duration radioTime(std::chrono::milliseconds duration) const;
+    // How long a message of `bytes` may take to be acked by the next hop
+    std::chrono::milliseconds ackWait(size_t bytes) const;
+
+    LoraLink& link;
+    LoraRadio& radio;
+    uint16_t self;
+    std::atomic<bool> routing;
+    RouteTable table;
+    uint16_t nextSeq;
+    uint16_t nextAdvertisementSeq;
+
+    std::deque<Pending> queue; // store and forward
+    std::deque<uint32_t> recentOrder;
+    std::unordered_set<uint32_t> recent; // origin and sequence of messages already handled
+    std::chrono::steady_clock::time_point nextAdvertisement;
+    std::chrono::steady_clock::time_point lastAdvertisement;
+    std::mt19937 rng;
+
+    std::deque<MeshMessage> inbox;
+    mutable std::mutex meshMutex;
+    std::condition_variable inboxReady;
+    MeshStats counters;
+    std::atomic<bool> running;
+    std::thread service;
+};
+
+// The mesh on the process-wide link, used by the LoRa functions of lora.h
+LoraMesh& loraMesh();
+
+#endif // MESH_H
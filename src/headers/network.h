@@ -1,8 +1,45 @@
 #ifndef NETWORK_H
 #define NETWORK_H
+#include <string>
+#include <vector>
+#include <mutex>
+#include <functional>
 #include "transaction.h"
 #include "tangle.h"
+#include "peer.h"
+#include "gossip.h"
+#include "transport.h"
+#include "validationcache.h"
+
+// Node network settings; configureNetwork() must run before the server starts or anything is sent
+struct NetworkConfig {
+    std::string bindAddress = "0.0.0.0";
+    int port = 8080;
+    std::vector<std::string> nodes = {"192.168.29.95"};
+    size_t fanout = 3;          // peers each new transaction is gossiped to
+    bool loraFallback = true;   // LoRa is a path to every peer, taken where TCP is down or slower
+    LinkProfile link;           // simulated impairment for outgoing TCP frames
+    bool requireSignatures = true; // drop incoming transactions without both valid signatures
+};
+
+extern std::mutex tangleMutex; // guards the Tangle shared with the server threads
+
+void configureNetwork(const NetworkConfig& config);
+// Called with tangleMutex held for each transaction first learned from a peer
+void onTransactionAccepted(std::function<void(const Transaction&)> callback);
+// Removes the transactions new to this node whose signatures do not check out, unless
+// requireSignatures is off. Takes tangleMutex briefly, so it must be called without it
+void dropUnverified(std::vector<Transaction>& txs, const Tangle& tangle, const std::string& from);
+GossipStats gossipStats();
+// Hit rate and footprint of the cache incoming transactions are validated against
+ValidationCacheStats validationCacheStats();
+// What the path of `kind` to node has measured so far
+PathState pathState(const std::string& node, PathKind kind);
+
 void startServer(Tangle& tangle);
+// Queues a snapshot for every peer and returns; the LoRa part goes out on a background thread, so
+// this is safe to call with tangleMutex held
 void broadcastTangle(const Tangle& tangle);
+void gossipTransaction(const Tangle& tangle, const Transaction& tx);
 void handleLoRaClient(Tangle& tangle);
 #endif
\ No newline at end of file
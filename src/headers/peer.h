@@ -0,0 +1,98 @@
+#ifndef PEER_H
+#define PEER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <random>
+#include "frame.h"
+
+// Simulated link impairment applied to outgoing frames (all zero: none)
+struct LinkProfile {
+    int latencyMs = 0;
+    double bytesPerSecond = 0; // 0: unlimited
+    double lossRate = 0;       // probability a queued frame is dropped
+};
+
+/**
+ * Keeps one long-lived TCP connection per known node and writes to all of
+ * them concurrently from a single epoll loop over non-blocking sockets.
+ *
+ * Each peer has its own outbound queue. A message broadcast under a key
+ * replaces a message with the same key that is still waiting in the queue,
+ * so a slow peer only ever receives the freshest snapshot; an empty key
+ * never coalesces. Broken
+ * connections are re-established with exponential backoff. Frames the
+ * peers send back are passed to the frame handler.
+ */
+class PeerManager {
+public:
+    using FrameHandler = std::function<void(const std::string& node, const Frame& frame)>;
+
+    // localAddress, if set, is bound as the source address of every connection
+    PeerManager(const std::vector<std::string>& nodes, int port, const std::string& localAddress = "");
+    ~PeerManager();
+
+    void start();
+    void stop();
+    void setFrameHandler(FrameHandler handler);
+    void setLinkProfile(const LinkProfile& profile);
+
+    // Queues message for every peer, coalescing with an unsent message of the same key
+    void broadcast(const std::string& key, std::shared_ptr<const std::string> message);
+    // Queues message for one peer
+    void send(const std::string& node, const std::string& key, std::shared_ptr<const std::string> message);
+
+    std::vector<std::string> nodes() const;
+    bool isConnected(const std::string& node) const;
+    size_t connectedCount() const;
+
+private:
+    struct Outbound {
+        std::string key;
+        std::shared_ptr<const std::string> data;
+        std::chrono::steady_clock::time_point readyAt;
+    };
+
+    struct Peer {
+        std::string node;
+        int fd = -1;
+        bool connected = false;
+        std::deque<Outbound> queue;
+        size_t offset = 0; // bytes of queue.front() already written
+        std::string inbox; // bytes received but not yet parsed into frames
+        int backoffMs = 0;
+        std::chrono::steady_clock::time_point nextAttempt;
+        std::chrono::steady_clock::time_point nextSendAt; // bandwidth pacing
+    };
+
+    void run();
+    void enqueue(Peer& peer, const std::string& key, std::shared_ptr<const std::string> message);
+    void wakeLoop();
+    std::chrono::steady_clock::time_point sendableAt(const Peer& peer) const;
+    void connectPeer(Peer& peer);
+    void disconnectPeer(Peer& peer);
+    void flushPeer(Peer& peer);
+    void watchPeer(Peer& peer);
+    bool readPeer(Peer& peer, std::vector<std::pair<std::string, Frame>>& received);
+
+    int port;
+    std::string localAddress;
+    LinkProfile link;
+    std::mt19937 lossRng;
+    int epollFd;
+    int wakeFd;
+    std::vector<Peer> peers;
+    FrameHandler frameHandler;
+    mutable std::mutex queueMutex;
+    std::thread loop;
+    std::atomic<bool> running;
+};
+
+#endif // PEER_H
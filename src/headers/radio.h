@@ -0,0 +1,186 @@
+#ifndef RADIO_H
+#define RADIO_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <future>
+#include <chrono>
+#include <atomic>
+#include <random>
+#include "sx126x.h"
+#include "serial.h"
+
+// Register-level settings of the LoRa HAT (the arguments of sx126x::set)
+struct RadioConfig {
+    std::string serial = "/dev/ttyS0";
+    int freq = 868;
+    uint16_t addr = 0x1234;
+    int power = 22;
+    bool rssi = false;
+    int airSpeed = 2400;
+    int netId = 0;
+    int bufferSize = 240;
+    uint16_t crypt = 0;
+    bool relay = false;
+    bool lbt = false; // the module's own LBT; LoraRadio also listens before talking, see setListenBeforeTalk
+    bool wor = false;
+
+    bool operator==(const RadioConfig& other) const;
+    bool operator!=(const RadioConfig& other) const { return !(*this == other); }
+};
+
+// Order in which queued packets get the air: NACKs and retransmissions, then approvals and single
+// transactions, then bulk sync
+enum class TxPriority { Control = 0, Interactive = 1, Bulk = 2 };
+
+struct TxStats {
+    uint64_t packets = 0;
+    double airtime = 0;   // seconds on air, radio time
+    double deferred = 0;  // seconds packets waited for duty-cycle budget, radio time
+    double dutyCycle = 0; // fraction of the current window used
+    uint64_t busy = 0;    // listen-before-talk samples that found the channel in use
+    double backoff = 0;   // seconds spent backing off a busy channel, radio time
+    uint64_t forced = 0;  // packets sent on a busy channel after the last backoff
+};
+
+/**
+ * Rolling duty-cycle budget: airtime started within any `window` may not
+ * exceed fraction * window. Times are seconds on the radio clock.
+ */
+class DutyCycle {
+public:
+    DutyCycle(double fraction, double window);
+
+    // Earliest time from `now` on at which `airtime` fits within `share` of the budget; infinity when
+    // it exceeds that share outright, so it could never be sent within the limit
+    double availableAt(double now, double airtime, double share = 1.0) const;
+    void record(double start, double airtime);
+    // Fraction of the window used as of now
+    double used(double now) const;
+
+private:
+    double fraction;
+    double window;
+    std::deque<std::pair<double, double>> history; // start, airtime
+};
+
+/**
+ * Owns the single sx126x for the life of the process. The UART is opened
+ * and configured once; later configure() calls only touch the module when
+ * the settings actually change. If the open fails or the port closes, it
+ * is retried after a delay that doubles up to 10 s; a packet queued in the
+ * meantime waits for the next attempt and fails only if that fails too. Every radio operation runs on one owner
+ * thread, which sends queued packets and otherwise blocks on the UART,
+ * queueing each packet the moment it is complete, so TX and RX never
+ * contend for the UART or the mode pins.
+ *
+ * Transmission is scheduled by airtime: the next packet goes as soon as the
+ * module has finished the previous one (sx126x::send_time), highest priority
+ * first, as long as the rolling duty-cycle budget (1% per hour by default,
+ * the EU868 limit) has room. Bulk traffic may only use part of the budget so
+ * control and interactive packets still get out when it is nearly spent.
+ *
+ * Before each packet the module's noise RSSI is read; when it is well above
+ * the noise floor another node is on the air, and the packet waits a random
+ * number of slots from a window that doubles with every busy reading. After
+ * LBT_MAX_ATTEMPTS busy readings it goes anyway, so a noisy channel delays
+ * traffic but cannot stop it.
+ *
+ * The UART is opened through a TransportFactory: openPigpioSerial for the
+ * HAT, or SimChannel::factory for a simulated radio.
+ */
+class LoraRadio {
+public:
+    explicit LoraRadio(TransportFactory factory);
+    ~LoraRadio();
+
+    // The process-wide radio used by lora.h, opened with the default transport
+    static LoraRadio& instance();
+    // Must be called before instance() is first used
+    static void setDefaultTransport(TransportFactory factory);
+
+    // Applied by the owner thread before the next operation; a no-op if unchanged
+    void configure(const RadioConfig& config);
+    // The configuration most recently requested
+    RadioConfig config() const;
+    // Clock rate of the open radio relative to wall time (1 until it is open)
+    double speedup() const;
+
+    // Sends the packets in order, back to back as airtime and budget allow; blocks until the last one is
+    // written. Higher-priority packets go out between the packets of a lower-priority job in progress.
+    bool transmit(std::vector<std::vector<uint8_t>> packets, TxPriority priority = TxPriority::Interactive);
+
+    // Duty-cycle limit as a fraction of `window`; 1 or more disables it
+    void setDutyCycle(double fraction, std::chrono::seconds window = std::chrono::hours(1));
+    TxStats txStats() const;
+
+    // Channel noise RSSI in dBm, the quietest of the last few idle samples; 0 until the first sample
+    int noiseFloor() const;
+
+    // Carrier sense with random exponential backoff before every packet (on by default)
+    void setListenBeforeTalk(bool enabled);
+
+    // Holds back Interactive and Bulk packets, so the module listens, for `duration` of radio time;
+    // Control packets still go. A zero duration releases the hold.
+    void holdTraffic(std::chrono::milliseconds duration);
+
+    // Waits up to timeout for the next received packet
+    bool receive(LoraPacket& packet, std::chrono::milliseconds timeout);
+    // Same, payload only
+    bool receive(std::string& payload, std::chrono::milliseconds timeout);
+
+private:
+    struct TxJob {
+        std::vector<std::vector<uint8_t>> packets;
+        size_t next = 0;
+        double heldSince = -1; // radio time the budget first held back the next packet
+        int busyReadings = 0;  // for the next packet
+        std::promise<bool> done;
+    };
+
+    static constexpr size_t PRIORITIES = 3;
+
+    void run();
+    bool applyConfig();
+    // Highest-priority job allowed to send at `now`, or null; with radioMutex held
+    TxJob* nextJob(size_t& priority, double now);
+    void finishJob(size_t priority, bool sent);
+    // Radio-clock seconds since the radio was created
+    double radioNow() const;
+    // Samples the channel for the next packet of job; true to send now, false after scheduling a backoff
+    bool channelClear(TxJob& job, double now);
+
+    TransportFactory openTransport;
+    std::unique_ptr<sx126x> radio;
+    RadioConfig applied;
+    RadioConfig wanted;
+    bool reconfigure;
+
+    std::deque<std::unique_ptr<TxJob>> txQueues[PRIORITIES];
+    std::deque<LoraPacket> rxQueue;
+    std::chrono::steady_clock::time_point epoch;
+    double nextTx;       // radio time the module is free again
+    double clockRate;    // speedup of the open radio
+    DutyCycle budget;
+    TxStats counters;
+    std::deque<int> noiseSamples;
+    double nextNoiseSample;
+    double holdUntil;    // radio time before which only Control packets go
+    double backoffUntil; // radio time the current backoff ends
+    bool listenBeforeTalk;
+    std::mt19937 rng;
+
+    mutable std::mutex radioMutex;
+    std::condition_variable txReady;
+    std::condition_variable rxReady;
+    std::atomic<bool> running;
+    std::thread owner;
+};
+
+#endif // RADIO_H
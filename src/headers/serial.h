@@ -0,0 +1,49 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <functional>
+
+/**
+ * What the sx126x driver needs from the hardware: the HAT's UART and its
+ * two mode pins (M0, M1). The pigpio backend drives the real HAT; the
+ * simulated backend (simradio.h) emulates the module on a shared in-memory
+ * channel so the LoRa stack runs on any Linux host.
+ */
+class SerialTransport {
+public:
+    virtual ~SerialTransport() = default;
+
+    virtual bool is_open() const = 0;
+
+    // Drive the mode pins: (0,0) normal transmission, (0,1) configuration
+    virtual void set_mode(bool m0, bool m1) = 0;
+
+    virtual int write(const uint8_t* data, size_t length) = 0;
+    // Bytes received and not yet read
+    virtual int available() = 0;
+    virtual int read(uint8_t* data, size_t length) = 0;
+
+    // Blocks until bytes are available, wake() is called or the timeout passes; true if bytes are available
+    virtual bool wait_readable(std::chrono::milliseconds timeout) = 0;
+    // Ends a wait_readable() in progress on another thread
+    virtual void wake() = 0;
+
+    // Hardware settle delays; the simulated backend shortens them with its clock
+    virtual void sleep(std::chrono::milliseconds duration) = 0;
+
+    // How many times faster than wall time the radio's clock runs (1 for real hardware)
+    virtual double speedup() const { return 1.0; }
+};
+
+// Opens the transport for a serial device at the given baud rate
+using TransportFactory = std::function<std::unique_ptr<SerialTransport>(const std::string& device, uint32_t baudrate)>;
+
+// Waveshare HAT over pigpio; initialises pigpio on first use. Defined in pigpio_serial.cpp,
+// the only translation unit that needs libpigpio.
+std::unique_ptr<SerialTransport> openPigpioSerial(const std::string& device, uint32_t baudrate);
+
+#endif // SERIAL_H
@@ -0,0 +1,106 @@
+#ifndef SIGNATURE_H
+#define SIGNATURE_H
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include "transaction.h"
+#include "validationcache.h"
+
+typedef struct evp_pkey_st EVP_PKEY;
+
+// An Ed25519 private key
+class SigningKey {
+public:
+    static SigningKey generate();
+    // From the 32-byte raw private key, so tests and benchmarks can use fixed keys
+    static SigningKey fromSeed(const std::string& seed);
+
+    std::string publicKey() const; // hex
+    std::string sign(const std::string& message) const; // raw 64 bytes; empty on failure
+
+private:
+    std::shared_ptr<EVP_PKEY> key;
+};
+
+// SHA3-256 of everything the sender signs: the terms of the trade, its parents and the sender's key.
+// Amount and price are taken at the precision the radio codec carries (codec.h)
+std::string transactionHash(const Transaction& tx);
+
+// README 1.2: sets sender_key and sender_signature = Sign(H(body)). Rounds amount and price to the
+// precision that is signed first, so every encoding of tx hashes the same
+void signAsSender(Transaction& tx, const SigningKey& key);
+// README 4.1: draws receiver_nonce and sets receiver_key and receiver_signature = Sign(H(body) || nonce)
+void signAsReceiver(Transaction& tx, const SigningKey& key);
+
+// Both signatures present and valid
+bool verifyTransaction(const Transaction& tx);
+
+// SHA3-256 of transactionHash(tx) with the proof of work, signatures, receiver key and nonce: two
+// transactions share it only if they carry the same bytes
+ContentHash contentHash(const Transaction& tx);
+
+struct VerifierStats {
+    uint64_t verified;   // transactions with both signatures valid
+    uint64_t rejected;
+    uint64_t batches;
+    uint64_t cached;     // of verified and rejected, answered by the validation cache
+    double cpuSeconds;   // CPU time spent verifying, summed over the threads that did it
+
+    // Transactions checked per second of one core, cache hits included
+    double perCore() const { return cpuSeconds > 0 ? (verified + rejected) / cpuSeconds : 0; }
+};
+
+/**
+ * Verifies the signatures of many transactions at once, as they come in a
+ * sync payload. Small batches are checked on the calling thread; larger
+ * ones are shared out in chunks between worker threads. Setup is paid once
+ * per thread rather than once per signature: each thread keeps its digest
+ * and verify contexts, and keeps the parsed public keys of the meters it
+ * has seen, which repeat across a payload. Ed25519 has no batch equation
+ * in OpenSSL, so each signature is still checked on its own. With a
+ * ValidationCache, a transaction whose content was checked before takes
+ * its outcome from the cache instead.
+ */
+class SignatureVerifier {
+public:
+    explicit SignatureVerifier(size_t workers = std::thread::hardware_concurrency(), ValidationCache* cache = nullptr);
+    ~SignatureVerifier();
+
+    // One flag per transaction, in order: true when both signatures are valid
+    std::vector<bool> verify(const std::vector<const Transaction*>& batch);
+    std::vector<bool> verify(const std::vector<Transaction>& batch);
+
+    VerifierStats stats() const;
+    size_t workers() const { return threads.size(); }
+    ValidationCache* cache() const { return outcomes; }
+
+    // The verifier incoming transactions go through, with a cache of DEFAULT_VALIDATION_CACHE_ENTRIES
+    static SignatureVerifier& shared();
+
+private:
+    void work();
+    // Takes chunks of the current batch until none is left; returns the CPU seconds it spent and
+    // adds the transactions the cache answered to cached
+    double verifyChunks(uint64_t& cached);
+
+    ValidationCache* outcomes;
+    std::vector<std::thread> threads;
+    std::mutex callMutex; // one batch at a time
+    mutable std::mutex jobMutex;
+    std::condition_variable jobReady;
+    std::condition_variable jobDone;
+    const std::vector<const Transaction*>* batch = nullptr;
+    std::vector<char>* results = nullptr; // not vector<bool>: workers write neighbouring flags
+    std::atomic<size_t> next{0}; // first transaction of the next chunk
+    uint64_t generation = 0;
+    size_t busy = 0;
+    bool stopping = false;
+    VerifierStats counters{};
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef SIMRADIO_H
+#define SIMRADIO_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+#include <chrono>
+#include "serial.h"
+
+struct SimRadioParams {
+    double speedup = 1.0;          // simulated seconds per wall-clock second
+    double lossRate = 0.0;         // random packet loss on top of the link budget
+    double referenceLossDb = 40.0; // path loss at 1 m
+    double pathLossExponent = 2.8;
+    double shadowingDb = 0.0;      // standard deviation of per-packet fading
+    double noiseFloorDbm = -115.0;
+    double sensitivityDbm = -124.0; // at 2400 bps; 3 dB worse per doubling of the air speed
+    double captureDb = 6.0;        // an overlapped packet survives if this much stronger than the other
+    uint32_t seed = 1;
+};
+
+struct SimRadioStats {
+    uint64_t sent = 0;       // packets put on the air
+    uint64_t delivered = 0;  // packet receptions
+    uint64_t collided = 0;   // receptions lost to an overlapping packet
+    uint64_t weak = 0;       // receptions below sensitivity
+    uint64_t dropped = 0;    // receptions lost to random loss
+    uint64_t deaf = 0;       // receptions missed because the receiver was transmitting
+    double airtime = 0;      // total seconds on air
+};
+
+/**
+ * An in-memory radio channel shared by simulated SX126x modules.
+ *
+ * Each attached module is configured over its UART exactly like the HAT
+ * (0xC2 register block in configuration mode) and transmits the
+ * [dest_high, dest_low, freq_offset, payload...] packets the driver writes.
+ * A packet occupies the air for its airtime at the configured air speed and
+ * reaches every module on the same frequency offset and air speed whose
+ * address matches (or 0xFFFF), unless it is below sensitivity after path
+ * loss, overlaps a stronger packet (or one within captureDb), arrives while
+ * the receiver is itself transmitting, or is randomly dropped. As on the
+ * HAT in fixed transmission mode, the receiver's UART gets the payload
+ * without the three addressing bytes, followed by an RSSI byte when that
+ * is enabled in the registers.
+ *
+ * The channel must outlive every transport attached to it.
+ */
+class SimChannel {
+public:
+    explicit SimChannel(const SimRadioParams& params = SimRadioParams());
+
+    // A simulated module at (x, y) metres
+    std::unique_ptr<SerialTransport> attach(double x, double y);
+    // Same, for code that opens transports by device name (e.g. LoraRadio)
+    TransportFactory factory(double x, double y);
+
+    double now() const; // simulated seconds since the channel was created
+    SimRadioStats stats() const;
+    const SimRadioParams& params() const { return config; }
+
+    // Seconds on air for a payload of `bytes` at `airSpeed` bps
+    static double airtime(size_t bytes, int airSpeed);
+
+private:
+    friend class SimSerial;
+
+    struct Module {
+        double x, y;
+        bool m0 = false, m1 = true;
+        std::array<uint8_t, 9> regs{};
+        uint16_t addr = 0;
+        uint8_t freqOffset = 0;
+        int airSpeed = 2400;
+        int powerDbm = 22;
+        bool rssiByte = false;
+        double busyUntil = 0; // end of this module's last transmission
+        int lastRssi = 0;
+        bool woken = false;
+        std::deque<uint8_t> rx;
+    };
+
+    struct Transmission {
+        size_t src;
+        double start, end;
+        uint16_t dest;
+        uint8_t freqOffset;
+        int airSpeed;
+        std::vector<uint8_t> payload;
+        std::vector<double> rssiAt; // received power at every module
+        bool settled = false;
+    };
+
+    int write(size_t module, const uint8_t* data, size_t length);
+    int available(size_t module);
+    int read(size_t module, uint8_t* data, size_t length);
+    bool waitReadable(size_t module, std::chrono::milliseconds timeout);
+    void wake(size_t module);
+    void setMode(size_t module, bool m0, bool m1);
+
+    void configure(Module& m, const uint8_t* regs);
+    void transmit(size_t module, const uint8_t* data, size_t length, double now);
+    void settle(double now);
+    bool overlapsTransmission(size_t module, double start, double end) const;
+    double channelRssi(size_t module, double now) const;
+
+    SimRadioParams config;
+    std::chrono::steady_clock::time_point epoch;
+    std::vector<std::unique_ptr<Module>> modules;
+    std::deque<Transmission> air;
+    SimRadioStats counters;
+    std::mt19937 rng;
+    mutable std::mutex channelMutex;
+    std::condition_variable channelChanged; // a packet went on the air or a module was woken
+};
+
+#endif // SIMRADIO_H
@@ -6,22 +6,30 @@
 #include <vector>
 #include <map>
 #include <array>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include "serial.h"
+
+// One packet as received: sender address and frequency, RSSI if enabled, and the payload
+struct LoraPacket {
+    uint16_t src;
+    int freq;    // MHz
+    int rssi;    // dBm; 0 when the RSSI byte is disabled
+    std::vector<uint8_t> payload;
+};
 
 /**
  * A C++ driver for the Waveshare SX1268 LoRa HAT,
  * originally converted from a Python implementation.
  *
- * Before using any sx126x instance, be sure to call gpioInitialise()
- * (and call gpioTerminate() before your program exits).
+ * The UART and mode pins are reached through a SerialTransport: pass
+ * openPigpioSerial(...) for the real HAT, or a simulated radio.
  */
 class sx126x {
 public:
-    // GPIO pin numbers (BCM numbering)
-    static constexpr int M0 = 22;
-    static constexpr int M1 = 27;
-
     // Constructor / Destructor
-    sx126x(const std::string& serial_num,
+    sx126x(std::unique_ptr<SerialTransport> transport,
            int freq,
            uint16_t addr,
            int power,
@@ -36,7 +44,14 @@ public:
 
     ~sx126x();
 
-    // Re-configure the module (can be called again to change frequency, power, etc.)
+    // Whether the UART opened successfully
+    bool is_open() const;
+
+    // Clock rate of the underlying radio relative to wall time (see SerialTransport)
+    double speedup() const;
+
+    // Re-configure the module (can be called again to change frequency, power, etc.).
+    // Returns immediately if the module already holds the resulting register values.
     void set(int freq,
              uint16_t addr,
              int power,
@@ -52,37 +67,80 @@ public:
     // Query and print the current register settings
     void get_settings();
 
-    // Send a raw packet (formatted as: [dest_high, dest_low, freq_offset, payload…])
+    // Send a raw packet (formatted as: [dest_high, dest_low, freq_offset, payload…]).
+    // The driver adds this node's address and frequency, a sync byte and the
+    // payload length, so the receiver can delimit packets in the UART stream.
     void send(const std::vector<uint8_t>& data);
 
-    // Check UART for incoming LoRa data, parse & print it (+RSSI if enabled)
-    std::string receive();
+    // Largest payload send() accepts
+    static constexpr size_t MAX_PACKET_PAYLOAD = 235;
+
+    // Seconds on air for `bytes` after the addressing bytes, at `air_speed` bps
+    static double air_time(size_t bytes, int air_speed);
+
+    // Seconds on air for send() of a packet of `length` bytes (addressing included) at the current air speed
+    double time_on_air(size_t length) const;
+    // Seconds until the module is free again after that send(): the UART transfer plus the time on air
+    double send_time(size_t length) const;
+
+    // Called for every complete packet received
+    void on_packet(std::function<void(const LoraPacket&)> handler);
 
-    // Request and print noise RSSI (and optional last-packet RSSI)
-    void get_channel_rssi();
+    // Waits up to timeout for UART data, drains it into the receive ring buffer and
+    // passes every complete packet to the handler. Returns the number of packets delivered.
+    int poll(std::chrono::milliseconds timeout);
+
+    // Ends a poll() in progress on another thread
+    void wake();
+
+    // Measure the channel's current noise RSSI in dBm; packets received meanwhile still reach the handler
+    bool get_channel_rssi(int& noise_dbm);
+
+    // Receiver sensitivity at `air_speed`: -124 dBm at 2400 bps, 3 dB worse per doubling of the rate
+    static double sensitivity_dbm(int air_speed);
 
     // Public attributes (read-only or directly modifiable as needed)
     bool rssi;              // whether to append a packet-RSSI byte
     uint16_t addr;          // this node’s address
     int       start_freq;   // base frequency (410 or 850)
     int       offset_freq;  // offset from start_freq in MHz
-    std::string serial_n;   // e.g. "/dev/ttyS0"
 
 private:
-    // Internal UART handle (pigpio’s serialOpen returns an int)
-    int      serial_handle;
+    // UART and mode pins
+    std::unique_ptr<SerialTransport> port;
     uint32_t baudrate;
 
     int      power;        // TX power (22/17/13/10 dBm)
     int      freq;         // center frequency in MHz
     int      send_to;      // “destination address”
+    int      air_speed;    // air data rate in bps
+    bool     normal_mode;  // M0=M1=0, ready to transmit
+    bool     rssi_pending; // an RSSI reply is expected in the UART stream
 
     // 12-byte configuration buffer
     std::array<uint8_t,12> cfg_reg;
 
+    // Last configuration the module acknowledged, so set() can skip no-op changes
+    std::array<uint8_t,12> applied_reg;
+    bool                   cfg_applied;
+
     // Buffer to hold “get settings” response
     std::vector<uint8_t>   get_reg;
 
+    // UART bytes not yet delimited into packets
+    static constexpr size_t RX_RING_SIZE = 2048;
+    std::array<uint8_t, RX_RING_SIZE> rx_ring;
+    size_t rx_head;
+    size_t rx_size;
+    std::function<void(const LoraPacket&)> packet_handler;
+
+    void set_mode(bool m0, bool m1);
+
+    uint8_t ring_at(size_t index) const;
+    void ring_drop(size_t count);
+    void fill_ring();
+    int deliver_packets();
+
     // Lookup tables (dictionaries) for air-speed, power, buffer-size
     std::map<int,uint8_t>  lora_air_speed_dic;
     std::map<int,uint8_t>  lora_power_dic;
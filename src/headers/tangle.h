@@ -1,13 +1,78 @@
 #ifndef TANGLE_H
 #define TANGLE_H
 #include "transaction.h"
+#include "tippool.h"
 #include <unordered_map>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+class WalkCache;
+
+// How many levels below the highest transaction random walks start by default
+static const size_t DEFAULT_ENTRY_DEPTH = 15;
+
+// Serialized form of one transaction, encoded once at insert time.
+// Only cumulative_weight can change afterwards, so it is kept in its own
+// slice and re-formatted in place instead of re-encoding the whole record.
+struct EncodedRecord {
+    std::string head;   // "id,timestamp,sender,receiver,amount,unit,price,currency,"
+    std::string weight; // cumulative_weight
+    std::string tail;   // ",proof_of_work,[previous],[validating],sender_key,sender_signature,
+                        //  receiver_key,receiver_nonce,receiver_signature\n"
+};
+
 class Tangle {
 public:
+    // A transaction already held keeps its content; only a higher cumulative_weight is taken from tx
     void addTransaction(const Transaction& tx);
+    // As above, with the time the transaction reached this node, for the tip pool
+    void addTransaction(const Transaction& tx, TipPool::Clock::time_point arrivedAt);
     void updateCumulativeWeight(const std::string& transaction_id);
     std::string serialize() const; // Converts the Tangle to a string format
+    std::string serialize(const std::vector<std::string>& ids) const; // Only the listed transactions
     void updateFromSerialized(const std::string& data); // Updates Tangle from serialized string
-    std::unordered_map<std::string, Transaction> transactions;
+    static std::vector<Transaction> parseSerialized(const std::string& data);
+
+    // Transactions listing id among their previous_transactions, in arrival order
+    const std::vector<std::string>& approversOf(const std::string& id) const;
+    // Changes whenever id gains an approver or an approver's weight changes; never repeats, even
+    // across Tangles, so whatever is derived from the approvers can be cached against it
+    uint64_t approvalVersion(const std::string& id) const;
+    // Longest chain of known parents below id: 0 for genesis and for transactions whose parents are
+    // all unknown so far
+    size_t heightOf(const std::string& id) const;
+    size_t height() const { return levels.empty() ? 0 : levels.size() - 1; }
+    // Where random walks start: the transactions entryDepth() levels below the highest one, or the
+    // roots (genesis) while the Tangle is not that deep. Walks from there still reach the active tips,
+    // but no longer get longer as the Tangle grows. Empty only for an empty Tangle
+    const std::vector<std::string>& entryPoints() const;
+    size_t entryDepth() const { return walkDepth; }
+    void setEntryDepth(size_t depth); // SIZE_MAX walks from genesis
+    // New transactions added so far; re-adding a known one does not count
+    uint64_t insertions() const { return inserted; }
+    // Unapproved transactions, by how long they have waited for an approver
+    TipPool& tips() { return tipPool; }
+    const TipPool& tips() const { return tipPool; }
+
+    // Read-only: every change goes through addTransaction or updateCumulativeWeight, which keep the
+    // cached records and the indexes in step
+    const std::unordered_map<std::string, Transaction>& transactions() const { return entries; }
+    mutable std::shared_ptr<WalkCache> walkCache; // transition tables of the weighted walks (tsa.h)
+private:
+    void encodeRecord(const Transaction& tx);
+    void indexApprovals(const Transaction& tx, TipPool::Clock::time_point arrivedAt);
+    // The weight of tx changed: the transition tables of its parents are stale
+    void touchParents(const Transaction& tx);
+    void setHeight(const std::string& id, size_t height);
+    std::unordered_map<std::string, Transaction> entries;
+    std::unordered_map<std::string, EncodedRecord> records;
+    std::unordered_map<std::string, std::vector<std::string>> approvers; // parent -> children
+    std::unordered_map<std::string, uint64_t> versions;
+    std::unordered_map<std::string, size_t> heights;
+    std::vector<std::vector<std::string>> levels; // transactions by height, in arrival order
+    size_t walkDepth = DEFAULT_ENTRY_DEPTH;
+    uint64_t inserted = 0;
+    TipPool tipPool;
 };
-#endif
\ No newline at end of file
+#endif
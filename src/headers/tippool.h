@@ -0,0 +1,92 @@
+#ifndef TIPPOOL_H
+#define TIPPOOL_H
+#include <string>
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <chrono>
+#include <cstdint>
+#include <random>
+
+struct TipPoolConfig {
+    std::chrono::steady_clock::duration tick = std::chrono::seconds(1); // timer wheel resolution
+    size_t slots = 64;                                                   // one turn of the wheel
+    std::chrono::steady_clock::duration demoteAfter = std::chrono::seconds(60);  // unapproved this long: lazy
+    std::chrono::steady_clock::duration evictAfter = std::chrono::seconds(300);  // this long: orphaned
+    size_t maxParents = 2; // parents select() hands out
+};
+
+struct TipPoolStats {
+    uint64_t arrived;  // transactions that joined as tips
+    uint64_t approved; // tips that gained an approver
+    uint64_t demoted;  // tips that went lazy
+    uint64_t evicted;  // lazy tips given up on, never approved here
+};
+
+/**
+ * The unapproved transactions a new transaction may approve, and how long
+ * each has waited. A tip is fresh until demoteAfter has passed since it
+ * arrived, then lazy, and after evictAfter it is evicted: it is no longer
+ * offered and, if it is approved after all, it simply does not come back.
+ * The deadlines sit on a hashed timer wheel of `slots` ticks, so keeping
+ * them costs O(1) per tip whatever the size of the pool. select() draws
+ * fresh tips at random, so that issuers that have not yet seen each
+ * other's transactions spread their approvals instead of all approving the
+ * same ones. It falls back to the oldest lazy tips only when there are too
+ * few fresh ones. Both the tip set and the parents of a transaction stay
+ * bounded under load.
+ */
+class TipPool {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit TipPool(TipPoolConfig config = {});
+
+    void arrived(const std::string& id, Clock::time_point now); // advances the wheel to now first
+    void approved(const std::string& id); // gained an approver; no-op for ids not in the pool
+    // Runs the wheel up to now, demoting and evicting whatever is due
+    void advance(Clock::time_point now);
+    // Up to maxParents distinct tips: fresh ones at random, then the oldest lazy ones
+    std::vector<std::string> select(Clock::time_point now);
+
+    bool contains(const std::string& id) const { return tips.count(id) > 0; }
+    bool isLazy(const std::string& id) const;
+    size_t freshCount() const { return fresh.size(); }
+    size_t lazyCount() const { return lazy.size(); }
+    TipPoolStats stats() const { return counters; }
+    const TipPoolConfig& config() const { return settings; }
+    void setMaxParents(size_t parents) { settings.maxParents = parents; }
+    void seed(uint64_t value) { rng.seed(value); } // seeded from std::random_device otherwise
+
+private:
+    struct Tip {
+        uint64_t seq; // arrival order
+        Clock::time_point arrivedAt;
+        bool lazy;
+        size_t slot;  // in fresh, while not lazy
+    };
+    struct Timer {
+        std::string id;
+        uint64_t seq;  // of the tip it was set for; a tip that left and came back is a different one
+        uint64_t due;  // tick
+    };
+
+    uint64_t tickOf(Clock::time_point t) const;
+    void schedule(const std::string& id, uint64_t seq, Clock::time_point deadline);
+    void fire(const Timer& timer, uint64_t now); // now: the tick advance() runs up to
+    void removeFresh(Tip& tip);
+
+    TipPoolConfig settings;
+    std::unordered_map<std::string, Tip> tips;
+    std::vector<std::string> fresh;                  // in no order, for drawing at random
+    std::set<std::pair<uint64_t, std::string>> lazy; // (seq, id), oldest first
+    std::vector<std::vector<Timer>> wheel;
+    bool started = false;
+    Clock::time_point epoch; // tick 0
+    uint64_t current = 0;    // last tick run
+    uint64_t nextSeq = 0;
+    TipPoolStats counters{};
+    std::mt19937_64 rng{std::random_device{}()};
+};
+
+#endif
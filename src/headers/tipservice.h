@@ -0,0 +1,81 @@
+#ifndef TIPSERVICE_H
+#define TIPSERVICE_H
+#include <vector>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+#include "tangle.h"
+
+// A tip-selection algorithm: selectTips, selectTipsMCMC, ... (tsa.h)
+using TipSelector = std::function<std::vector<std::string>(Tangle&)>;
+
+struct TipServiceConfig {
+    size_t poolSize = 4;                              // ready selections kept
+    std::chrono::milliseconds maxAge{2000};           // a selection older than this is not handed out
+    uint64_t maxInserts = 8;                          // nor one that many transactions have arrived since
+    std::chrono::milliseconds refreshInterval{100};   // how often the pool is checked without being asked
+};
+
+struct TipServiceStats {
+    uint64_t handedOut;      // selections served from the pool
+    uint64_t selectedInline; // selections run by the caller: the pool had nothing fresh enough
+    uint64_t selectedAhead;  // selections run in the background
+    uint64_t expired;        // selections dropped from the pool unused
+};
+
+/**
+ * Keeps a few tip selections ready so that issuing a transaction does not
+ * wait for the walks. A background thread runs the selector under the
+ * Tangle's mutex and pools the result, stamped with the time and with
+ * Tangle::insertions(). selectTips() takes the oldest pooled selection that
+ * is still within both staleness bounds in O(1), and only runs the
+ * selector itself when there is none. Selections past half of either
+ * bound are replaced in the background, so a pool that is asked often
+ * enough never runs dry, and arriving transactions are taken into account
+ * within maxInserts / 2 inserts.
+ */
+class TipService {
+public:
+    TipService(Tangle& tangle, std::mutex& tangleMutex, TipSelector selector, TipServiceConfig config = {});
+    ~TipService();
+
+    void start();
+    void stop();
+
+    // Call with tangleMutex held, as for the selector itself
+    std::vector<std::string> selectTips();
+
+    TipServiceStats stats() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Selection {
+        std::vector<std::string> tips;
+        Clock::time_point selectedAt;
+        uint64_t insertions; // tangle.insertions() when selected
+    };
+
+    // Within the bounds scaled by `share` (1 to hand out, 0.5 to keep)
+    bool fresh(const Selection& s, Clock::time_point now, uint64_t insertions, double share) const;
+    void run();
+
+    Tangle& tangle;
+    std::mutex& tangleMutex;
+    TipSelector selector;
+    TipServiceConfig config;
+
+    mutable std::mutex poolMutex;
+    std::condition_variable wake;
+    std::deque<Selection> pool; // oldest first
+    TipServiceStats counters{};
+    bool stopping = false;
+    std::thread worker;
+};
+
+#endif
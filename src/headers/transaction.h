@@ -16,5 +16,12 @@ struct Transaction {
     std::vector<std::string> validating_transactions;
     int cumulative_weight;
     std::string proof_of_work;
+    // Ed25519 keys and signatures in hex (signature.h): the sender signs the body, the receiver
+    // signs the body's hash with its nonce
+    std::string sender_key;
+    std::string sender_signature;
+    std::string receiver_key;
+    std::string receiver_nonce;
+    std::string receiver_signature;
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,76 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <string>
+#include <vector>
+#include <array>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+// The ways a message can reach a peer
+enum class PathKind : uint8_t {
+    Tcp = 0,  // persistent connection (PeerManager)
+    Lora = 1  // the radio mesh (LoraMesh)
+};
+
+static const size_t PATH_KINDS = 2;
+
+const char* pathName(PathKind kind);
+
+// What one path to one peer has shown so far
+struct PathState {
+    bool available = false;    // connected, or radio enabled, as last reported
+    double latency = 0;        // seconds for a small message, smoothed
+    double bytesPerSecond = 0; // smoothed over large messages
+    uint64_t delivered = 0;
+    uint64_t failed = 0;
+    int failures = 0;          // in a row; each holds the path back for longer
+    std::chrono::steady_clock::time_point heldUntil;
+};
+
+/**
+ * Per-peer route entries for every PathKind, and the choice between them.
+ * A path costs the time it is expected to take to deliver a message: its
+ * latency plus the size over its bandwidth, both learned from deliveries
+ * and starting from a prior for the kind of path. A path is healthy while
+ * it is available and has not just failed; after each failure in a row it
+ * is held back twice as long, up to a minute, and the first delivery
+ * clears it. Messages go over the cheapest healthy path, so a large sync
+ * takes TCP whenever the peer is connected and the radio carries what
+ * cannot go any other way.
+ */
+class PathSelector {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    PathSelector();
+
+    // Latency and bandwidth assumed for paths of `kind` until they have delivered something
+    void setPrior(PathKind kind, double latency, double bytesPerSecond);
+    void setAvailable(const std::string& peer, PathKind kind, bool available);
+
+    // A message of `bytes` reached peer `seconds` after it was handed to the path
+    void delivered(const std::string& peer, PathKind kind, size_t bytes, double seconds);
+    void failed(const std::string& peer, PathKind kind, Clock::time_point now);
+
+    // Expected seconds to deliver `bytes`; infinite when the path is unavailable or held back
+    double cost(const std::string& peer, PathKind kind, size_t bytes, Clock::time_point now) const;
+    // Healthy paths to peer, cheapest first, then available paths still held back as a last resort
+    std::vector<PathKind> rank(const std::string& peer, size_t bytes, Clock::time_point now) const;
+
+    PathState state(const std::string& peer, PathKind kind) const;
+
+private:
+    using Entries = std::array<PathState, PATH_KINDS>;
+
+    Entries& entries(const std::string& peer);
+    static double transferTime(const PathState& path, size_t bytes);
+
+    mutable std::mutex selectorMutex;
+    Entries priors;
+    std::map<std::string, Entries> routes;
+};
+
+#endif // TRANSPORT_H
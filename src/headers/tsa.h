@@ -2,6 +2,148 @@
 #define TSA_H
 #include <vector>
 #include <string>
+#include <memory>
+#include <cstdint>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include "tangle.h"
+
+// Up to maxParents tips from the Tangle's tip pool, fresh ones at random, then the oldest lazy
+// ones; the lightest transaction when the pool is empty
 std::vector<std::string> selectTips(Tangle& tangle);
-#endif
\ No newline at end of file
+// As above, ageing the pool to `now` rather than to the current time
+std::vector<std::string> selectTips(Tangle& tangle, TipPool::Clock::time_point now);
+// Random walks from the entry points; MCMC steps to an approver with probability ~ exp(alpha * weight)
+std::vector<std::string> selectTipsMCMC(Tangle& tangle, double alpha = 0.1);
+// Greedy weighted walk: steps to an approver with probability ~ its cumulative weight
+std::vector<std::string> selectTipsGWW(Tangle& tangle);
+// Unweighted random walk: every approver equally likely
+std::vector<std::string> selectTipsURW(Tangle& tangle);
+// Weighted random walk: steps to an approver with probability ~ its cumulative weight
+std::vector<std::string> selectTipsWRW(Tangle& tangle);
+
+// xoshiro256**: small, fast and good enough for walks; not for anything secret
+class WalkRng {
+public:
+    using result_type = uint64_t;
+
+    explicit WalkRng(uint64_t seed);
+
+    result_type operator()();
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    double uniform();       // [0, 1)
+    size_t below(size_t n); // [0, n)
+    // Advances 2^128 draws: successive jumps from one seed give non-overlapping streams
+    void jump();
+
+private:
+    uint64_t state[4];
+};
+
+// This thread's walk generator, seeded once from std::random_device
+WalkRng& walkRng();
+
+// Walker's alias method: draws i with probability weights[i] / sum(weights) in O(1)
+struct AliasTable {
+    std::vector<double> probability;
+    std::vector<uint32_t> alias;
+
+    // Negative weights count as zero; all zero, every index is equally likely
+    void build(const std::vector<double>& weights);
+    size_t sample(WalkRng& rng) const;
+};
+
+// How a walk weighs the approvers of the transaction it is on
+enum class WalkBias {
+    Uniform,    // not at all
+    Weight,     // cumulative weight
+    Exponential // exp(alpha * cumulative weight)
+};
+
+/**
+ * Transition tables of the weighted walks: for each transaction, an alias
+ * table over its approvers, so a walk step costs O(1) instead of a pass
+ * over the approvers' weights. A table is kept until the transaction's
+ * approvalVersion() changes, that is until it gains an approver or one of
+ * them changes weight. Safe to use from several walks at once.
+ */
+class WalkCache {
+public:
+    // Table over tangle.approversOf(id); alpha only matters to WalkBias::Exponential, and
+    // WalkBias::Uniform needs no table
+    std::shared_ptr<const AliasTable> table(const Tangle& tangle, const std::string& id, WalkBias bias,
+                                            double alpha);
+
+    // The cache attached to tangle, created on first use
+    static WalkCache& of(const Tangle& tangle);
+
+private:
+    struct Entry {
+        uint64_t version;
+        std::shared_ptr<const AliasTable> table;
+    };
+
+    std::shared_mutex cacheMutex;
+    std::unordered_map<std::string, Entry> weighted;
+    std::unordered_map<std::string, Entry> exponential;
+    double exponentialAlpha = 0; // that the exponential tables were built for
+};
+
+// Walks from start to a tip, each step through the cached transition table of the current transaction
+std::string walkToTip(const Tangle& tangle, const std::string& start, WalkBias bias, double alpha, WalkRng& rng);
+
+/**
+ * Runs tip-selection walks side by side on a pool of worker threads. The
+ * Tangle is only read, so the caller keeps it from changing (tangleMutex)
+ * until walk() returns. Each worker has its own WalkRng: worker i starts
+ * from the executor's seed jumped i times, and walk j of a call always
+ * runs on worker j % workers, so an executor created with the same seed
+ * and number of workers makes the same choices on the same Tangle.
+ */
+class WalkExecutor {
+public:
+    // seed 0 seeds from std::random_device
+    explicit WalkExecutor(size_t workers = std::thread::hardware_concurrency(), uint64_t seed = 0);
+    ~WalkExecutor();
+
+    // Tips reached by k independent walks, each from an entry point of its own, in walk order; empty
+    // for an empty Tangle
+    std::vector<std::string> walk(const Tangle& tangle, size_t k, WalkBias bias, double alpha = 0.1);
+    // The distinct tips k walks reached, most often reached first (ties by id), with their counts
+    std::vector<std::pair<std::string, size_t>> rank(const Tangle& tangle, size_t k, WalkBias bias,
+                                                     double alpha = 0.1);
+
+    size_t workers() const { return rngs.size(); }
+
+    // The executor the TSA functions share
+    static WalkExecutor& shared();
+
+private:
+    struct Job {
+        const Tangle* tangle;
+        const std::vector<std::string>* starts; // tangle->entryPoints()
+        WalkBias bias;
+        double alpha;
+        std::vector<std::string>* tips;
+    };
+
+    void work(size_t index);
+
+    std::vector<std::thread> threads; // none for a single worker
+    std::vector<WalkRng> rngs;        // one per worker
+    std::mutex callMutex;        // one walk() at a time
+    std::mutex jobMutex;
+    std::condition_variable jobReady;
+    std::condition_variable jobDone;
+    Job job;
+    uint64_t generation = 0;     // bumped per job
+    size_t busy = 0;             // workers still on the current job
+    bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef VALIDATIONCACHE_H
+#define VALIDATIONCACHE_H
+#include <array>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+// SHA3-256 of everything a transaction carries (signature.h: contentHash)
+using ContentHash = std::array<uint8_t, 32>;
+
+// What has been established about a transaction's content; flags of one entry accumulate
+enum ValidationOutcome : uint8_t {
+    SIGNATURES_VALID = 1 << 0,
+    REJECTED         = 1 << 7, // failed a check; nothing else about it matters
+};
+
+static const size_t DEFAULT_VALIDATION_CACHE_ENTRIES = 1 << 16;
+
+struct ValidationCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t entries;
+    size_t capacity;
+    size_t memoryBytes; // slots, index nodes and buckets; allocator overhead not counted
+
+    double hitRate() const { return hits + misses > 0 ? double(hits) / (hits + misses) : 0; }
+};
+
+/**
+ * Outcomes of validating transactions, keyed by the hash of their whole
+ * content, so a transaction that arrives again (every snapshot resends the
+ * Tangle) is not checked again. The key covers the signatures and nonce as
+ * well as the body, and every check is a function of those bytes alone, so
+ * a rejection is cached as safely as an acceptance. At most `capacity`
+ * entries are kept. The entries are split over shards, each with its own
+ * lock, so the verifier's worker threads rarely wait on each other. Each
+ * shard evicts by CLOCK: a hit marks an entry, and the hand sweeping for a
+ * victim clears marks until it finds an entry that was not used since its
+ * last pass.
+ */
+class ValidationCache {
+public:
+    explicit ValidationCache(size_t capacity = DEFAULT_VALIDATION_CACHE_ENTRIES, size_t shards = 16);
+
+    // Returns true and the recorded flags if hash is known
+    bool lookup(const ContentHash& hash, uint8_t& outcome);
+    // Adds outcome to the flags of hash, evicting another entry if the shard is full
+    void record(const ContentHash& hash, uint8_t outcome);
+
+    ValidationCacheStats stats() const;
+
+private:
+    struct KeyHash {
+        size_t operator()(const ContentHash& key) const noexcept {
+            size_t h;
+            std::memcpy(&h, key.data(), sizeof(h)); // already uniformly distributed
+            return h;
+        }
+    };
+
+    struct Slot {
+        ContentHash key;
+        uint8_t outcome;
+        bool referenced;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::vector<Slot> slots; // filled up to capacity, then reused in place
+        std::unordered_map<ContentHash, uint32_t, KeyHash> index; // hash -> slot
+        size_t hand = 0;
+        uint64_t hits = 0, misses = 0, evictions = 0;
+    };
+
+    Shard& shardFor(const ContentHash& hash);
+
+    size_t perShard;
+    std::unique_ptr<Shard[]> shards;
+    size_t shardCount;
+};
+
+#endif
@@ -4,11 +4,15 @@
 #include <random>
 #include <thread>
 #include <chrono>
-#include <pigpio.h>
+#include <mutex>
 #include <lora.h>
 #include <sx126x.h>
+#include "headers/radio.h"
+#include "headers/serial.h"
 #include "headers/pow.h"
 #include "headers/tsa.h"
+#include "headers/tipservice.h"
+#include "headers/signature.h"
 #include "headers/transaction.h"
 #include "headers/tangle.h"
 #include "headers/network.h"
@@ -18,19 +22,30 @@
 using namespace std;
 using namespace chrono;
 
-void simulateSmartMeter(Tangle &tangle)
+const int SYNC_EVERY = 6; // Full-Tangle broadcast every this many transactions, to repair missed gossip
+
+void simulateSmartMeter(Tangle &tangle, TipService &tips)
 {
     random_device rd;
     mt19937 gen(rd());
     uniform_real_distribution<> energyDist(0.5, 5.0);
     uniform_real_distribution<> priceDist(0.1, 0.5);
+    // Meters started together would otherwise keep broadcasting into each other's LoRa bursts
+    uniform_int_distribution<> periodMs(9000, 11000);
+    SigningKey meterKey = SigningKey::generate();
+    // Stands in for the receiver, whose approval (README step 4) does not travel over the network yet
+    SigningKey gridKey = SigningKey::generate();
 
     vector<int> timearray;
     int i = 0;
     while (i < 1000)
     {
         i++;
-        vector<string> parents = selectTips(tangle);
+        vector<string> parents;
+        {
+            lock_guard<mutex> lock(tangleMutex);
+            parents = tips.selectTips();
+        }
 
         Transaction newTx;
         newTx.transaction_id = "tx" + to_string(rand());
@@ -44,12 +59,15 @@ void simulateSmartMeter(Tangle &tangle)
         newTx.currency = "USD";
         newTx.previous_transactions = parents;
         newTx.proof_of_work = "Pending";
+        signAsSender(newTx, meterKey);
+        signAsReceiver(newTx, gridKey);
 
         cout << "[LOG] Generating new transaction: " << newTx.transaction_id << " at:" << newTx.timestamp << endl;
         auto start = chrono::high_resolution_clock::now();
         // Compute PoW for new transaction
         newTx.proof_of_work = performPoW(newTx.transaction_id, 2);
 
+        unique_lock<mutex> lock(tangleMutex);
         // Update cumulative weight for selected tips
         for (const string &parent : parents)
         {
@@ -64,8 +82,13 @@ void simulateSmartMeter(Tangle &tangle)
         cout << "[LOG] Transaction " << newTx.transaction_id << " added to Tangle." << endl;
         cout << "Time elapsed:" << elapsed << " ms" << endl;
 
-        broadcastTangle(tangle);
-        this_thread::sleep_for(chrono::seconds(10));
+        gossipTransaction(tangle, newTx);
+        if (i % SYNC_EVERY == 0)
+        {
+            broadcastTangle(tangle);
+        }
+        lock.unlock();
+        this_thread::sleep_for(chrono::milliseconds(periodMs(gen)));
     }
 }
 void printVec(vector<uint8_t> v)
@@ -74,21 +97,18 @@ void printVec(vector<uint8_t> v)
 
     cout << str << endl;
 }
-void receiveLoop(){
+void receiveLoop(Tangle &tangle){
     
     while(true){
-        receiveOverLora();
+        receiveOverLora(tangle);
         std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
 }
 int main()
 {
 
-    if (gpioInitialise() < 0)
-    {
-        std::cerr << "pigpio initialization failed" << std::endl;
-        return 1;
-    }
+    // The HAT is only opened, and pigpio initialised, on first LoRa use
+    LoraRadio::setDefaultTransport(openPigpioSerial);
 
     // initializeLora();
     
@@ -96,22 +116,30 @@ int main()
     Tangle tangle;
 
     // Create genesis transaction (without PoW initially)
-    Transaction genesis = {"tx0", "2025-03-11T12:00:00Z", 00000000011, "node_A", "node_B", 5.0, "kWh", 0.12, "USD", {}, {"tx3", "tx4"}, 1, ""};
+    Transaction genesis = {"tx0", "2025-03-11T12:00:00Z", 00000000011, "node_A", "node_B", 5.0, "kWh", 0.12, "USD", {}, {"tx3", "tx4"}, 1, "", "", "", "", "", ""};
 
     // Compute PoW separately
     genesis.proof_of_work = performPoW(genesis.transaction_id, 2);
     tangle.addTransaction(genesis);
 
     // thread serverThread(startServer, ref(tangle));
-    // thread loraThread(receiveLoop);
+    // thread loraThread(receiveLoop, ref(tangle));
+    // Tip pairs are selected ahead of time, off the issuing path
+    TipService tipService(tangle, tangleMutex, [](Tangle &t) { return selectTips(t); });
+    tipService.start();
+
     // Start transaction simulation in a separate thread
-    thread simulationThread(simulateSmartMeter, ref(tangle));
+    thread simulationThread(simulateSmartMeter, ref(tangle), ref(tipService));
 
     // Join the threads to keep the main function active
     // serverThread.join();
     // loraThread.join();
     simulationThread.join();
+    tipService.stop();
+
+    TipServiceStats stats = tipService.stats();
+    cout << "[LOG] Tip selections: " << stats.handedOut << " ready, " << stats.selectedInline << " inline, "
+         << stats.selectedAhead << " ahead, " << stats.expired << " expired" << endl;
 
     return 0;
-    gpioTerminate();
 }
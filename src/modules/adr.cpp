@@ -0,0 +1,115 @@
+#include "adr.h"
+#include "sx126x.h"
+
+#include <algorithm>
+
+static const int AIR_SPEEDS[] = {1200, 2400, 4800, 9600, 19200, 38400, 62500}; // slowest first
+static const int POWERS[] = {10, 13, 17, 22};                                  // lowest first
+
+static constexpr double RSSI_SMOOTHING = 0.2;  // weight of a new reading
+static constexpr double QUIET_NOISE = -115.0;  // dBm; noise above this eats into the margin
+static constexpr double BASE_MARGIN = 10.0;    // dB
+static constexpr double SPEEDUP_HEADROOM = 3.0; // dB beyond the margin before a faster or quieter setting
+static constexpr double PENALTY_STEP = 3.0;    // dB added while loss is above target
+static constexpr double PENALTY_RELAX = 1.0;   // dB removed while loss is well below it
+static constexpr double MAX_PENALTY = 15.0;
+
+// -------------------- LinkQuality --------------------
+
+void LinkQuality::observe(uint16_t src, int rssi, Clock::time_point now) {
+    heardAny = now;
+    NeighbourQuality& n = table[src];
+    n.lastHeard = now;
+    if (rssi == 0) {
+        return; // RSSI byte disabled
+    }
+    n.rssi = n.samples == 0 ? rssi : n.rssi + RSSI_SMOOTHING * (rssi - n.rssi);
+    n.samples++;
+}
+
+void LinkQuality::shift(double db) {
+    for (auto& [src, n] : table) {
+        n.rssi += db;
+    }
+}
+
+double LinkQuality::margin(uint16_t src, int airSpeed, int powerDrop) const {
+    auto it = table.find(src);
+    if (it == table.end() || it->second.samples == 0) {
+        return -1e9;
+    }
+    double noiseExcess = noise != 0 ? std::max(0.0, noise - QUIET_NOISE) : 0.0;
+    return it->second.rssi - powerDrop - sx126x::sensitivity_dbm(airSpeed) - noiseExcess;
+}
+
+std::vector<uint16_t> LinkQuality::active(Clock::time_point now, Clock::duration recent, size_t minSamples) const {
+    std::vector<uint16_t> out;
+    for (const auto& [src, n] : table) {
+        if (now - n.lastHeard <= recent && n.samples >= minSamples) {
+            out.push_back(src);
+        }
+    }
+    return out;
+}
+
+// -------------------- AdrPolicy --------------------
+
+AdrPolicy::AdrPolicy(double lossTarget) : lossTarget(lossTarget), baseMargin(BASE_MARGIN), penalty(0) {}
+
+void AdrPolicy::updateLoss(double loss) {
+    if (loss > lossTarget) {
+        penalty = std::min(MAX_PENALTY, penalty + PENALTY_STEP);
+    } else if (loss < lossTarget / 2) {
+        penalty = std::max(0.0, penalty - PENALTY_RELAX);
+    }
+}
+
+bool AdrPolicy::choose(const LinkQuality& links, const std::vector<uint16_t>& neighbours, int airSpeed, int power,
+                       int& newAirSpeed, int& newPower) const {
+    if (neighbours.empty()) {
+        return false;
+    }
+    // Worst neighbour margin at a setting, RSSI having been measured at the current power
+    auto worst = [&](int speed, int p) {
+        double m = 1e9;
+        for (uint16_t src : neighbours) {
+            m = std::min(m, links.margin(src, speed, power - p));
+        }
+        return m;
+    };
+
+    // Faster or quieter than now only with headroom; slower or louder at once
+    double margin = requiredMargin();
+    double headroom = margin + SPEEDUP_HEADROOM;
+
+    newAirSpeed = AIR_SPEEDS[0];
+    for (int speed : AIR_SPEEDS) {
+        if (worst(speed, BASE_POWER) >= (speed > airSpeed ? headroom : margin)) {
+            newAirSpeed = speed;
+        }
+    }
+    // A thin margin alone is no reason to slow down while packets still get through
+    bool failing = penalty > 0 || worst(airSpeed, power) < 0;
+    if (newAirSpeed < airSpeed && !failing) {
+        newAirSpeed = airSpeed;
+    }
+
+    newPower = BASE_POWER;
+    for (int p : POWERS) {
+        bool quieter = newAirSpeed > airSpeed || p < power;
+        if (worst(newAirSpeed, p) >= (quieter ? headroom : margin)) {
+            newPower = p;
+            break;
+        }
+    }
+    return newAirSpeed != airSpeed || newPower != power;
+}
+
+bool AdrPolicy::acceptable(const LinkQuality& links, uint16_t proposer, int airSpeed, int power,
+                           int currentAirSpeed, int currentPower) const {
+    if (airSpeed == BASE_AIR_SPEED && power == BASE_POWER) {
+        return true; // the fallback is always accepted
+    }
+    double proposed = links.margin(proposer, airSpeed, currentPower - power);
+    return proposed >= requiredMargin() || proposed >= links.margin(proposer, currentAirSpeed, 0);
+}
@@ -0,0 +1,364 @@
+#include "../headers/codec.h"
+#include <cmath>
+
+// Strings every node knows up front; indices are part of the wire format, append only
+static const std::vector<std::string> STATIC_DICT = {
+    "Meter_001", "Grid", "node_A", "node_B",
+    "kWh", "Wh", "MWh",
+    "USD", "EUR", "INR",
+    "Pending", "INVALID_POW"
+};
+static const size_t MAX_ADAPTIVE = 64;
+static const size_t KEY_BYTES = 32; // Ed25519 public key
+
+// Field tags
+static const uint8_t TAG_LITERAL = 0;
+static const uint8_t TAG_NUMERIC = 1; // ids: "tx<number>", timestamps: delta, PoW: packed hex, keys: raw bytes
+static const uint8_t TAG_BACKREF = 2; // ids: index of an earlier record in this message, keys: adaptive entry
+
+static void putVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static void putSigned(std::vector<uint8_t>& out, int64_t value) {
+    putVarint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+static void putLiteral(std::vector<uint8_t>& out, const std::string& str) {
+    putVarint(out, str.size());
+    out.insert(out.end(), str.begin(), str.end());
+}
+
+// Digits only, no leading zeros, small enough to round-trip through int64
+static bool parseNumber(const std::string& str, size_t from, int64_t& value) {
+    size_t len = str.size() - from;
+    if (len == 0 || len > 18) return false;
+    if (str[from] == '0' && len > 1) return false;
+    value = 0;
+    for (size_t i = from; i < str.size(); i++) {
+        if (str[i] < '0' || str[i] > '9') return false;
+        value = value * 10 + (str[i] - '0');
+    }
+    return true;
+}
+
+static bool isLowerHex(const std::string& str) {
+    if (str.empty()) return false;
+    for (char c : str) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return false;
+    }
+    return true;
+}
+
+static int hexValue(char c) {
+    return (c <= '9') ? c - '0' : c - 'a' + 10;
+}
+
+// -------------------- Encoder --------------------
+
+CompactEncoder::CompactEncoder(size_t limit) : limit(limit) {
+    reset();
+}
+
+void CompactEncoder::reset() {
+    records = 0;
+    lastTimestamp = 0;
+    buffer.assign(1, COMPACT_MAGIC);
+    adaptive.clear();
+    positions.clear();
+}
+
+void CompactEncoder::putString(const std::string& str) {
+    for (size_t i = 0; i < STATIC_DICT.size(); i++) {
+        if (STATIC_DICT[i] == str) {
+            putVarint(buffer, 1 + i);
+            return;
+        }
+    }
+    for (size_t i = 0; i < adaptive.size(); i++) {
+        if (adaptive[i] == str) {
+            putVarint(buffer, 1 + STATIC_DICT.size() + i);
+            return;
+        }
+    }
+    putVarint(buffer, TAG_LITERAL);
+    putLiteral(buffer, str);
+    if (adaptive.size() < MAX_ADAPTIVE) {
+        adaptive.push_back(str);
+    }
+}
+
+// Lower-case hex packed two digits a byte, anything else as a string
+void CompactEncoder::putHex(const std::string& str) {
+    if (isLowerHex(str)) {
+        buffer.push_back(TAG_NUMERIC);
+        putVarint(buffer, str.size());
+        for (size_t i = 0; i < str.size(); i += 2) {
+            uint8_t hi = hexValue(str[i]);
+            uint8_t lo = (i + 1 < str.size()) ? hexValue(str[i + 1]) : 0;
+            buffer.push_back(static_cast<uint8_t>(hi << 4 | lo));
+        }
+    } else {
+        buffer.push_back(TAG_LITERAL);
+        putString(str);
+    }
+}
+
+// A public key recurs across a message: the first time it is sent as its raw bytes and joins the
+// adaptive dictionary, afterwards only its index there. Anything but a key's hex goes as a string
+void CompactEncoder::putKey(const std::string& key) {
+    if (key.size() != 2 * KEY_BYTES || !isLowerHex(key)) {
+        buffer.push_back(TAG_LITERAL);
+        putString(key);
+        return;
+    }
+    for (size_t i = 0; i < adaptive.size(); i++) {
+        if (adaptive[i] == key) {
+            buffer.push_back(TAG_BACKREF);
+            putVarint(buffer, i);
+            return;
+        }
+    }
+    buffer.push_back(TAG_NUMERIC);
+    for (size_t i = 0; i < key.size(); i += 2) {
+        buffer.push_back(static_cast<uint8_t>(hexValue(key[i]) << 4 | hexValue(key[i + 1])));
+    }
+    if (adaptive.size() < MAX_ADAPTIVE) {
+        adaptive.push_back(key);
+    }
+}
+
+void CompactEncoder::putId(const std::string& id) {
+    auto it = positions.find(id);
+    int64_t number;
+    if (it != positions.end()) {
+        buffer.push_back(TAG_BACKREF);
+        putVarint(buffer, it->second);
+    } else if (id.compare(0, 2, "tx") == 0 && parseNumber(id, 2, number)) {
+        buffer.push_back(TAG_NUMERIC);
+        putVarint(buffer, static_cast<uint64_t>(number));
+    } else {
+        buffer.push_back(TAG_LITERAL);
+        putLiteral(buffer, id);
+    }
+}
+
+bool CompactEncoder::add(const Transaction& tx) {
+    // Snapshot state so an oversized record can be rolled back
+    size_t savedSize = buffer.size();
+    size_t savedAdaptive = adaptive.size();
+    int64_t savedTimestamp = lastTimestamp;
+
+    putId(tx.transaction_id);
+
+    int64_t ts;
+    if (parseNumber(tx.timestamp, 0, ts)) {
+        buffer.push_back(TAG_NUMERIC);
+        putSigned(buffer, ts - lastTimestamp);
+        lastTimestamp = ts;
+    } else {
+        buffer.push_back(TAG_LITERAL);
+        putLiteral(buffer, tx.timestamp);
+    }
+
+    putString(tx.sender);
+    putString(tx.receiver);
+    putSigned(buffer, std::llround(tx.amount * AMOUNT_SCALE));
+    putString(tx.unit);
+    putSigned(buffer, std::llround(tx.price_per_unit * PRICE_SCALE));
+    putString(tx.currency);
+    putSigned(buffer, tx.cumulative_weight);
+
+    putHex(tx.proof_of_work);
+
+    putVarint(buffer, tx.previous_transactions.size());
+    for (const auto& parent : tx.previous_transactions) putId(parent);
+    putVarint(buffer, tx.validating_transactions.size());
+    for (const auto& parent : tx.validating_transactions) putId(parent);
+
+    putKey(tx.sender_key);
+    putHex(tx.sender_signature);
+    putKey(tx.receiver_key);
+    putHex(tx.receiver_nonce);
+    putHex(tx.receiver_signature);
+
+    if (records > 0 && buffer.size() > limit) {
+        buffer.resize(savedSize);
+        adaptive.resize(savedAdaptive);
+        lastTimestamp = savedTimestamp;
+        return false;
+    }
+    positions.emplace(tx.transaction_id, records++);
+    return true;
+}
+
+std::vector<std::vector<uint8_t>> encodeCompact(const std::vector<const Transaction*>& txs, size_t limit) {
+    std::vector<std::vector<uint8_t>> messages;
+    CompactEncoder encoder(limit);
+
+    for (const Transaction* tx : txs) {
+        if (!encoder.add(*tx)) {
+            messages.push_back(encoder.data());
+            encoder.reset();
+            encoder.add(*tx);
+        }
+    }
+    if (!encoder.empty()) {
+        messages.push_back(encoder.data());
+    }
+    return messages;
+}
+
+// -------------------- Decoder --------------------
+
+namespace {
+struct Reader {
+    const uint8_t* pos;
+    const uint8_t* end;
+    bool ok = true;
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos >= end) break;
+            uint8_t byte = *pos++;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        ok = false;
+        return 0;
+    }
+    int64_t signedVarint() {
+        uint64_t raw = varint();
+        return static_cast<int64_t>(raw >> 1) ^ -static_cast<int64_t>(raw & 1);
+    }
+    uint8_t byte() {
+        if (pos >= end) { ok = false; return 0; }
+        return *pos++;
+    }
+    std::string literal() {
+        uint64_t len = varint();
+        if (!ok || len > static_cast<uint64_t>(end - pos)) { ok = false; return ""; }
+        std::string str(reinterpret_cast<const char*>(pos), len);
+        pos += len;
+        return str;
+    }
+};
+}
+
+bool decodeCompact(const uint8_t* data, size_t length, std::vector<Transaction>& out) {
+    if (length < 1 || data[0] != COMPACT_MAGIC) return false;
+
+    Reader in{data + 1, data + length};
+    std::vector<std::string> adaptive;
+    std::vector<std::string> ids;
+    int64_t lastTimestamp = 0;
+
+    auto getString = [&]() -> std::string {
+        uint64_t tag = in.varint();
+        if (tag == TAG_LITERAL) {
+            std::string str = in.literal();
+            if (adaptive.size() < MAX_ADAPTIVE) adaptive.push_back(str);
+            return str;
+        }
+        if (tag <= STATIC_DICT.size()) return STATIC_DICT[tag - 1];
+        if (tag - 1 - STATIC_DICT.size() < adaptive.size()) return adaptive[tag - 1 - STATIC_DICT.size()];
+        in.ok = false;
+        return "";
+    };
+    auto getId = [&]() -> std::string {
+        uint8_t tag = in.byte();
+        if (tag == TAG_BACKREF) {
+            uint64_t index = in.varint();
+            if (index < ids.size()) return ids[index];
+        } else if (tag == TAG_NUMERIC) {
+            return "tx" + std::to_string(in.varint());
+        } else if (tag == TAG_LITERAL) {
+            return in.literal();
+        }
+        in.ok = false;
+        return "";
+    };
+
+    auto getHex = [&]() -> std::string {
+        if (in.byte() != TAG_NUMERIC) return getString();
+        std::string str;
+        uint64_t nibbles = in.varint();
+        static const char HEX[] = "0123456789abcdef";
+        for (uint64_t i = 0; in.ok && i < nibbles; i += 2) {
+            uint8_t packed = in.byte();
+            str += HEX[packed >> 4];
+            if (i + 1 < nibbles) str += HEX[packed & 0x0F];
+        }
+        return str;
+    };
+
+    auto getKey = [&]() -> std::string {
+        uint8_t tag = in.byte();
+        if (tag == TAG_LITERAL) return getString();
+        if (tag == TAG_BACKREF) {
+            uint64_t index = in.varint();
+            if (index < adaptive.size()) return adaptive[index];
+        } else if (tag == TAG_NUMERIC && static_cast<size_t>(in.end - in.pos) >= KEY_BYTES) {
+            static const char HEX[] = "0123456789abcdef";
+            std::string key;
+            for (size_t i = 0; i < KEY_BYTES; i++) {
+                uint8_t packed = in.byte();
+                key += HEX[packed >> 4];
+                key += HEX[packed & 0x0F];
+            }
+            if (adaptive.size() < MAX_ADAPTIVE) adaptive.push_back(key);
+            return key;
+        }
+        in.ok = false;
+        return "";
+    };
+
+    std::vector<Transaction> txs;
+    while (in.ok && in.pos < in.end) {
+        Transaction tx;
+        tx.transaction_id = getId();
+
+        if (in.byte() == TAG_NUMERIC) {
+            lastTimestamp += in.signedVarint();
+            tx.timestamp = std::to_string(lastTimestamp);
+            tx.timestampInt = static_cast<int>(lastTimestamp);
+        } else {
+            tx.timestamp = in.literal();
+            tx.timestampInt = 0;
+        }
+
+        tx.sender = getString();
+        tx.receiver = getString();
+        tx.amount = in.signedVarint() / AMOUNT_SCALE;
+        tx.unit = getString();
+        tx.price_per_unit = in.signedVarint() / PRICE_SCALE;
+        tx.currency = getString();
+        tx.cumulative_weight = static_cast<int>(in.signedVarint());
+
+        tx.proof_of_work = getHex();
+
+        uint64_t count = in.varint();
+        for (uint64_t i = 0; in.ok && i < count; i++) tx.previous_transactions.push_back(getId());
+        count = in.varint();
+        for (uint64_t i = 0; in.ok && i < count; i++) tx.validating_transactions.push_back(getId());
+
+        tx.sender_key = getKey();
+        tx.sender_signature = getHex();
+        tx.receiver_key = getKey();
+        tx.receiver_nonce = getHex();
+        tx.receiver_signature = getHex();
+
+        if (!in.ok) break;
+        ids.push_back(tx.transaction_id);
+        txs.push_back(std::move(tx));
+    }
+    if (!in.ok || txs.empty()) return false;
+
+    out.insert(out.end(), txs.begin(), txs.end());
+    return true;
+}
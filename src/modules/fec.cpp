@@ -0,0 +1,194 @@
+#include "fec.h"
+
+#include <cmath>
+#include <algorithm>
+
+static constexpr double CONFIDENCE_Z = 1.0;      // standard deviations of loss the parity covers
+static constexpr double MAX_LOSS = 0.5;          // estimates above this are treated as this
+static constexpr double NEGLIGIBLE_LOSS = 0.01;  // estimates below this are treated as no loss
+static constexpr double ESTIMATE_DECAY = 0.9;    // per message sent
+static constexpr double ESTIMATE_PRIOR = 10;     // fragments the initial estimate is worth
+
+// -------------------- GF(256) --------------------
+
+// log/exp tables for x^8 + x^4 + x^3 + x^2 + 1 with generator 2
+struct GaloisField {
+    uint8_t exp[512];
+    uint8_t log[256];
+
+    GaloisField() {
+        int x = 1;
+        for (int i = 0; i < 255; i++) {
+            exp[i] = static_cast<uint8_t>(x);
+            log[x] = static_cast<uint8_t>(i);
+            x <<= 1;
+            if (x & 0x100) {
+                x ^= 0x11D;
+            }
+        }
+        for (int i = 255; i < 512; i++) {
+            exp[i] = exp[i - 255];
+        }
+        log[0] = 0;
+    }
+
+    uint8_t mul(uint8_t a, uint8_t b) const {
+        return (a == 0 || b == 0) ? 0 : exp[log[a] + log[b]];
+    }
+
+    uint8_t inv(uint8_t a) const {
+        return exp[255 - log[a]];
+    }
+};
+
+static const GaloisField& gf() {
+    static const GaloisField field;
+    return field;
+}
+
+// dst ^= c * src
+static void mulAdd(std::vector<uint8_t>& dst, const std::vector<uint8_t>& src, uint8_t c) {
+    if (c == 0) {
+        return;
+    }
+    const GaloisField& f = gf();
+    unsigned logC = f.log[c];
+    for (size_t i = 0; i < dst.size(); i++) {
+        if (src[i]) {
+            dst[i] ^= f.exp[f.log[src[i]] + logC];
+        }
+    }
+}
+
+// Row `row` of the generator matrix, column `col`: identity for data rows, 1/(x_i + y_j) for parity rows
+static uint8_t generator(size_t row, size_t col, size_t k) {
+    if (row < k) {
+        return row == col ? 1 : 0;
+    }
+    return gf().inv(static_cast<uint8_t>(row ^ col)); // x_i = row, y_j = col, distinct since row >= k > col
+}
+
+// -------------------- Reed-Solomon --------------------
+
+std::vector<std::vector<uint8_t>> encodeParity(const std::vector<std::vector<uint8_t>>& data, size_t parity) {
+    size_t k = data.size();
+    size_t length = k ? data[0].size() : 0;
+    std::vector<std::vector<uint8_t>> out(parity, std::vector<uint8_t>(length, 0));
+    for (size_t p = 0; p < parity; p++) {
+        for (size_t j = 0; j < k; j++) {
+            mulAdd(out[p], data[j], generator(k + p, j, k));
+        }
+    }
+    return out;
+}
+
+bool decodeErasures(std::vector<std::vector<uint8_t>>& blocks, const std::vector<bool>& present, size_t k) {
+    std::vector<size_t> missing;
+    for (size_t j = 0; j < k; j++) {
+        if (!present[j]) {
+            missing.push_back(j);
+        }
+    }
+    if (missing.empty()) {
+        return true;
+    }
+
+    // The first k blocks to arrive, and the generator rows that produced them
+    std::vector<size_t> rows;
+    for (size_t i = 0; i < blocks.size() && rows.size() < k; i++) {
+        if (present[i]) {
+            rows.push_back(i);
+        }
+    }
+    if (rows.size() < k) {
+        return false;
+    }
+    // Every block is combined byte for byte with the others
+    size_t length = blocks[rows[0]].size();
+    for (size_t r : rows) {
+        if (blocks[r].size() != length) {
+            return false;
+        }
+    }
+
+    // Invert the k x k submatrix by Gauss-Jordan elimination
+    const GaloisField& f = gf();
+    std::vector<std::vector<uint8_t>> m(k, std::vector<uint8_t>(k));
+    std::vector<std::vector<uint8_t>> inv(k, std::vector<uint8_t>(k, 0));
+    for (size_t r = 0; r < k; r++) {
+        for (size_t c = 0; c < k; c++) {
+            m[r][c] = generator(rows[r], c, k);
+        }
+        inv[r][r] = 1;
+    }
+    for (size_t c = 0; c < k; c++) {
+        size_t pivot = c;
+        while (pivot < k && m[pivot][c] == 0) {
+            pivot++;
+        }
+        if (pivot == k) {
+            return false;
+        }
+        std::swap(m[pivot], m[c]);
+        std::swap(inv[pivot], inv[c]);
+        uint8_t scale = f.inv(m[c][c]);
+        for (size_t j = 0; j < k; j++) {
+            m[c][j] = f.mul(m[c][j], scale);
+            inv[c][j] = f.mul(inv[c][j], scale);
+        }
+        for (size_t r = 0; r < k; r++) {
+            uint8_t factor = m[r][c];
+            if (r == c || factor == 0) {
+                continue;
+            }
+            for (size_t j = 0; j < k; j++) {
+                m[r][j] ^= f.mul(factor, m[c][j]);
+                inv[r][j] ^= f.mul(factor, inv[c][j]);
+            }
+        }
+    }
+
+    // data_j = sum over received blocks of inv[j][r] * block_r
+    for (size_t j : missing) {
+        std::vector<uint8_t> rebuilt(length, 0);
+        for (size_t r = 0; r < k; r++) {
+            mulAdd(rebuilt, blocks[rows[r]], inv[j][r]);
+        }
+        blocks[j] = std::move(rebuilt);
+    }
+    return true;
+}
+
+size_t parityFor(size_t k, double loss) {
+    double p = std::min(std::max(loss, 0.0), MAX_LOSS);
+    if (p < NEGLIGIBLE_LOSS || k == 0) {
+        return 0;
+    }
+    // Smallest parity whose expected arrivals, less CONFIDENCE_Z standard deviations, still cover k
+    size_t limit = std::min(k, FEC_MAX_BLOCKS - k);
+    for (size_t parity = 0; parity < limit; parity++) {
+        double n = static_cast<double>(k + parity);
+        if (n * (1 - p) - CONFIDENCE_Z * std::sqrt(n * p * (1 - p)) >= k) {
+            return parity;
+        }
+    }
+    return limit;
+}
+
+// -------------------- LossEstimator --------------------
+
+LossEstimator::LossEstimator(double initial)
+    : sentCount(ESTIMATE_PRIOR), lostCount(ESTIMATE_PRIOR * initial) {}
+
+void LossEstimator::sent(size_t fragments) {
+    sentCount = sentCount * ESTIMATE_DECAY + fragments;
+    lostCount *= ESTIMATE_DECAY;
+}
+
+void LossEstimator::lost(size_t fragments) {
+    lostCount += fragments;
+}
+
+double LossEstimator::rate() const {
+    return sentCount > 0 ? std::min(1.0, lostCount / sentCount) : 0.0;
+}
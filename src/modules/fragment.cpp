@@ -0,0 +1,360 @@
+#include "fragment.h"
+
+#include <cstring>
+#include <algorithm>
+#include <iterator>
+
+static const size_t COMPLETED_MEMORY = 256; // completed message ids remembered to ignore late retransmissions
+
+std::vector<std::vector<uint8_t>> fragmentMessage(uint16_t messageId, const uint8_t* data, size_t length,
+                                                  size_t maxPayload) {
+    uint16_t total = static_cast<uint16_t>(std::max<size_t>(1, (length + maxPayload - 1) / maxPayload));
+    std::vector<std::vector<uint8_t>> fragments;
+    if (total > MAX_FRAGMENTS) {
+        return fragments;
+    }
+    fragments.reserve(total);
+
+    size_t offset = 0;
+    for (uint16_t pid = 0; pid < total; ++pid) {
+        size_t chunkSize = std::min(maxPayload, length - offset);
+
+        PacketHeader hdr{};
+        hdr.messageId = messageId;
+        hdr.packetId = pid;
+        hdr.totalPackets = total;
+        hdr.type = (pid == 0) ? PT_START : (pid + 1 == total ? PT_END : PT_MIDDLE);
+
+        std::vector<uint8_t> fragment(sizeof(hdr) + chunkSize);
+        std::memcpy(fragment.data(), &hdr, sizeof(hdr));
+        if (chunkSize > 0) {
+            std::memcpy(fragment.data() + sizeof(hdr), data + offset, chunkSize);
+        }
+        fragments.push_back(std::move(fragment));
+
+        offset += chunkSize;
+    }
+    return fragments;
+}
+
+std::vector<std::vector<uint8_t>> fragmentCoded(uint16_t messageId, const uint8_t* data, size_t length,
+                                                size_t maxPayload, double loss) {
+    size_t k = std::max<size_t>(1, (length + maxPayload - 1) / maxPayload);
+    std::vector<std::vector<uint8_t>> fragments;
+    if (k > FEC_MAX_BLOCKS) {
+        return fragments;
+    }
+
+    // Equal blocks as small as possible, so padding stays under one byte per block
+    size_t blockSize = (length + k - 1) / k;
+    std::vector<std::vector<uint8_t>> blocks(k, std::vector<uint8_t>(blockSize, 0));
+    for (size_t i = 0; i < k; i++) {
+        size_t offset = i * blockSize;
+        if (offset < length) {
+            std::memcpy(blocks[i].data(), data + offset, std::min(blockSize, length - offset));
+        }
+    }
+    size_t parity = std::min(parityFor(k, loss), FEC_MAX_BLOCKS - k);
+    std::vector<std::vector<uint8_t>> parityBlocks = encodeParity(blocks, parity);
+    blocks.insert(blocks.end(), std::make_move_iterator(parityBlocks.begin()),
+                  std::make_move_iterator(parityBlocks.end()));
+
+    fragments.reserve(blocks.size());
+    for (size_t pid = 0; pid < blocks.size(); ++pid) {
+        CodedHeader hdr{};
+        hdr.type = PT_CODED;
+        hdr.messageId = messageId;
+        hdr.packetId = static_cast<uint16_t>(pid);
+        hdr.totalPackets = static_cast<uint16_t>(blocks.size());
+        hdr.dataPackets = static_cast<uint8_t>(k);
+        hdr.padding = static_cast<uint8_t>(k * blockSize - length);
+
+        std::vector<uint8_t> fragment(sizeof(hdr) + blockSize);
+        std::memcpy(fragment.data(), &hdr, sizeof(hdr));
+        if (blockSize > 0) {
+            std::memcpy(fragment.data() + sizeof(hdr), blocks[pid].data(), blockSize);
+        }
+        fragments.push_back(std::move(fragment));
+    }
+    return fragments;
+}
+
+std::vector<uint8_t> encodeNack(const Nack& nack) {
+    NackHeader hdr{};
+    hdr.type = PT_NACK;
+    hdr.messageId = nack.messageId;
+    hdr.origin = nack.origin;
+    hdr.totalPackets = nack.totalPackets;
+
+    std::vector<uint8_t> out(sizeof(hdr));
+    std::memcpy(out.data(), &hdr, sizeof(hdr));
+    out.insert(out.end(), nack.missing.begin(), nack.missing.end());
+    return out;
+}
+
+bool decodeNack(const uint8_t* data, size_t length, Nack& nack) {
+    NackHeader hdr;
+    if (length < sizeof(hdr)) {
+        return false;
+    }
+    std::memcpy(&hdr, data, sizeof(hdr));
+    size_t bitmapBytes = (hdr.totalPackets + 7) / 8;
+    if (hdr.type != PT_NACK || hdr.totalPackets == 0 || hdr.totalPackets > MAX_FRAGMENTS ||
+        length < sizeof(hdr) + bitmapBytes) {
+        return false;
+    }
+    nack.origin = hdr.origin;
+    nack.messageId = hdr.messageId;
+    nack.totalPackets = hdr.totalPackets;
+    nack.missing.assign(data + sizeof(hdr), data + sizeof(hdr) + bitmapBytes);
+    return true;
+}
+
+// -------------------- Reassembler --------------------
+
+Reassembler::Reassembler(size_t maxAssemblies, size_t maxBytes)
+    : maxAssemblies(maxAssemblies), maxBytes(maxBytes) {}
+
+bool Reassembler::add(uint16_t src, const uint8_t* fragment, size_t length, std::vector<uint8_t>& message,
+                      Clock::time_point now) {
+    PacketHeader header;
+    CodedHeader coded{};
+    size_t headerSize = sizeof(header);
+    if (length < 1 || fragment[0] < PT_START || (fragment[0] > PT_END && fragment[0] != PT_CODED)) {
+        return false;
+    }
+    if (fragment[0] == PT_CODED) {
+        if (length < sizeof(coded)) {
+            return false;
+        }
+        std::memcpy(&coded, fragment, sizeof(coded));
+        if (coded.dataPackets == 0 || coded.dataPackets > coded.totalPackets) {
+            return false;
+        }
+        headerSize = sizeof(coded);
+    } else if (length < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, fragment, sizeof(header)); // CodedHeader starts with the same fields
+    const uint8_t* data = fragment + headerSize;
+    length -= headerSize;
+
+    uint32_t id = key(src, header.messageId);
+    if (header.totalPackets == 0 || header.totalPackets > MAX_FRAGMENTS || header.packetId >= header.totalPackets) {
+        return false;
+    }
+    if (completed.count(id)) {
+        counters.duplicates++;
+        return false;
+    }
+
+    auto it = assemblies.find(id);
+    if (it == assemblies.end()) {
+        Assembly fresh;
+        fresh.src = src;
+        fresh.messageId = header.messageId;
+        fresh.total = header.totalPackets;
+        fresh.coded = header.type == PT_CODED;
+        fresh.needed = fresh.coded ? coded.dataPackets : fresh.total;
+        fresh.padding = coded.padding;
+        fresh.blockSize = length;
+        fresh.parts.resize(fresh.total);
+        fresh.present.assign(fresh.total, false);
+        fresh.first = now;
+        it = assemblies.emplace(id, std::move(fresh)).first;
+    }
+    Assembly& assembly = it->second;
+    if (header.totalPackets != assembly.total || (header.type == PT_CODED) != assembly.coded ||
+        (assembly.coded && coded.dataPackets != assembly.needed)) {
+        return false; // message id reused for a different message; keep the one in progress
+    }
+    // The blocks of a coded message are all the same length; a shorter one was cut short on the way.
+    // If this one is longer, the ones already held were, and they are given up
+    if (assembly.coded && length < assembly.blockSize) {
+        return false;
+    }
+    if (assembly.coded && length > assembly.blockSize) {
+        for (size_t i = 0; i < assembly.parts.size(); i++) {
+            if (assembly.present[i]) {
+                assembly.bytes -= assembly.parts[i].size();
+                counters.bytes -= assembly.parts[i].size();
+                assembly.parts[i].clear();
+                assembly.present[i] = false;
+            }
+        }
+        assembly.received = 0;
+        assembly.blockSize = length;
+    }
+    assembly.last = now;
+    if (assembly.present[header.packetId]) {
+        counters.duplicates++;
+        return false;
+    }
+
+    assembly.parts[header.packetId].assign(data, data + length);
+    assembly.present[header.packetId] = true;
+    assembly.received++;
+    assembly.nackRounds = 0; // progress; the sender is answering
+    assembly.bytes += length;
+    counters.bytes += length;
+
+    if (assembly.received == assembly.needed) {
+        bool rebuilt = rebuild(assembly, message);
+        drop(it);
+        if (!rebuilt) {
+            return false;
+        }
+        rememberCompleted(id);
+        counters.completed++;
+        return true;
+    }
+
+    enforceLimits(id);
+    return false;
+}
+
+std::vector<Nack> Reassembler::stalled(Clock::time_point now, Clock::duration quiet, int maxRounds) {
+    std::vector<Nack> nacks;
+    for (auto& [id, assembly] : assemblies) {
+        if (assembly.nackRounds >= maxRounds || now - assembly.last < quiet) {
+            continue;
+        }
+        Nack nack;
+        nack.origin = assembly.src;
+        nack.messageId = assembly.messageId;
+        nack.totalPackets = assembly.total;
+        nack.missing.assign((assembly.total + 7) / 8, 0);
+        for (uint16_t i = 0; i < assembly.total; i++) {
+            if (!assembly.present[i]) {
+                nack.missing[i / 8] |= static_cast<uint8_t>(1 << (i % 8));
+            }
+        }
+        nacks.push_back(std::move(nack));
+        assembly.nackRounds++;
+        assembly.last = now; // give the retransmission time to arrive before asking again
+    }
+    return nacks;
+}
+
+void Reassembler::expire(Clock::time_point now, Clock::duration timeout) {
+    for (auto it = assemblies.begin(); it != assemblies.end();) {
+        auto next = std::next(it);
+        if (now - it->second.first > timeout) {
+            drop(it);
+            counters.expired++;
+        }
+        it = next;
+    }
+}
+
+ReassemblyStats Reassembler::stats() const {
+    ReassemblyStats out = counters;
+    out.assemblies = assemblies.size();
+    return out;
+}
+
+bool Reassembler::rebuild(Assembly& assembly, std::vector<uint8_t>& message) {
+    if (assembly.coded && !decodeErasures(assembly.parts, assembly.present, assembly.needed)) {
+        return false;
+    }
+    message.clear();
+    message.reserve(assembly.bytes);
+    for (uint16_t i = 0; i < assembly.needed; i++) {
+        message.insert(message.end(), assembly.parts[i].begin(), assembly.parts[i].end());
+    }
+    message.resize(message.size() - std::min<size_t>(assembly.padding, message.size()));
+    return true;
+}
+
+void Reassembler::drop(std::unordered_map<uint32_t, Assembly>::iterator it) {
+    counters.bytes -= it->second.bytes;
+    assemblies.erase(it);
+}
+
+void Reassembler::rememberCompleted(uint32_t id) {
+    completed.insert(id);
+    completedOrder.push_back(id);
+    if (completedOrder.size() > COMPLETED_MEMORY) {
+        completed.erase(completedOrder.front());
+        completedOrder.pop_front();
+    }
+}
+
+// Evicts the least recently active assemblies, other than `keep`, until within both bounds
+void Reassembler::enforceLimits(uint32_t keep) {
+    while (assemblies.size() > maxAssemblies || counters.bytes > maxBytes) {
+        auto oldest = assemblies.end();
+        for (auto it = assemblies.begin(); it != assemblies.end(); ++it) {
+            if (it->first != keep && (oldest == assemblies.end() || it->second.last < oldest->second.last)) {
+                oldest = it;
+            }
+        }
+        if (oldest == assemblies.end()) {
+            oldest = assemblies.find(keep); // a single message larger than the whole budget
+        }
+        drop(oldest);
+        counters.evicted++;
+    }
+}
+
+// -------------------- SendWindow --------------------
+
+SendWindow::SendWindow(size_t maxMessages) : maxMessages(maxMessages) {}
+
+void SendWindow::store(uint16_t messageId, std::vector<std::vector<uint8_t>> fragments) {
+    messages.push_back({messageId, std::move(fragments)});
+    if (messages.size() > maxMessages) {
+        messages.pop_front();
+    }
+}
+
+// Index of the most recent message the NACK is for, or messages.size()
+size_t SendWindow::find(const Nack& nack) const {
+    for (size_t i = messages.size(); i-- > 0;) {
+        if (messages[i].messageId == nack.messageId && messages[i].fragments.size() == nack.totalPackets) {
+            return i;
+        }
+    }
+    return messages.size();
+}
+
+std::vector<std::vector<uint8_t>> SendWindow::missing(const Nack& nack, double loss) const {
+    std::vector<std::vector<uint8_t>> out;
+    size_t index = find(nack);
+    if (index == messages.size()) {
+        return out;
+    }
+    const Sent* sent = &messages[index];
+
+    size_t marked = 0;
+    for (size_t i = 0; i < sent->fragments.size(); i++) {
+        if (nack.missing[i / 8] & (1 << (i % 8))) {
+            marked++;
+        }
+    }
+    size_t limit = marked;
+    const std::vector<uint8_t>& first = sent->fragments.front();
+    if (first[0] == PT_CODED) {
+        CodedHeader hdr;
+        std::memcpy(&hdr, first.data(), sizeof(hdr));
+        size_t received = sent->fragments.size() - marked;
+        size_t needed = hdr.dataPackets > received ? hdr.dataPackets - received : 0;
+        limit = std::min(marked, needed + parityFor(needed, loss));
+    }
+
+    for (size_t i = 0; i < sent->fragments.size() && out.size() < limit; i++) {
+        if (nack.missing[i / 8] & (1 << (i % 8))) {
+            out.push_back(sent->fragments[i]);
+        }
+    }
+    return out;
+}
+
+bool SendWindow::firstNack(const Nack& nack) {
+    size_t index = find(nack);
+    if (index == messages.size() || messages[index].nacked) {
+        return false;
+    }
+    messages[index].nacked = true;
+    return true;
+}
@@ -0,0 +1,82 @@
+#include "../headers/frame.h"
+#include <array>
+#include <cstring>
+#include <arpa/inet.h>
+
+// Reflected CRC-32 (IEEE 802.3), table built on first use
+static const std::array<uint32_t, 256>& crcTable() {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    return table;
+}
+
+uint32_t crc32(uint32_t crc, const void* data, size_t length) {
+    const auto& table = crcTable();
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+std::string encodeFrame(MessageType type, const std::string& payload) {
+    FrameHeader hdr{};
+    hdr.magic = htons(FRAME_MAGIC);
+    hdr.version = FRAME_VERSION;
+    hdr.type = type;
+    hdr.length = htonl(static_cast<uint32_t>(payload.size()));
+
+    uint32_t crc = crc32(0, &hdr, offsetof(FrameHeader, crc));
+    hdr.crc = htonl(crc32(crc, payload.data(), payload.size()));
+
+    std::string out(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    out += payload;
+    return out;
+}
+
+FrameStatus decodeFrame(const char* data, size_t size, size_t maxPayload, Frame& frame, size_t& consumed) {
+    if (size < sizeof(FrameHeader)) return FRAME_INCOMPLETE;
+
+    FrameHeader hdr;
+    std::memcpy(&hdr, data, sizeof(hdr));
+    uint32_t length = ntohl(hdr.length);
+    if (ntohs(hdr.magic) != FRAME_MAGIC || hdr.version != FRAME_VERSION || length > maxPayload) {
+        return FRAME_INVALID;
+    }
+    if (size - sizeof(hdr) < length) return FRAME_INCOMPLETE;
+
+    const char* payload = data + sizeof(hdr);
+    uint32_t crc = crc32(crc32(0, data, offsetof(FrameHeader, crc)), payload, length);
+    if (crc != ntohl(hdr.crc)) return FRAME_INVALID;
+
+    frame.type = static_cast<MessageType>(hdr.type);
+    frame.crc = crc;
+    frame.payload.assign(payload, length);
+    consumed = sizeof(hdr) + length;
+    return FRAME_OK;
+}
+
+std::string ackPayload(const Frame& frame) {
+    uint32_t crc = htonl(frame.crc);
+    std::string out(1, static_cast<char>(frame.type));
+    out.append(reinterpret_cast<const char*>(&crc), sizeof(crc));
+    return out;
+}
+
+std::string ackPayload(const std::string& encoded) {
+    FrameHeader hdr;
+    std::memcpy(&hdr, encoded.data(), sizeof(hdr));
+    std::string out(1, static_cast<char>(hdr.type));
+    out.append(reinterpret_cast<const char*>(&hdr.crc), sizeof(hdr.crc)); // already big endian
+    return out;
+}
@@ -0,0 +1,165 @@
+#include "gossip.h"
+#include "frame.h"
+#include <cmath>
+#include <algorithm>
+#include <functional>
+
+using namespace std;
+
+const size_t BATCH_BYTES = 16 * 1024;                 // Flush a peer's batch early once this much is queued
+const auto BATCH_DELAY = chrono::milliseconds(20);    // Longest a transaction waits for batching
+
+// -------------------- SeenFilter --------------------
+
+SeenFilter::SeenFilter(size_t capacity, double falsePositiveRate)
+    : capacity(capacity), count(0)
+{
+    const double ln2 = log(2.0);
+    bits = max<size_t>(64, static_cast<size_t>(ceil(-double(capacity) * log(falsePositiveRate) / (ln2 * ln2))));
+    hashes = max<size_t>(1, static_cast<size_t>(round(double(bits) / capacity * ln2)));
+    current.assign((bits + 63) / 64, 0);
+    previous.assign((bits + 63) / 64, 0);
+}
+
+// Double hashing: position i = h1 + i * h2
+void SeenFilter::positions(const string &id, vector<size_t> &out) const
+{
+    uint64_t h1 = hash<string>{}(id);
+    uint64_t h2 = 1469598103934665603ull; // FNV-1a
+    for (unsigned char c : id)
+    {
+        h2 = (h2 ^ c) * 1099511628211ull;
+    }
+    h2 |= 1;
+
+    out.clear();
+    for (size_t i = 0; i < hashes; i++)
+    {
+        out.push_back((h1 + i * h2) % bits);
+    }
+}
+
+static bool allSet(const vector<uint64_t> &words, const vector<size_t> &positions)
+{
+    for (size_t pos : positions)
+    {
+        if (!(words[pos / 64] & (1ull << (pos % 64))))
+            return false;
+    }
+    return true;
+}
+
+bool SeenFilter::contains(const string &id) const
+{
+    vector<size_t> pos;
+    positions(id, pos);
+    return allSet(current, pos) || allSet(previous, pos);
+}
+
+bool SeenFilter::checkAndInsert(const string &id)
+{
+    vector<size_t> pos;
+    positions(id, pos);
+    if (allSet(current, pos))
+        return true;
+    bool seenBefore = allSet(previous, pos);
+
+    for (size_t p : pos)
+    {
+        current[p / 64] |= 1ull << (p % 64);
+    }
+    if (++count >= capacity)
+    {
+        previous.swap(current);
+        fill(current.begin(), current.end(), 0);
+        count = 0;
+    }
+    return seenBefore;
+}
+
+// -------------------- Gossip --------------------
+
+Gossip::Gossip(PeerManager &peers, size_t fanout)
+    : peers(peers), fanout(fanout), seen(100000, 0.01), rng(random_device{}()), pendingBytes(0),
+      running(true), published(0), received(0), duplicates(0), frames(0)
+{
+    flusher = thread(&Gossip::flushLoop, this);
+}
+
+Gossip::~Gossip()
+{
+    running = false;
+    wake.notify_all();
+    flusher.join();
+    flush();
+}
+
+bool Gossip::markSeen(const string &id)
+{
+    lock_guard<mutex> lock(gossipMutex);
+    return !seen.checkAndInsert(id);
+}
+
+void Gossip::publish(const string &serialized, const string &from)
+{
+    vector<string> targets = peers.nodes();
+    targets.erase(remove(targets.begin(), targets.end(), from), targets.end());
+
+    lock_guard<mutex> lock(gossipMutex);
+
+    // Partial Fisher-Yates: the first `fanout` entries become a uniform random sample
+    size_t picks = min(fanout, targets.size());
+    for (size_t i = 0; i < picks; i++)
+    {
+        uniform_int_distribution<size_t> dist(i, targets.size() - 1);
+        swap(targets[i], targets[dist(rng)]);
+        pending[targets[i]] += serialized;
+        pendingBytes += serialized.size();
+    }
+    published++;
+
+    if (pendingBytes >= BATCH_BYTES)
+        wake.notify_one();
+}
+
+void Gossip::recordArrival(bool duplicate)
+{
+    received++;
+    if (duplicate)
+        duplicates++;
+}
+
+GossipStats Gossip::stats() const
+{
+    return {published.load(), received.load(), duplicates.load(), frames.load()};
+}
+
+void Gossip::flushLoop()
+{
+    while (running)
+    {
+        {
+            unique_lock<mutex> lock(gossipMutex);
+            wake.wait_for(lock, BATCH_DELAY);
+        }
+        flush();
+    }
+}
+
+// One frame per peer: a lone transaction goes as MSG_TRANSACTION, several as one MSG_DELTA
+void Gossip::flush()
+{
+    map<string, string> batches;
+    {
+        lock_guard<mutex> lock(gossipMutex);
+        batches.swap(pending);
+        pendingBytes = 0;
+    }
+
+    for (const auto &[node, lines] : batches)
+    {
+        bool single = count(lines.begin(), lines.end(), '\n') == 1;
+        peers.send(node, "", make_shared<const string>(encodeFrame(single ? MSG_TRANSACTION : MSG_DELTA, lines)));
+        frames++;
+    }
+}
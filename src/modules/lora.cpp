@@ -1,114 +1,490 @@
 #include <vector>
 #include <cstdint>
 #include <cstring>
-#include <map>
+#include <random>
+#include <bitset>
 #include <chrono>
 #include <thread>
 #include <string>
 #include <iostream>
+#include <algorithm>
 #include "sx126x.h"
+#include "radio.h"
 #include "lora.h"
+#include "codec.h"
+#include "mesh.h"
+#include "network.h"
 
 // GLOBAL VARIABLES
 
-static constexpr auto AIRTIME         = std::chrono::milliseconds(400);
-static constexpr auto MARGIN          = std::chrono::milliseconds(50);
-static constexpr auto PACKET_INTERVAL = AIRTIME + MARGIN; // ~450 ms
-static constexpr auto MSG_TIMEOUT     = 5000; // 5s, considering max 10packets per message
+// Link timing, in radio time
+static constexpr auto NACK_QUIET      = std::chrono::milliseconds(2000);  // silence before asking for missing fragments
+static constexpr auto MSG_TIMEOUT     = std::chrono::milliseconds(60000); // partial messages are dropped after this
+static constexpr auto SERVICE_TICK    = std::chrono::milliseconds(100);
+static constexpr int  NACK_ROUNDS     = 3;
+static constexpr auto ADR_INTERVAL    = std::chrono::milliseconds(10000);  // between rate evaluations
+static constexpr auto ADR_ACK_WAIT    = std::chrono::milliseconds(5000);   // for every neighbour to answer a proposal
+static constexpr auto HELLO_INTERVAL  = std::chrono::milliseconds(30000);  // beacon after this long without sending
+static constexpr auto ADR_SILENCE     = std::chrono::milliseconds(120000); // hearing nobody this long means lost contact
+static constexpr int  ADR_MAX_BACKOFF = 4;  // unanswered proposals stretch the interval up to 16x
 
+static constexpr size_t MAX_ASSEMBLIES     = 16;
+static constexpr size_t MAX_ASSEMBLY_BYTES = 64 * 1024;
+static constexpr size_t SEND_WINDOW        = 8;  // sent messages kept for retransmission
+static constexpr size_t MAX_INBOX          = 64; // completed messages waiting for receive()
+static constexpr size_t SYNC_FRAME_PACKETS = 3;  // fragments a Tangle sync frame may span
 
+static uint8_t frequencyOffset(int freq) {
+    return static_cast<uint8_t>(freq > 850 ? freq - 850 : freq - 410);
+}
+
+// -------------------- LoraLink --------------------
+
+LoraLink::LoraLink(LoraRadio& radio)
+    : radio(radio),
+      reassembler(MAX_ASSEMBLIES, MAX_ASSEMBLY_BYTES),
+      window(SEND_WINDOW),
+      nextMessageId(static_cast<uint16_t>(std::random_device{}())),
+      nackRounds(NACK_ROUNDS),
+      erasureCoding(true),
+      adaptiveRate(false),
+      nextProposal(0),
+      failedProposals(0),
+      rateChangedAt(std::chrono::steady_clock::now()),
+      running(true) {
+    service = std::thread(&LoraLink::serve, this);
+}
+
+LoraLink::~LoraLink() {
+    running = false;
+    service.join();
+}
+
+void LoraLink::setNackRounds(int rounds) {
+    nackRounds = rounds;
+}
+
+void LoraLink::setErasureCoding(bool enabled) {
+    erasureCoding = enabled;
+}
+
+void LoraLink::setAdaptiveRate(bool enabled) {
+    adaptiveRate = enabled;
+}
+
+LinkStats LoraLink::stats() const {
+    std::lock_guard<std::mutex> lock(linkMutex);
+    LinkStats out = counters;
+    out.reassembly = reassembler.stats();
+    out.lossEstimate = loss.rate();
+    return out;
+}
 
-static std::vector<std::vector<uint8_t>> preparePackets(const uint8_t* data, size_t length) {
-    uint16_t total = static_cast<uint16_t>((length + MAX_PAYLOAD - 1) / MAX_PAYLOAD);
-    static uint16_t nextMessageId = 0;
-    uint16_t msgId = nextMessageId++;
+std::chrono::steady_clock::duration LoraLink::radioTime(std::chrono::milliseconds duration) const {
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(duration / radio.speedup());
+}
 
+// Prefixes each fragment with the module's [dest_high, dest_low, freq_offset] addressing
+bool LoraLink::transmitFragments(const std::vector<std::vector<uint8_t>>& fragments, uint16_t dest,
+                                 TxPriority priority) {
+    {
+        std::lock_guard<std::mutex> lock(linkMutex);
+        lastTransmit = std::chrono::steady_clock::now();
+    }
+    uint8_t channel = frequencyOffset(radio.config().freq);
     std::vector<std::vector<uint8_t>> packets;
-    packets.reserve(total);
-
-    size_t offset = 0;
-    for (uint16_t pid = 0; pid < total; ++pid) {
-        size_t chunkSize = std::min(MAX_PAYLOAD, length - offset);
-
-        // high level headers
-        PacketHeader hdr{};
-        hdr.messageId = msgId;
-        hdr.packetId = pid;
-        hdr.totalPackets = (pid == 0 ? total : 0);
-        hdr.type = (pid == 0) ? PT_START : (pid + 1 == total ? PT_END : PT_MIDDLE);
-
-        std::vector<uint8_t> pkt(3 + sizeof(hdr) + chunkSize);
-        pkt.push_back(0x12); // dest addr high byte
-        pkt.push_back(0x34); // dest addr low byte
-        pkt.push_back(static_cast<uint8_t>(868-860)); // freq offset
-
-        std::memcpy(pkt.data(), &hdr, sizeof(hdr));
-        std::memcpy(pkt.data() + sizeof(hdr), data + offset, chunkSize);
+    packets.reserve(fragments.size());
+    for (const auto& fragment : fragments) {
+        std::vector<uint8_t> pkt;
+        pkt.reserve(3 + fragment.size());
+        pkt.push_back(static_cast<uint8_t>(dest >> 8));
+        pkt.push_back(static_cast<uint8_t>(dest & 0xFF));
+        pkt.push_back(channel);
+        pkt.insert(pkt.end(), fragment.begin(), fragment.end());
         packets.push_back(std::move(pkt));
-
-        offset += chunkSize;
     }
-    return packets;
+    return radio.transmit(std::move(packets), priority);
 }
 
-bool sendOverLora(std::string str) {
-    sx126x lora("/dev/ttyS0", 868, 0x1234, 22, false, 2400, 0, 240, 0, false, false, false);
+bool LoraLink::send(const std::vector<uint8_t>& message, uint16_t dest, TxPriority priority) {
+    std::vector<std::vector<uint8_t>> fragments;
+    {
+        std::lock_guard<std::mutex> lock(linkMutex);
+        if (erasureCoding) {
+            fragments = fragmentCoded(nextMessageId, message.data(), message.size(), MAX_PAYLOAD, loss.rate());
+            if (!fragments.empty()) {
+                counters.parityFragments += fragments.size() - (message.size() + MAX_PAYLOAD - 1) / MAX_PAYLOAD;
+            }
+        }
+        if (fragments.empty()) {
+            fragments = fragmentMessage(nextMessageId, message.data(), message.size(), MAX_PAYLOAD);
+        }
+        if (fragments.empty()) {
+            std::cerr << "[ERROR] Message of " << message.size() << " bytes is too large for LoRa" << std::endl;
+            return false;
+        }
+        window.store(nextMessageId++, fragments);
+        counters.messagesSent++;
+        counters.fragmentsSent += fragments.size();
+        loss.sent(fragments.size());
+    }
+    return transmitFragments(fragments, dest, priority);
+}
 
-    std::vector<uint8_t> message(str.begin(), str.end());
+bool LoraLink::receive(std::vector<uint8_t>& message, std::chrono::milliseconds timeout) {
+    uint16_t src;
+    return receive(message, src, timeout);
+}
 
-    auto packets = preparePackets(message.data(), message.size());
-    for (auto& pkt : packets) {
-        lora.send(pkt);
-        std::this_thread::sleep_for(PACKET_INTERVAL);
+bool LoraLink::receive(std::vector<uint8_t>& message, uint16_t& src, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(linkMutex);
+    if (!inboxReady.wait_for(lock, timeout, [this] { return !inbox.empty(); })) {
+        return false;
     }
+    src = inbox.front().src;
+    message = std::move(inbox.front().message);
+    inbox.pop_front();
     return true;
 }
 
-bool receiveOverLora() {
-    sx126x lora("/dev/ttyS0", 868, 0x1234, 22, false, 2400, 0, 240, 0, false, false, false);
-    using Clock = std::chrono::steady_clock;
-    auto startTime = Clock::now();
-    uint32_t timeoutMs = 5000;
-
-    struct Assembly {
-        uint16_t total = 0;
-        std::map<uint16_t, std::vector<uint8_t>> parts;
-    };
-    std::map<uint16_t, Assembly> buffers;
-    std::vector<uint8_t> outMessage;
-
-    while (true) {
-        std::string raw = lora.receive();
-        if (raw.size() <= sizeof(PacketHeader)) {
-        } else {
-            PacketHeader hdr;
-            std::memcpy(&hdr, raw.data(), sizeof(hdr));
-            size_t payloadLen = raw.size() - sizeof(hdr);
-            const uint8_t* payload = reinterpret_cast<const uint8_t*>(raw.data() + sizeof(hdr));
-
-            auto& assembly = buffers[hdr.messageId];
-            if (hdr.type == PT_START) {
-                assembly.total = hdr.totalPackets;
-            }
-            assembly.parts[hdr.packetId] = std::vector<uint8_t>(payload, payload + payloadLen);
+void LoraLink::handlePacket(const LoraPacket& packet) {
+    const std::vector<uint8_t>& data = packet.payload;
+    if (data.empty()) {
+        return;
+    }
+    if (adaptiveRate) {
+        std::lock_guard<std::mutex> lock(linkMutex);
+        links.observe(packet.src, packet.rssi, std::chrono::steady_clock::now());
+    }
 
-            if (assembly.total > 0 && assembly.parts.size() == assembly.total) {
-                outMessage.clear();
-                for (uint16_t i = 0; i < assembly.total; ++i) {
-                    auto& chunk = assembly.parts[i];
-                    outMessage.insert(outMessage.end(), chunk.begin(), chunk.end());
-                }
+    if (data[0] == PT_RATE) {
+        if (adaptiveRate) {
+            handleRate(packet);
+        }
+        return;
+    }
 
-                for(size_t i = 0; i < outMessage.size(); i++){
-                    std::cout << outMessage[i];
+    if (data[0] == PT_NACK) {
+        Nack nack;
+        if (!decodeNack(data.data(), data.size(), nack) || nack.origin != radio.config().addr) {
+            return; // malformed, or asks another node for its message
+        }
+        std::vector<std::vector<uint8_t>> resend;
+        {
+            std::lock_guard<std::mutex> lock(linkMutex);
+            counters.nacksReceived++;
+            if (window.firstNack(nack)) {
+                size_t missing = 0;
+                for (uint8_t bits : nack.missing) {
+                    missing += std::bitset<8>(bits).count();
                 }
-                std::cout << std::endl;
-                return true;
+                loss.lost(missing);
+                counters.fragmentsLost += missing;
             }
+            resend = window.missing(nack, loss.rate());
+            counters.fragmentsRetransmitted += resend.size();
+        }
+        if (!resend.empty()) {
+            transmitFragments(resend, packet.src, TxPriority::Control);
+        }
+        return;
+    }
+
+    std::vector<uint8_t> message;
+    std::lock_guard<std::mutex> lock(linkMutex);
+    if (reassembler.add(packet.src, data.data(), data.size(), message, std::chrono::steady_clock::now())) {
+        if (inbox.size() >= MAX_INBOX) {
+            inbox.pop_front();
         }
-        if (std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - startTime).count() > timeoutMs) {
+        inbox.push_back({packet.src, std::move(message)});
+        counters.messagesReceived++;
+        inboxReady.notify_all();
+    }
+}
+
+// NACK_QUIET, or a few fragments' airtime at slow air speeds, so a NACK does not land mid-stream
+std::chrono::milliseconds LoraLink::nackQuiet() const {
+    double fragment = sx126x::air_time(3 + sizeof(CodedHeader) + MAX_PAYLOAD, radio.config().airSpeed);
+    return std::max(NACK_QUIET, std::chrono::milliseconds(static_cast<int>(3000 * fragment)));
+}
+
+// Asks the senders of stalled messages for exactly the fragments still missing
+void LoraLink::sendNacks() {
+    std::vector<Nack> nacks;
+    {
+        std::lock_guard<std::mutex> lock(linkMutex);
+        auto now = std::chrono::steady_clock::now();
+        reassembler.expire(now, radioTime(MSG_TIMEOUT));
+        nacks = reassembler.stalled(now, radioTime(nackQuiet()), nackRounds);
+        counters.nacksSent += nacks.size();
+    }
+    for (const auto& nack : nacks) {
+        transmitFragments({encodeNack(nack)}, nack.origin, TxPriority::Control);
+    }
+}
+
+// -------------------- Adaptive rate --------------------
+
+void LoraLink::sendRate(RatePhase phase, uint8_t id, int airSpeed, int power, uint16_t dest, int copies) {
+    RateHeader hdr{PT_RATE, id, phase, static_cast<uint16_t>(airSpeed), static_cast<int8_t>(power)};
+    std::vector<uint8_t> packet(sizeof(hdr));
+    std::memcpy(packet.data(), &hdr, sizeof(hdr));
+    transmitFragments(std::vector<std::vector<uint8_t>>(copies, packet), dest, TxPriority::Control);
+}
+
+// Takes effect once the radio has finished sending what is already on the module
+void LoraLink::switchRate(int airSpeed, int power) {
+    RadioConfig config = radio.config();
+    if (config.airSpeed == airSpeed && config.power == power) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(linkMutex);
+        links.shift(power - config.power); // neighbours switch power with us
+        rateChangedAt = std::chrono::steady_clock::now();
+        counters.rateChanges++;
+    }
+    config.airSpeed = airSpeed;
+    config.power = power;
+    radio.configure(config);
+    std::cout << "[LOG] LoRa air speed " << airSpeed << " bps, power " << power << " dBm" << std::endl;
+}
+
+void LoraLink::handleRate(const LoraPacket& packet) {
+    RateHeader hdr;
+    if (packet.payload.size() < sizeof(hdr)) {
+        return;
+    }
+    std::memcpy(&hdr, packet.payload.data(), sizeof(hdr));
+    int airSpeed = hdr.airSpeed;
+    int power = hdr.power;
+    RadioConfig current = radio.config();
+
+    switch (hdr.phase) {
+    case RATE_PROPOSE: {
+        bool accept;
+        {
+            std::lock_guard<std::mutex> lock(linkMutex);
+            if (proposal.active && packet.src > current.addr) {
+                accept = false; // our own proposal goes first
+            } else {
+                proposal.active = false;
+                accept = adr.acceptable(links, packet.src, airSpeed, power, current.airSpeed, current.power);
+            }
+        }
+        sendRate(accept ? RATE_ACK : RATE_REJECT, hdr.proposal, airSpeed, power, packet.src);
+        if (accept) {
+            radio.holdTraffic(ADR_ACK_WAIT); // listen for the commit
+        }
+        break;
+    }
+    case RATE_ACK:
+    case RATE_REJECT: {
+        std::lock_guard<std::mutex> lock(linkMutex);
+        if (!proposal.active || hdr.proposal != proposal.id) {
+            return; // an answer to a proposal already settled
+        }
+        if (hdr.phase == RATE_REJECT) {
+            proposal.active = false;
+            std::cout << "[LOG] Node " << packet.src << " rejected " << airSpeed << " bps" << std::endl;
+            return;
+        }
+        proposal.waiting.erase(std::remove(proposal.waiting.begin(), proposal.waiting.end(), packet.src),
+                               proposal.waiting.end());
+        break;
+    }
+    case RATE_COMMIT:
+        switchRate(airSpeed, power);
+        radio.holdTraffic(std::chrono::milliseconds(0));
+        sendRate(RATE_HELLO, 0, airSpeed, power, LORA_BROADCAST); // tells the proposer we made it
+        break;
+    default:
+        break; // a hello only feeds the link table
+    }
+}
+
+// Proposes a new rate when the link table calls for one, commits it once every neighbour has acked,
+// undoes it if nobody is heard at the new rate, falls back when cut off, and beacons when quiet.
+// Proposals go out just after a packet was heard: a neighbour streaming fragments is deaf while on
+// the air, and listens only while the next one crosses its UART.
+void LoraLink::adaptRate(bool heard) {
+    if (!adaptiveRate) {
+        return;
+    }
+    enum { NONE, PROPOSE, COMMIT, CONFIRMED, ABANDON, REVERT, FALLBACK } action = NONE;
+    RateProposal next;
+    bool hello;
+    RadioConfig current = radio.config();
+    int noise = radio.noiseFloor();
+    {
+        std::lock_guard<std::mutex> lock(linkMutex);
+        auto now = std::chrono::steady_clock::now();
+        links.setNoise(noise);
+        if (proposal.active) {
+            if (proposal.waiting.empty()) {
+                proposal.active = false;
+                proposal.previousAirSpeed = current.airSpeed;
+                proposal.previousPower = current.power;
+                proposal.probation = true;
+                failedProposals = 0;
+                next = proposal;
+                action = COMMIT;
+            } else if (now - proposal.sentAt > radioTime(ADR_ACK_WAIT)) {
+                proposal.active = false;
+                failedProposals++;
+                nextEvaluation = now + radioTime(ADR_INTERVAL) * (1 << std::min(failedProposals, ADR_MAX_BACKOFF));
+                action = ABANDON;
+            }
+        } else if (proposal.probation && links.lastHeard() > rateChangedAt) {
+            proposal.probation = false; // a neighbour answered at the new rate
+            action = CONFIRMED;
+        } else if (proposal.probation && now - rateChangedAt > radioTime(ADR_ACK_WAIT) * 2) {
+            proposal.probation = false;
+            next = proposal;
+            action = REVERT;
+        } else if ((current.airSpeed != BASE_AIR_SPEED || current.power != BASE_POWER) &&
+                   now - std::max(links.lastHeard(), rateChangedAt) > radioTime(ADR_SILENCE)) {
+            action = FALLBACK;
+        } else if (heard && now >= nextEvaluation) {
+            // Evaluated once there is someone to measure, then every ADR_INTERVAL
+            std::vector<uint16_t> neighbours = links.active(now, radioTime(ADR_SILENCE), 1);
+            int airSpeed, power;
+            if (!neighbours.empty()) {
+                nextEvaluation = now + radioTime(ADR_INTERVAL);
+                adr.updateLoss(loss.rate());
+            }
+            if (adr.choose(links, neighbours, current.airSpeed, current.power, airSpeed, power)) {
+                proposal.id = nextProposal++;
+                proposal.airSpeed = airSpeed;
+                proposal.power = power;
+                proposal.waiting = neighbours;
+                proposal.sentAt = now;
+                proposal.active = true;
+                next = proposal;
+                action = PROPOSE;
+            }
+        }
+        hello = action == NONE && now - lastTransmit > radioTime(HELLO_INTERVAL);
+    }
+
+    switch (action) {
+    case PROPOSE:
+        // Our own traffic waits so the answers are heard
+        radio.holdTraffic(ADR_ACK_WAIT);
+        sendRate(RATE_PROPOSE, next.id, next.airSpeed, next.power, LORA_BROADCAST);
+        break;
+    case COMMIT:
+        sendRate(RATE_COMMIT, next.id, next.airSpeed, next.power, LORA_BROADCAST, 2); // one may be lost
+        switchRate(next.airSpeed, next.power);
+        radio.holdTraffic(ADR_ACK_WAIT * 2); // listen for a neighbour at the new rate
+        break;
+    case CONFIRMED:
+        radio.holdTraffic(std::chrono::milliseconds(0));
+        break;
+    case ABANDON:
+        std::cout << "[LOG] Rate proposal " << int(next.id) << " unanswered" << std::endl;
+        radio.holdTraffic(std::chrono::milliseconds(0));
+        break;
+    case REVERT:
+        std::cout << "[LOG] Nobody heard at " << next.airSpeed << " bps, reverting" << std::endl;
+        switchRate(next.previousAirSpeed, next.previousPower);
+        radio.holdTraffic(std::chrono::milliseconds(0));
+        break;
+    case FALLBACK:
+        std::cout << "[LOG] No neighbours heard, falling back to " << BASE_AIR_SPEED << " bps" << std::endl;
+        switchRate(BASE_AIR_SPEED, BASE_POWER);
+        break;
+    default:
+        if (hello) {
+            sendRate(RATE_HELLO, 0, current.airSpeed, current.power, LORA_BROADCAST);
+        }
+        break;
+    }
+}
+
+void LoraLink::serve() {
+    while (running) {
+        LoraPacket packet;
+        bool heard = radio.receive(packet, std::chrono::duration_cast<std::chrono::milliseconds>(
+                                               radioTime(SERVICE_TICK)) + std::chrono::milliseconds(1));
+        if (heard) {
+            handlePacket(packet);
+        }
+        sendNacks();
+        adaptRate(heard);
+    }
+}
+
+LoraLink& loraLink() {
+    static LoraLink& link = [] () -> LoraLink& {
+        LoraRadio& radio = LoraRadio::instance();
+        RadioConfig config = radio.config();
+        config.rssi = true; // packet RSSI drives the air speed
+        radio.configure(config);
+        static LoraLink shared(radio);
+        shared.setAdaptiveRate(true);
+        return shared;
+    }();
+    return link;
+}
+
+bool sendOverLora(std::string str) {
+    std::vector<uint8_t> message(str.begin(), str.end());
+    return loraMesh().send(message);
+}
+
+std::vector<std::vector<uint8_t>> encodeTransactionsForLora(const Tangle& tangle) {
+    std::vector<const Transaction*> txs;
+    txs.reserve(tangle.transactions().size());
+    for (const auto& pair : tangle.transactions()) {
+        txs.push_back(&pair.second);
+    }
+
+    // A signed transaction does not fit one packet: its two signatures, nonce and PoW alone take
+    // about 180 bytes, and it is some 290 bytes in all. Every frame spans SYNC_FRAME_PACKETS
+    // fragments, mesh header included, which holds two signed transactions, the second sending its
+    // keys as dictionary references. Three packets then carry two transactions instead of two
+    // packets carrying one, and a lost frame still costs only the transactions inside it
+    return encodeCompact(txs, SYNC_FRAME_PACKETS * MAX_PAYLOAD - sizeof(MeshHeader));
+}
+
+bool sendEncodedOverLora(const std::vector<std::vector<uint8_t>>& messages) {
+    std::cout << "[LOG] Sending " << messages.size() << " compact LoRa frames" << std::endl;
+    bool sent = true;
+    for (const auto& message : messages) {
+        sent = loraMesh().send(message, LORA_BROADCAST, TxPriority::Bulk) && sent;
+    }
+    return sent;
+}
+
+bool receiveOverLora(Tangle& tangle) {
+    MeshMessage delivered;
+    if (!loraMesh().receive(delivered, std::chrono::milliseconds(5000))) {
+        return false;
+    }
+    std::vector<uint8_t>& outMessage = delivered.payload;
+
+    if (!outMessage.empty() && outMessage[0] == COMPACT_MAGIC) {
+        std::vector<Transaction> received;
+        if (!decodeCompact(outMessage.data(), outMessage.size(), received)) {
+            std::cerr << "[ERROR] Malformed compact LoRa message" << std::endl;
             return false;
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        dropUnverified(received, tangle, "LoRa node " + std::to_string(delivered.origin));
+        std::lock_guard<std::mutex> lock(tangleMutex);
+        for (const auto& tx : received) {
+            // Known ids are kept as they are: what arrives can only repeat them or contradict them
+            if (tangle.transactions().find(tx.transaction_id) == tangle.transactions().end()) {
+                tangle.addTransaction(tx);
+            }
+        }
+        std::cout << "[LOG] Received " << received.size() << " transactions over LoRa" << std::endl;
+        return true;
     }
+
+    for(size_t i = 0; i < outMessage.size(); i++){
+        std::cout << outMessage[i];
+    }
+    std::cout << std::endl;
+    return true;
 }
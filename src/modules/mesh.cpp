@@ -0,0 +1,524 @@
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include "mesh.h"
+
+// Mesh timing, in radio time
+static constexpr auto ROUTE_INTERVAL  = std::chrono::milliseconds(120000); // between routine advertisements
+static constexpr auto ROUTE_TIMEOUT   = std::chrono::milliseconds(400000); // routes not refreshed this long are gone
+static constexpr auto TRIGGER_HOLDOFF = std::chrono::milliseconds(20000);  // least time between advertisements
+static constexpr auto ROUTE_WAIT      = std::chrono::milliseconds(15000);  // a queued message waits this long for a route
+static constexpr int  FLOOD_JITTER_MS = 2000; // floods are repeated after up to this long, a few airtimes
+static constexpr auto ACK_WAIT        = std::chrono::milliseconds(3000);   // beyond the message's own airtime
+static constexpr int  MAX_ATTEMPTS    = 3;  // sends to a next hop before the message is flooded instead
+static constexpr auto SERVICE_TICK    = std::chrono::milliseconds(100);
+
+static constexpr size_t MAX_QUEUE  = 32;  // messages held for forwarding
+static constexpr size_t MAX_RECENT = 512; // origin and sequence pairs remembered against duplicates
+static constexpr size_t MAX_INBOX  = 64;
+// Advertisements fit one fragment
+static constexpr size_t MAX_ADVERTISED = (MAX_PAYLOAD - sizeof(MeshHeader)) / sizeof(RouteEntry);
+
+// -------------------- RouteTable --------------------
+
+RouteTable::RouteTable(uint16_t self) : self(self) {}
+
+void RouteTable::heard(uint16_t src, Clock::time_point now) {
+    auto it = links.find(src);
+    if (it != links.end()) {
+        it->second.lastHeard = now;
+    }
+}
+
+uint8_t RouteTable::linkCost(const Link& link) {
+    uint8_t window = static_cast<uint8_t>((1u << link.samples) - 1);
+    double delivery = double(std::bitset<8>(link.history & window).count()) / link.samples;
+    return static_cast<uint8_t>(std::min(255.0, std::round(MESH_LINK_COST / (delivery * delivery))));
+}
+
+bool RouteTable::dropVia(uint16_t neighbour) {
+    bool dropped = false;
+    for (auto it = routes.begin(); it != routes.end();) {
+        if (it->second.nextHop == neighbour) {
+            it = routes.erase(it);
+            dropped = true;
+        } else {
+            ++it;
+        }
+    }
+    return dropped;
+}
+
+bool RouteTable::merge(uint16_t neighbour, uint16_t seq, const std::vector<RouteEntry>& entries,
+                       Clock::time_point now) {
+    if (neighbour == self) {
+        return false;
+    }
+    std::unordered_set<uint16_t>& theirs = reach[neighbour];
+    theirs.clear();
+    for (const RouteEntry& e : entries) {
+        if (e.hops == 1) {
+            theirs.insert(e.dest);
+        }
+    }
+
+    // Shift the advertisements missed since the last one into the history
+    auto found = links.find(neighbour);
+    Link& link = links[neighbour];
+    if (found == links.end()) {
+        link.history = 1;
+        link.samples = 1;
+    } else {
+        uint16_t gap = static_cast<uint16_t>(seq - link.lastSeq);
+        if (gap == 0) {
+            return false; // a copy
+        }
+        link.history = gap >= 8 ? 1 : static_cast<uint8_t>(link.history << gap | 1);
+        link.samples = std::min<int>(8, link.samples + gap);
+    }
+    link.lastSeq = seq;
+    link.lastHeard = now;
+    size_t heard = std::bitset<4>(link.history).count();
+    if (heard >= 3) {
+        link.up = true;
+    } else if (heard < 2) {
+        link.up = false;
+    }
+    if (!link.up) {
+        return dropVia(neighbour);
+    }
+
+    bool changed = false;
+    int cost = linkCost(link);
+    std::unordered_set<uint16_t> offered;
+    // Cheaper, or news from the neighbour we already go through
+    auto offer = [&](uint16_t dest, int hops, int total) {
+        if (hops > MESH_MAX_HOPS || total > MESH_MAX_COST) {
+            return;
+        }
+        offered.insert(dest);
+        auto it = routes.find(dest);
+        if (it == routes.end() || total < it->second.cost || it->second.nextHop == neighbour) {
+            changed |= it == routes.end();
+            routes[dest] = {neighbour, static_cast<uint8_t>(hops), static_cast<uint8_t>(total), now};
+        }
+    };
+    offer(neighbour, 1, cost);
+    for (const RouteEntry& e : entries) {
+        // Split horizon: a route through us is no route for us
+        if (e.dest != self && e.dest != neighbour && e.nextHop != self) {
+            offer(e.dest, e.hops + 1, e.cost + cost);
+        }
+    }
+    // The neighbour lost the routes it no longer offers
+    for (auto it = routes.begin(); it != routes.end();) {
+        if (it->second.nextHop == neighbour && !offered.count(it->first)) {
+            it = routes.erase(it);
+            changed = true;
+        } else {
+            ++it;
+        }
+    }
+    return changed;
+}
+
+bool RouteTable::expire(Clock::time_point now, Clock::duration timeout) {
+    bool changed = false;
+    for (auto it = links.begin(); it != links.end();) {
+        if (now - it->second.lastHeard > timeout) {
+            reach.erase(it->first);
+            it = links.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto it = routes.begin(); it != routes.end();) {
+        auto via = links.find(it->second.nextHop);
+        if (now - it->second.updated > timeout || via == links.end() || !via->second.up) {
+            it = routes.erase(it);
+            changed = true;
+        } else {
+            ++it;
+        }
+    }
+    return changed;
+}
+
+bool RouteTable::nextHop(uint16_t dest, uint16_t& hop) const {
+    auto it = routes.find(dest);
+    if (it == routes.end()) {
+        return false;
+    }
+    hop = it->second.nextHop;
+    return true;
+}
+
+// Self-pruning flood: the sender's neighbours already heard it, so only a node with others repeats it
+bool RouteTable::extendsFlood(uint16_t from, uint16_t origin) const {
+    auto theirs = reach.find(from);
+    for (const auto& [addr, link] : links) {
+        if (!link.up || addr == from || addr == origin) {
+            continue;
+        }
+        if (theirs == reach.end() || !theirs->second.count(addr)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<RouteEntry> RouteTable::advertisement(size_t maxEntries) const {
+    std::vector<RouteEntry> out;
+    out.reserve(routes.size());
+    for (const auto& [dest, route] : routes) {
+        out.push_back({dest, route.nextHop, route.hops, route.cost});
+    }
+    std::sort(out.begin(), out.end(), [](const RouteEntry& a, const RouteEntry& b) { return a.cost < b.cost; });
+    if (out.size() > maxEntries) {
+        out.resize(maxEntries);
+    }
+    return out;
+}
+
+size_t RouteTable::neighbours() const {
+    return std::count_if(links.begin(), links.end(), [](const auto& l) { return l.second.up; });
+}
+
+// -------------------- LoraMesh --------------------
+
+static TxPriority priorityOf(uint8_t flags) {
+    return static_cast<TxPriority>((flags & MESH_PRIORITY_MASK) >> MESH_PRIORITY_SHIFT);
+}
+
+LoraMesh::LoraMesh(LoraLink& link, LoraRadio& radio)
+    : link(link),
+      radio(radio),
+      self(radio.config().addr),
+      routing(true),
+      table(radio.config().addr),
+      nextSeq(static_cast<uint16_t>(std::random_device{}())),
+      nextAdvertisementSeq(0),
+      rng(std::random_device{}()),
+      running(true) {
+    // First advertisement soon, at a random moment so neighbours started together do not collide
+    auto now = std::chrono::steady_clock::now();
+    nextAdvertisement = now + radioTime(std::chrono::milliseconds(std::uniform_int_distribution<int>(0, 5000)(rng)));
+    service = std::thread(&LoraMesh::serve, this);
+}
+
+LoraMesh::~LoraMesh() {
+    running = false;
+    service.join();
+}
+
+void LoraMesh::setRouting(bool enabled) {
+    routing = enabled;
+}
+
+MeshStats LoraMesh::stats() const {
+    std::lock_guard<std::mutex> lock(meshMutex);
+    MeshStats out = counters;
+    out.neighbours = table.neighbours();
+    out.routes = table.size();
+    return out;
+}
+
+std::chrono::steady_clock::duration LoraMesh::radioTime(std::chrono::milliseconds duration) const {
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(duration / radio.speedup());
+}
+
+// ACK_WAIT plus twice the message's airtime, room for the link to recover a lost fragment
+std::chrono::milliseconds LoraMesh::ackWait(size_t bytes) const {
+    size_t fragments = (bytes + MAX_PAYLOAD - 1) / MAX_PAYLOAD;
+    double airtime = sx126x::air_time(bytes + fragments * (3 + sizeof(CodedHeader)), radio.config().airSpeed);
+    return ACK_WAIT + std::chrono::milliseconds(static_cast<int>(2000 * airtime));
+}
+
+bool LoraMesh::seen(uint16_t origin, uint16_t seq) {
+    uint32_t key = static_cast<uint32_t>(origin) << 16 | seq;
+    if (!recent.insert(key).second) {
+        return true;
+    }
+    recentOrder.push_back(key);
+    if (recentOrder.size() > MAX_RECENT) {
+        recent.erase(recentOrder.front());
+        recentOrder.pop_front();
+    }
+    return false;
+}
+
+bool LoraMesh::send(const std::vector<uint8_t>& message, uint16_t dest, TxPriority priority) {
+    MeshHeader hdr{};
+    hdr.magic = MESH_MAGIC;
+    hdr.kind = MESH_DATA;
+    hdr.flags = static_cast<uint8_t>(static_cast<int>(priority) << MESH_PRIORITY_SHIFT);
+    hdr.origin = self;
+    hdr.dest = dest;
+    hdr.ttl = MESH_MAX_HOPS;
+    hdr.hops = 0;
+    bool flooded = dest == LORA_BROADCAST || !routing;
+    if (flooded) {
+        hdr.flags |= MESH_FLOODED;
+    }
+
+    std::vector<uint8_t> packet(sizeof(hdr));
+    {
+        std::lock_guard<std::mutex> lock(meshMutex);
+        hdr.seq = nextSeq++;
+        seen(self, hdr.seq); // our own flood coming back is a duplicate
+        std::memcpy(packet.data(), &hdr, sizeof(hdr));
+        packet.insert(packet.end(), message.begin(), message.end());
+        counters.originated++;
+        if (!flooded) {
+            // Routed messages wait in the queue for their ack
+            enqueue(std::move(packet), std::chrono::steady_clock::duration::zero());
+            return true;
+        }
+        counters.flooded++;
+    }
+    return link.send(packet, LORA_BROADCAST, priority);
+}
+
+bool LoraMesh::receive(MeshMessage& message, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(meshMutex);
+    if (!inboxReady.wait_for(lock, timeout, [this] { return !inbox.empty(); })) {
+        return false;
+    }
+    message = std::move(inbox.front());
+    inbox.pop_front();
+    return true;
+}
+
+void LoraMesh::enqueue(std::vector<uint8_t> message, std::chrono::steady_clock::duration delay) {
+    if (queue.size() >= MAX_QUEUE) {
+        queue.pop_front();
+        counters.dropped++;
+    }
+    auto now = std::chrono::steady_clock::now();
+    queue.push_back({std::move(message), now, now + delay});
+}
+
+// Queued for `delay`, ackDelay() of the message acked
+void LoraMesh::queueAck(const MeshHeader& data, uint16_t to, std::chrono::steady_clock::duration delay) {
+    MeshHeader hdr{MESH_MAGIC, MESH_ACK, 0, data.origin, to, data.seq, 1, 0};
+    std::vector<uint8_t> ack(sizeof(hdr));
+    std::memcpy(ack.data(), &hdr, sizeof(hdr));
+    enqueue(std::move(ack), delay);
+}
+
+// A message may be decoded before its sender has finished sending the parity, and the sender
+// hears nothing until then
+std::chrono::steady_clock::duration LoraMesh::ackDelay(size_t bytes) const {
+    size_t fragment = 3 + sizeof(CodedHeader) + std::min(bytes, MAX_PAYLOAD);
+    double airtime = sx126x::air_time(fragment, radio.config().airSpeed);
+    return radioTime(std::chrono::milliseconds(static_cast<int>(1000 * airtime)));
+}
+
+void LoraMesh::handleMessage(uint16_t src, const std::vector<uint8_t>& message) {
+    MeshHeader hdr;
+    {
+        std::lock_guard<std::mutex> lock(meshMutex);
+        auto now = std::chrono::steady_clock::now();
+        if (message.size() < sizeof(hdr) || message[0] != MESH_MAGIC) {
+            // From a node without the mesh layer: one hop, as before
+            if (inbox.size() >= MAX_INBOX) {
+                inbox.pop_front();
+            }
+            inbox.push_back({src, 1, message});
+            counters.delivered++;
+            inboxReady.notify_all();
+            return;
+        }
+        std::memcpy(&hdr, message.data(), sizeof(hdr));
+        table.heard(src, now);
+
+        bool changed = false;
+        if (hdr.kind == MESH_ROUTES) {
+            if (routing) {
+                std::vector<RouteEntry> entries((message.size() - sizeof(hdr)) / sizeof(RouteEntry));
+                std::memcpy(entries.data(), message.data() + sizeof(hdr), entries.size() * sizeof(RouteEntry));
+                changed = table.merge(src, hdr.seq, entries, now);
+            }
+        } else if (hdr.kind == MESH_ACK) {
+            for (auto it = queue.begin(); it != queue.end(); ++it) {
+                MeshHeader sent;
+                std::memcpy(&sent, it->message.data(), sizeof(sent));
+                if (it->attempts > 0 && sent.origin == hdr.origin && sent.seq == hdr.seq) {
+                    queue.erase(it);
+                    break;
+                }
+            }
+        } else if (hdr.kind == MESH_DATA) {
+            // A routed message was addressed to us alone: ack it, again if the first ack was lost
+            bool acked = !(hdr.flags & MESH_FLOODED) && hdr.dest != LORA_BROADCAST;
+            auto delay = ackDelay(message.size());
+            if (acked) {
+                queueAck(hdr, src, delay);
+            }
+            if (seen(hdr.origin, hdr.seq)) {
+                counters.duplicates++;
+            } else {
+                if (hdr.dest == self || hdr.dest == LORA_BROADCAST) {
+                    if (inbox.size() >= MAX_INBOX) {
+                        inbox.pop_front();
+                    }
+                    inbox.push_back({hdr.origin, hdr.hops + 1,
+                                     std::vector<uint8_t>(message.begin() + sizeof(hdr), message.end())});
+                    counters.delivered++;
+                    inboxReady.notify_all();
+                }
+                uint16_t hop;
+                bool routed = routing && hdr.dest != LORA_BROADCAST && table.nextHop(hdr.dest, hop);
+                if (hdr.dest == self) {
+                    // arrived
+                } else if (hdr.ttl <= 1) {
+                    counters.expired++;
+                } else if ((hdr.flags & MESH_FLOODED) && routing && !routed &&
+                           !table.extendsFlood(src, hdr.origin)) {
+                    counters.suppressed++;
+                } else {
+                    // After our ack, which the next hop's own ack would collide with
+                    if (!acked) {
+                        delay = std::chrono::steady_clock::duration::zero();
+                    }
+                    if (routed) {
+                        hdr.flags &= ~MESH_FLOODED; // we know the way from here
+                    } else if (hdr.flags & MESH_FLOODED) {
+                        delay = radioTime(std::chrono::milliseconds(
+                            std::uniform_int_distribution<int>(0, FLOOD_JITTER_MS)(rng)));
+                    }
+                    MeshHeader next = hdr;
+                    next.ttl--;
+                    next.hops++;
+                    std::vector<uint8_t> forward(message);
+                    std::memcpy(forward.data(), &next, sizeof(next));
+                    enqueue(std::move(forward), delay);
+                }
+            }
+        }
+
+        // Tell the neighbours soon, but not more often than TRIGGER_HOLDOFF
+        if (changed) {
+            auto soon = std::max(lastAdvertisement + radioTime(TRIGGER_HOLDOFF),
+                                 now + radioTime(std::chrono::milliseconds(
+                                           std::uniform_int_distribution<int>(500, 2500)(rng))));
+            nextAdvertisement = std::min(nextAdvertisement, soon);
+        }
+    }
+}
+
+// Sends what is due: acks, floods, routed messages to their next hop (kept until acked and sent again when
+// the ack is late), and messages that waited ROUTE_WAIT for a route in vain, flooded
+void LoraMesh::flushQueue() {
+    std::vector<std::pair<uint16_t, std::vector<uint8_t>>> out; // link destination, message
+    {
+        std::lock_guard<std::mutex> lock(meshMutex);
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = queue.begin(); it != queue.end();) {
+            if (now < it->notBefore) {
+                ++it;
+                continue;
+            }
+            MeshHeader hdr;
+            std::memcpy(&hdr, it->message.data(), sizeof(hdr));
+            if (hdr.kind == MESH_ACK) {
+                out.push_back({hdr.dest, std::move(it->message)});
+                it = queue.erase(it);
+                continue;
+            }
+            uint16_t hop;
+            bool route = routing && !(hdr.flags & MESH_FLOODED) && table.nextHop(hdr.dest, hop);
+            if (route && it->attempts < MAX_ATTEMPTS) {
+                (it->attempts++ ? counters.retransmitted : counters.forwarded)++;
+                it->notBefore = std::chrono::steady_clock::time_point::max(); // until sent, below
+                out.push_back({hop, it->message});
+                ++it;
+                continue;
+            }
+            if (!(hdr.flags & MESH_FLOODED) && !it->attempts && routing &&
+                now - it->queuedAt <= radioTime(ROUTE_WAIT)) {
+                ++it;
+                continue; // no route yet
+            }
+            hdr.flags |= MESH_FLOODED;
+            std::memcpy(it->message.data(), &hdr, sizeof(hdr));
+            counters.flooded++;
+            out.push_back({LORA_BROADCAST, std::move(it->message)});
+            it = queue.erase(it);
+        }
+    }
+    for (auto& [dest, message] : out) {
+        MeshHeader hdr;
+        std::memcpy(&hdr, message.data(), sizeof(hdr));
+        link.send(message, dest, hdr.kind == MESH_ACK ? TxPriority::Control : priorityOf(hdr.flags));
+        if (hdr.kind != MESH_DATA || dest == LORA_BROADCAST) {
+            continue;
+        }
+        // The send returns once the message is on air, however long it queued behind others;
+        // only then does the wait for the ack start
+        std::lock_guard<std::mutex> lock(meshMutex);
+        auto now = std::chrono::steady_clock::now();
+        for (Pending& pending : queue) {
+            MeshHeader queued;
+            std::memcpy(&queued, pending.message.data(), sizeof(queued));
+            if (queued.kind == MESH_DATA && queued.origin == hdr.origin && queued.seq == hdr.seq &&
+                pending.notBefore == std::chrono::steady_clock::time_point::max()) {
+                pending.notBefore = now + radioTime(ackWait(message.size()));
+            }
+        }
+    }
+}
+
+void LoraMesh::advertise() {
+    std::vector<uint8_t> message;
+    {
+        std::lock_guard<std::mutex> lock(meshMutex);
+        auto now = std::chrono::steady_clock::now();
+        if (!routing || now < nextAdvertisement) {
+            return;
+        }
+        MeshHeader hdr{MESH_MAGIC, MESH_ROUTES, 0, self, LORA_BROADCAST, nextAdvertisementSeq++, 1, 0};
+        std::vector<RouteEntry> entries = table.advertisement(MAX_ADVERTISED);
+        message.resize(sizeof(hdr) + entries.size() * sizeof(RouteEntry));
+        std::memcpy(message.data(), &hdr, sizeof(hdr));
+        std::memcpy(message.data() + sizeof(hdr), entries.data(), entries.size() * sizeof(RouteEntry));
+        // Jittered so neighbours do not fall into step. The first few come quickly, since neighbours
+        // take a node for a link only once they have heard three.
+        auto jitter = std::chrono::milliseconds(std::uniform_int_distribution<int>(-2000, 2000)(rng));
+        nextAdvertisement = now + radioTime(counters.advertisements < 3 ? TRIGGER_HOLDOFF * 2 + jitter
+                                                                        : ROUTE_INTERVAL + jitter * 2);
+        lastAdvertisement = now;
+        counters.advertisements++;
+    }
+    link.send(message, LORA_BROADCAST, TxPriority::Interactive);
+}
+
+void LoraMesh::serve() {
+    while (running) {
+        std::vector<uint8_t> message;
+        uint16_t src;
+        if (link.receive(message, src, std::chrono::duration_cast<std::chrono::milliseconds>(
+                                           radioTime(SERVICE_TICK)) + std::chrono::milliseconds(1))) {
+            handleMessage(src, message);
+        }
+        {
+            std::lock_guard<std::mutex> lock(meshMutex);
+            if (routing && table.expire(std::chrono::steady_clock::now(), radioTime(ROUTE_TIMEOUT))) {
+                nextAdvertisement = std::min(nextAdvertisement, lastAdvertisement + radioTime(TRIGGER_HOLDOFF));
+            }
+        }
+        flushQueue();
+        advertise();
+    }
+}
+
+LoraMesh& loraMesh() {
+    static LoraMesh shared(loraLink(), LoraRadio::instance());
+    return shared;
+}
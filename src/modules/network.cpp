@@ -4,52 +4,52 @@
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <cstring>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <unistd.h>
-#include <openssl/sha.h>
-#include <sstream>
-#include <iomanip>
+#include <cerrno>
 #include <arpa/inet.h>
 #include <ctime>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <stdexcept>
+#include <deque>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <memory>
+#include <functional>
 #include <lora.h>
+#include "peer.h"
+#include "frame.h"
+#include "gossip.h"
+#include "transport.h"
+#include "signature.h"
 
 using namespace std;
 
-vector<string> knownNodes = {"192.168.29.95"}; // Example nodes
+static NetworkConfig networkConfig;
+static function<void(const Transaction &)> acceptedCallback;
 mutex tangleMutex;
-const int PORT = 8080;
 const int BUFFER_SIZE = 4096;
 const int MAX_RETRIES = 1; // Number of times to retry sending data
-
-// Computes SHA-256 checksum of the data
-string computeChecksum(const string &data)
-{
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256((unsigned char *)data.c_str(), data.size(), hash);
-
-    stringstream ss;
-    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++)
-    {
-        ss << hex << setw(2) << setfill('0') << (int)hash[i];
-    }
-    return ss.str();
-}
-
-// Verifies that the received data has a correct checksum
-bool verifyChecksum(const string &data, const string &receivedChecksum)
-{
-    string calculatedChecksum = computeChecksum(data);
-    return calculatedChecksum == receivedChecksum;
-}
+const int IO_THREADS = 2;                     // Event loops sharing the listening socket
+const int MAX_CONNECTIONS = 1024;             // Connections beyond this are refused at accept
+const int IDLE_TIMEOUT_MS = 60000;            // Peers silent for longer are dropped
+const size_t MAX_MESSAGE_BYTES = 16u << 20;   // Largest accepted frame payload
+const int ACK_TIMEOUT_MS = 10000;             // A snapshot not acked this long after its expected delivery failed
 
 void printLastTransaction(Tangle &tangle)
 {
     Transaction lastTx;
     string latestTimestamp = "0";
 
-    for (const auto &pair : tangle.transactions)
+    for (const auto &pair : tangle.transactions())
     {
         if (pair.second.timestamp > latestTimestamp)
         {
@@ -84,50 +84,427 @@ void printLastTransaction(Tangle &tangle)
     }
 }
 
-void handleTCPClient(int clientSocket, Tangle &tangle)
+void configureNetwork(const NetworkConfig &config)
+{
+    networkConfig = config;
+}
+
+void onTransactionAccepted(function<void(const Transaction &)> callback)
+{
+    acceptedCallback = move(callback);
+}
+
+// Per-peer TCP and LoRa route entries; TCP learns from snapshot acks, LoRa from send times
+static PathSelector pathSelector;
+
+// A snapshot sent over TCP and not acked yet
+struct AwaitedAck
 {
-    char buffer[BUFFER_SIZE] = {0};
-    int bytesRead;
-    string receivedData;
+    string ack; // payload of the ACK that answers it
+    size_t bytes;
+    chrono::steady_clock::time_point sentAt;
+    chrono::steady_clock::time_point deadline;
+};
+
+static mutex ackMutex;
+static unordered_map<string, deque<AwaitedAck>> awaitedAcks; // by node, oldest first
+
+// Measures the TCP path to a node when it acks a snapshot; the older ones were replaced in its queue
+static void onPeerFrame(const string &node, const Frame &frame)
+{
+    if (frame.type != MSG_ACK)
+        return;
+    lock_guard<mutex> lock(ackMutex);
+    deque<AwaitedAck> &awaited = awaitedAcks[node];
+    auto it = find_if(awaited.begin(), awaited.end(), [&](const AwaitedAck &a) { return a.ack == frame.payload; });
+    if (it == awaited.end())
+        return;
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - it->sentAt;
+    pathSelector.delivered(node, PathKind::Tcp, it->bytes, elapsed.count());
+    awaited.erase(awaited.begin(), it + 1);
+}
 
-    while ((bytesRead = read(clientSocket, buffer, BUFFER_SIZE)) > 0)
+// Fails the TCP path to every node that has acked nothing since its oldest snapshot was due
+static void expireAcks(chrono::steady_clock::time_point now)
+{
+    lock_guard<mutex> lock(ackMutex);
+    for (auto &[node, awaited] : awaitedAcks)
     {
-        receivedData.append(buffer, bytesRead);
+        if (!awaited.empty() && now >= awaited.front().deadline)
+        {
+            pathSelector.failed(node, PathKind::Tcp, now);
+            awaited.clear();
+        }
     }
+}
+
+// One long-lived connection per known node, started on first broadcast
+static PeerManager &peerManager()
+{
+    static PeerManager peers(networkConfig.nodes, networkConfig.port,
+                             networkConfig.bindAddress == "0.0.0.0" ? "" : networkConfig.bindAddress);
+    static once_flag started;
+    call_once(started, []()
+              {
+                  peers.setLinkProfile(networkConfig.link);
+                  peers.setFrameHandler(onPeerFrame);
+                  peers.start();
+              });
+    return peers;
+}
+
+PathState pathState(const string &node, PathKind kind)
+{
+    return pathSelector.state(node, kind);
+}
+
+static Gossip &gossip()
+{
+    static Gossip instance(peerManager(), networkConfig.fanout);
+    return instance;
+}
+
+GossipStats gossipStats()
+{
+    return gossip().stats();
+}
+
+ValidationCacheStats validationCacheStats()
+{
+    return SignatureVerifier::shared().cache()->stats();
+}
+
+// The batch is verified without tangleMutex held, so a large sync does not hold up everything else that
+// needs the Tangle
+void dropUnverified(vector<Transaction> &txs, const Tangle &tangle, const string &from)
+{
+    if (!networkConfig.requireSignatures || txs.empty())
+        return;
 
-    if (!receivedData.empty())
+    vector<const Transaction *> unknown;
+    {
+        lock_guard<mutex> lock(tangleMutex);
+        for (const auto &tx : txs)
+        {
+            if (tangle.transactions().find(tx.transaction_id) == tangle.transactions().end())
+                unknown.push_back(&tx);
+        }
+    }
+    vector<bool> valid = SignatureVerifier::shared().verify(unknown);
+
+    unordered_set<const Transaction *> rejected;
+    for (size_t i = 0; i < unknown.size(); i++)
+    {
+        if (!valid[i])
+            rejected.insert(unknown[i]);
+    }
+    if (rejected.empty())
+        return;
+    vector<Transaction> kept;
+    kept.reserve(txs.size() - rejected.size());
+    for (auto &tx : txs)
+    {
+        if (!rejected.count(&tx))
+            kept.push_back(move(tx));
+    }
+    txs = move(kept);
+    cerr << "[ERROR] Dropped " << rejected.size() << " transactions from " << from
+         << " without valid signatures" << endl;
+}
+
+// Merges gossiped transactions and forwards the ones this node had not seen
+static void acceptGossip(const string &payload, const string &from, Tangle &tangle)
+{
+    Gossip &g = gossip();
+    size_t fresh = 0;
+    auto received = Tangle::parseSerialized(payload);
+    dropUnverified(received, tangle, from);
+
+    lock_guard<mutex> lock(tangleMutex);
+    for (const auto &tx : received)
+    {
+        bool isNew = g.markSeen(tx.transaction_id) &&
+                     tangle.transactions().find(tx.transaction_id) == tangle.transactions().end();
+        g.recordArrival(!isNew);
+        if (!isNew)
+            continue;
+
+        tangle.addTransaction(tx);
+        if (acceptedCallback)
+            acceptedCallback(tx);
+        g.publish(tangle.serialize({tx.transaction_id}), from);
+        fresh++;
+    }
+    cout << "[LOG] Received " << received.size() << " gossiped transactions from " << from
+         << " (" << fresh << " new)" << endl;
+}
+
+// Applies one frame to the Tangle; anything to send back on the same connection goes into reply
+void handleFrame(const Frame &frame, const string &from, Tangle &tangle, string &reply)
+{
+    switch (frame.type)
+    {
+    case MSG_DELTA:
+    case MSG_TRANSACTION:
+        acceptGossip(frame.payload, from, tangle);
+        break;
+    case MSG_SNAPSHOT:
     {
         cout << "[LOG] Received Tangle update" << endl;
-        string receivedChecksum = receivedData.substr(receivedData.find_last_of(" ") + 1);
-        string actualData = receivedData.substr(0, receivedData.find_last_of(" "));
+        auto received = Tangle::parseSerialized(frame.payload);
+        dropUnverified(received, tangle, from);
+        // Transactions already held were not verified again: addTransaction keeps their content and
+        // takes only the peer's cumulative weight
+        lock_guard<mutex> lock(tangleMutex);
+        for (const auto &tx : received)
+            tangle.addTransaction(tx);
+        cout << "[LOG] Tangle update verified and applied." << endl;
+        printLastTransaction(tangle);
+        break;
+    }
+    case MSG_ACK:
+        return;
+    default:
+        cerr << "[ERROR] Unknown message type " << static_cast<int>(frame.type) << endl;
+        return;
+    }
+    reply += encodeFrame(MSG_ACK, ackPayload(frame));
+}
+
+struct Connection
+{
+    string peer; // remote address, used to avoid gossiping back to the sender
+    string buffer;
+    string outbox;
+    chrono::steady_clock::time_point lastActivity;
+    bool readClosed = false; // the peer is done sending; the connection ends once the outbox is written
+};
+
+static atomic<int> openConnections{0};
+
+static void closeConnection(int epollFd, unordered_map<int, Connection> &connections, int fd)
+{
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections.erase(fd);
+    openConnections--;
+}
 
-        if (verifyChecksum(actualData, receivedChecksum))
+static void acceptClients(int serverSocket, int epollFd, unordered_map<int, Connection> &connections)
+{
+    while (true)
+    {
+        sockaddr_in clientAddr{};
+        socklen_t addrLen = sizeof(clientAddr);
+        int clientSocket = accept4(serverSocket, (sockaddr *)&clientAddr, &addrLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientSocket < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return; // EAGAIN: backlog drained, or another loop took the connection
+        }
+
+        if (openConnections.fetch_add(1) >= MAX_CONNECTIONS)
         {
-            tangle.updateFromSerialized(actualData);
-            cout << "[LOG] Tangle update verified and applied." << endl;
-            printLastTransaction(tangle);
+            openConnections--;
+            cerr << "[ERROR] Connection limit reached, refusing client" << endl;
+            close(clientSocket);
+            continue;
         }
-        else
+
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.fd = clientSocket;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientSocket, &ev) < 0)
+        {
+            close(clientSocket);
+            openConnections--;
+            continue;
+        }
+        char address[INET_ADDRSTRLEN] = {0};
+        inet_ntop(AF_INET, &clientAddr.sin_addr, address, sizeof(address));
+        Connection &conn = connections[clientSocket];
+        conn.peer = address;
+        conn.lastActivity = chrono::steady_clock::now();
+        cout << "[LOG] New connection received" << endl;
+    }
+}
+
+// Writes as much of the outbox as the socket takes; EPOLLOUT stays armed until it is empty, EPOLLIN
+// until the peer is done sending
+static bool flushClient(int epollFd, int fd, Connection &conn)
+{
+    while (!conn.outbox.empty())
+    {
+        ssize_t sent = send(fd, conn.outbox.data(), conn.outbox.size(), MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                return false;
+            break;
+        }
+        conn.outbox.erase(0, sent);
+    }
+
+    epoll_event ev{};
+    ev.events = conn.readClosed ? 0 : EPOLLIN | EPOLLRDHUP;
+    if (!conn.outbox.empty())
+        ev.events |= EPOLLOUT;
+    ev.data.fd = fd;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev);
+    return true;
+}
+
+// Drains the socket, handles every complete frame in the buffer and flushes the replies
+static void serviceClient(int epollFd, unordered_map<int, Connection> &connections, int fd, uint32_t events, Tangle &tangle)
+{
+    auto it = connections.find(fd);
+    if (it == connections.end())
+        return;
+    Connection &conn = it->second;
+
+    char buffer[BUFFER_SIZE];
+    while (!conn.readClosed && (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+    {
+        ssize_t bytesRead = read(fd, buffer, BUFFER_SIZE);
+        if (bytesRead > 0)
+        {
+            conn.buffer.append(buffer, bytesRead);
+            conn.lastActivity = chrono::steady_clock::now();
+            continue;
+        }
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+        if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+
+        conn.readClosed = true;
+        break;
+    }
+
+    size_t consumed = 0;
+    while (true)
+    {
+        Frame frame;
+        size_t frameSize = 0;
+        FrameStatus status = decodeFrame(conn.buffer.data() + consumed, conn.buffer.size() - consumed,
+                                         MAX_MESSAGE_BYTES, frame, frameSize);
+        if (status == FRAME_INCOMPLETE)
+            break;
+        if (status == FRAME_INVALID)
         {
             cerr << "[ERROR] Data corruption detected!" << endl;
+            closeConnection(epollFd, connections, fd);
+            return;
+        }
+        // The CRC only proves the frame arrived as sent; a peer can still send a line that does not parse
+        try
+        {
+            handleFrame(frame, conn.peer, tangle, conn.outbox);
+        }
+        catch (const invalid_argument &e)
+        {
+            cerr << "[ERROR] Malformed frame from " << conn.peer << ": " << e.what() << endl;
+            closeConnection(epollFd, connections, fd);
+            return;
+        }
+        catch (const out_of_range &e)
+        {
+            cerr << "[ERROR] Malformed frame from " << conn.peer << ": " << e.what() << endl;
+            closeConnection(epollFd, connections, fd);
+            return;
+        }
+        consumed += frameSize;
+    }
+    conn.buffer.erase(0, consumed);
+
+    // A peer that half-closes after its last frame still gets the replies to it; an incomplete trailing
+    // frame is discarded
+    if (!flushClient(epollFd, fd, conn) || (conn.readClosed && conn.outbox.empty()))
+    {
+        closeConnection(epollFd, connections, fd);
+    }
+}
+
+static void closeIdleClients(int epollFd, unordered_map<int, Connection> &connections)
+{
+    auto deadline = chrono::steady_clock::now() - chrono::milliseconds(IDLE_TIMEOUT_MS);
+    vector<int> idle;
+    for (const auto &[fd, conn] : connections)
+    {
+        if (conn.lastActivity < deadline)
+            idle.push_back(fd);
+    }
+    for (int fd : idle)
+    {
+        cerr << "[ERROR] Dropping idle connection" << endl;
+        closeConnection(epollFd, connections, fd);
+    }
+}
+
+// One event loop; every loop watches the shared listening socket and owns the clients it accepts
+static void runEventLoop(int serverSocket, Tangle &tangle)
+{
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0)
+    {
+        cerr << "[ERROR] Failed to create epoll instance" << endl;
+        return;
+    }
+
+    epoll_event listenEv{};
+    listenEv.events = EPOLLIN | EPOLLEXCLUSIVE;
+    listenEv.data.fd = serverSocket;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, serverSocket, &listenEv);
+
+    unordered_map<int, Connection> connections;
+    epoll_event events[64];
+    auto lastSweep = chrono::steady_clock::now();
+
+    while (true)
+    {
+        int ready = epoll_wait(epollFd, events, 64, 1000);
+        for (int i = 0; i < ready; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == serverSocket)
+                acceptClients(serverSocket, epollFd, connections);
+            else
+                serviceClient(epollFd, connections, fd, events[i].events, tangle);
+        }
+
+        auto now = chrono::steady_clock::now();
+        if (now - lastSweep >= chrono::seconds(1))
+        {
+            closeIdleClients(epollFd, connections);
+            lastSweep = now;
         }
     }
-    close(clientSocket);
 }
 
 void startServer(Tangle &tangle)
 {
-    int serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+    int serverSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (serverSocket == -1)
     {
         cerr << "[ERROR] Failed to create socket" << endl;
         return;
     }
 
+    int reuse = 1;
+    setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
     sockaddr_in serverAddr{};
     serverAddr.sin_family = AF_INET;
-    serverAddr.sin_addr.s_addr = INADDR_ANY;
-    serverAddr.sin_port = htons(PORT);
+    serverAddr.sin_port = htons(networkConfig.port);
+    if (inet_pton(AF_INET, networkConfig.bindAddress.c_str(), &serverAddr.sin_addr) != 1)
+    {
+        cerr << "[ERROR] Invalid bind address " << networkConfig.bindAddress << endl;
+        close(serverSocket);
+        return;
+    }
 
     if (bind(serverSocket, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0)
     {
@@ -136,77 +513,140 @@ void startServer(Tangle &tangle)
         return;
     }
 
-    if (listen(serverSocket, 5) < 0)
+    if (listen(serverSocket, SOMAXCONN) < 0)
     {
         cerr << "[ERROR] Failed to listen on socket" << endl;
         close(serverSocket);
         return;
     }
 
-    cout << "[LOG] Server listening on port " << PORT << endl;
+    cout << "[LOG] Server listening on " << networkConfig.bindAddress << ":" << networkConfig.port << " with " << IO_THREADS << " I/O threads" << endl;
 
-    while (true)
+    vector<thread> loops;
+    for (int i = 1; i < IO_THREADS; i++)
     {
-        int clientSocket = accept(serverSocket, nullptr, nullptr);
-        if (clientSocket >= 0)
-        {
-            cout << "[LOG] New connection received" << endl;
-            thread clientThread(handleTCPClient, clientSocket, ref(tangle));
-            clientThread.detach();
-        }
+        loops.emplace_back(runEventLoop, serverSocket, ref(tangle));
+    }
+    runEventLoop(serverSocket, tangle);
+    for (auto &loop : loops)
+    {
+        loop.join();
     }
 }
 
-bool sendOverTCP(string message, string node)
+/**
+ * Sends Tangle syncs over LoRa on its own thread. Under the duty-cycle
+ * budget a sync can take minutes to get out, while broadcastTangle's
+ * caller holds tangleMutex; the frames are encoded there and handed over.
+ * Only the newest sync waits to go: a newer one replaces it, as a newer
+ * snapshot replaces an unsent one on TCP.
+ */
+class LoraSyncSender
 {
-    int retryCount = 0;
-    while (retryCount < MAX_RETRIES)
+public:
+    LoraSyncSender() : worker(&LoraSyncSender::run, this) {}
+
+    void submit(vector<vector<uint8_t>> messages, vector<string> nodes, size_t bytes)
     {
-        int sock = socket(AF_INET, SOCK_STREAM, 0);
-        if (sock == -1)
         {
-            cerr << "[ERROR] Failed to create socket" << endl;
-            retryCount++;
-            continue;
+            lock_guard<mutex> lock(syncMutex);
+            if (pending)
+                cout << "[LOG] Replacing a LoRa sync that had not gone out yet" << endl;
+            next = {move(messages), move(nodes), bytes};
+            pending = true;
         }
+        ready.notify_one();
+    }
 
-        sockaddr_in serverAddr{};
-        serverAddr.sin_family = AF_INET;
-        serverAddr.sin_port = htons(PORT);
-        inet_pton(AF_INET, node.c_str(), &serverAddr.sin_addr);
+private:
+    struct Sync
+    {
+        vector<vector<uint8_t>> messages;
+        vector<string> nodes; // peers the sync was meant for over LoRa
+        size_t bytes;         // size of the snapshot it stands for, for the path costs
+    };
 
-        if (connect(sock, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0)
+    void run()
+    {
+        while (true)
         {
-            cerr << "[ERROR] Failed to connect to " << node << " (Attempt " << retryCount + 1 << ")" << endl;
-            close(sock);
-            retryCount++;
-            continue;
-        }
+            Sync sync;
+            {
+                unique_lock<mutex> lock(syncMutex);
+                ready.wait(lock, [this] { return pending; });
+                sync = move(next);
+                pending = false;
+            }
 
-        send(sock, message.c_str(), message.size(), 0);
-        cout << "[LOG] Sent Tangle update to " << node << "using TCP/IP" << endl;
-        close(sock);
-        return true;
+            auto began = chrono::steady_clock::now();
+            bool sent = sendEncodedOverLora(sync.messages);
+            chrono::duration<double> elapsed = chrono::steady_clock::now() - began;
+            for (const string &node : sync.nodes)
+            {
+                if (sent)
+                    pathSelector.delivered(node, PathKind::Lora, sync.bytes, elapsed.count());
+                else
+                    pathSelector.failed(node, PathKind::Lora, chrono::steady_clock::now());
+            }
+            if (!sent)
+                cout << "[ERROR] Failed to send data over LoRa" << endl;
+        }
     }
-    return false;
+
+    mutex syncMutex;
+    condition_variable ready;
+    Sync next;
+    bool pending = false;
+    thread worker; // last, so everything it uses exists when it starts
+};
+
+// Never destroyed: at exit its thread may still be waiting on the radio
+static LoraSyncSender &loraSyncSender()
+{
+    static LoraSyncSender *sender = new LoraSyncSender();
+    return *sender;
 }
 
 void broadcastTangle(const Tangle &tangle)
 {
-    string tangleData = tangle.serialize();
-    string checksum = computeChecksum(tangleData);
-    string message = tangleData + " " + checksum;
+    PeerManager &peers = peerManager();
+    auto snapshot = make_shared<const string>(encodeFrame(MSG_SNAPSHOT, tangle.serialize()));
+    auto now = chrono::steady_clock::now();
+    expireAcks(now);
 
-    for (const auto &node : knownNodes)
+    // Each peer gets the snapshot over its cheapest healthy path. TCP ones are queued at once and written
+    // concurrently, an unsent older snapshot being replaced; with no path at all it waits for the connection.
+    vector<string> overLora;
+    for (const string &node : networkConfig.nodes)
     {
-        // if (sendOverTCP(message, node))
-        // {
-        //     continue;
-        // }
-        string messageForLora = tangleData + " " + checksum + " " + node;
-        if (!sendOverLora(messageForLora))
+        pathSelector.setAvailable(node, PathKind::Tcp, peers.isConnected(node));
+        pathSelector.setAvailable(node, PathKind::Lora, networkConfig.loraFallback);
+        vector<PathKind> ranked = pathSelector.rank(node, snapshot->size(), now);
+        if (!ranked.empty() && ranked.front() == PathKind::Lora)
         {
-            cout << "[ERROR] Failed to send data over LoRa" << endl;
+            overLora.push_back(node);
+            continue;
         }
+        peers.send(node, "tangle", snapshot);
+
+        double expected = pathSelector.cost(node, PathKind::Tcp, snapshot->size(), now);
+        auto wait = chrono::milliseconds(ACK_TIMEOUT_MS) +
+                    chrono::duration_cast<chrono::milliseconds>(chrono::duration<double>(isinf(expected) ? 0 : expected));
+        lock_guard<mutex> lock(ackMutex);
+        awaitedAcks[node].push_back({ackPayload(*snapshot), snapshot->size(), now, now + wait});
     }
+    if (overLora.empty())
+        return;
+
+    // LoRa is a broadcast medium: one pass of compact frames reaches every peer it was chosen for
+    cout << "[LOG] Sending Tangle over LoRa to " << overLora.size() << " of " << networkConfig.nodes.size()
+         << " peers" << endl;
+    loraSyncSender().submit(encodeTransactionsForLora(tangle), move(overLora), snapshot->size());
+}
+
+void gossipTransaction(const Tangle &tangle, const Transaction &tx)
+{
+    Gossip &g = gossip();
+    g.markSeen(tx.transaction_id);
+    g.publish(tangle.serialize({tx.transaction_id}));
 }
\ No newline at end of file
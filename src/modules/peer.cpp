@@ -0,0 +1,430 @@
+#include "peer.h"
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+const int MIN_BACKOFF_MS = 500;
+const int MAX_BACKOFF_MS = 30000;
+const size_t MAX_QUEUED = 64;        // Per-peer outbound messages before the oldest is dropped
+const size_t MAX_INBOUND = 16u << 20; // Largest frame accepted from a peer
+const uint32_t WAKE_EVENT = UINT32_MAX;
+
+PeerManager::PeerManager(const vector<string> &nodes, int port, const string &localAddress)
+    : port(port), localAddress(localAddress), lossRng(random_device{}()),
+      epollFd(-1), wakeFd(-1), peers(nodes.size()), running(false)
+{
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        peers[i].node = nodes[i];
+    }
+}
+
+PeerManager::~PeerManager()
+{
+    stop();
+}
+
+void PeerManager::start()
+{
+    if (running.exchange(true))
+        return;
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u32 = WAKE_EVENT;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+
+    loop = thread(&PeerManager::run, this);
+}
+
+void PeerManager::stop()
+{
+    if (!running.exchange(false))
+        return;
+
+    wakeLoop();
+    loop.join();
+
+    for (auto &peer : peers)
+    {
+        if (peer.fd >= 0)
+            close(peer.fd);
+        peer.fd = -1;
+        peer.connected = false;
+    }
+    close(wakeFd);
+    close(epollFd);
+}
+
+void PeerManager::setFrameHandler(FrameHandler handler)
+{
+    lock_guard<mutex> lock(queueMutex);
+    frameHandler = move(handler);
+}
+
+void PeerManager::setLinkProfile(const LinkProfile &profile)
+{
+    lock_guard<mutex> lock(queueMutex);
+    link = profile;
+}
+
+void PeerManager::enqueue(Peer &peer, const string &key, shared_ptr<const string> message)
+{
+    if (link.lossRate > 0 && uniform_real_distribution<double>(0, 1)(lossRng) < link.lossRate)
+        return;
+
+    // The front message may be partly written already and must go out unchanged
+    size_t first = (peer.offset > 0) ? 1 : 0;
+    if (!key.empty())
+    {
+        auto it = find_if(peer.queue.begin() + min(first, peer.queue.size()), peer.queue.end(),
+                          [&](const Outbound &out) { return out.key == key; });
+        if (it != peer.queue.end())
+        {
+            it->data = message;
+            return;
+        }
+    }
+
+    peer.queue.push_back({key, message, Clock::now() + chrono::milliseconds(link.latencyMs)});
+    if (peer.queue.size() > MAX_QUEUED)
+    {
+        peer.queue.erase(peer.queue.begin() + first);
+    }
+}
+
+void PeerManager::wakeLoop()
+{
+    uint64_t one = 1;
+    // EAGAIN: the counter is already at its maximum, so the loop is woken anyway
+    if (write(wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    {
+        cerr << "[ERROR] Failed to wake the peer loop" << endl;
+    }
+}
+
+void PeerManager::broadcast(const string &key, shared_ptr<const string> message)
+{
+    {
+        lock_guard<mutex> lock(queueMutex);
+        for (auto &peer : peers)
+        {
+            enqueue(peer, key, message);
+        }
+    }
+    wakeLoop();
+}
+
+void PeerManager::send(const string &node, const string &key, shared_ptr<const string> message)
+{
+    {
+        lock_guard<mutex> lock(queueMutex);
+        for (auto &peer : peers)
+        {
+            if (peer.node == node)
+                enqueue(peer, key, message);
+        }
+    }
+    wakeLoop();
+}
+
+vector<string> PeerManager::nodes() const
+{
+    vector<string> out;
+    for (const auto &peer : peers)
+    {
+        out.push_back(peer.node); // fixed at construction, no lock needed
+    }
+    return out;
+}
+
+bool PeerManager::isConnected(const string &node) const
+{
+    lock_guard<mutex> lock(queueMutex);
+    for (const auto &peer : peers)
+    {
+        if (peer.node == node)
+            return peer.connected;
+    }
+    return false;
+}
+
+size_t PeerManager::connectedCount() const
+{
+    lock_guard<mutex> lock(queueMutex);
+    return count_if(peers.begin(), peers.end(), [](const Peer &peer) { return peer.connected; });
+}
+
+void PeerManager::connectPeer(Peer &peer)
+{
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, peer.node.c_str(), &addr.sin_addr) != 1)
+    {
+        cerr << "[ERROR] Invalid peer address " << peer.node << endl;
+        peer.nextAttempt = Clock::now() + chrono::milliseconds(MAX_BACKOFF_MS);
+        return;
+    }
+
+    peer.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (peer.fd < 0)
+    {
+        cerr << "[ERROR] Failed to create socket" << endl;
+        disconnectPeer(peer);
+        return;
+    }
+
+    int noDelay = 1;
+    setsockopt(peer.fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    if (!localAddress.empty())
+    {
+        sockaddr_in local{};
+        local.sin_family = AF_INET;
+        inet_pton(AF_INET, localAddress.c_str(), &local.sin_addr);
+        bind(peer.fd, (sockaddr *)&local, sizeof(local));
+    }
+
+    if (connect(peer.fd, (sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS)
+    {
+        disconnectPeer(peer);
+        return;
+    }
+
+    epoll_event ev{};
+    ev.events = EPOLLOUT;
+    ev.data.u32 = static_cast<uint32_t>(&peer - peers.data());
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, peer.fd, &ev);
+}
+
+// Closes the socket and schedules a reconnect with exponential backoff
+void PeerManager::disconnectPeer(Peer &peer)
+{
+    if (peer.fd >= 0)
+    {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, peer.fd, nullptr);
+        close(peer.fd);
+    }
+
+    if (peer.connected)
+        cerr << "[ERROR] Lost connection to " << peer.node << endl;
+
+    peer.backoffMs = peer.backoffMs ? min(peer.backoffMs * 2, MAX_BACKOFF_MS) : MIN_BACKOFF_MS;
+    if (!peer.connected)
+        cerr << "[ERROR] Failed to connect to " << peer.node << ", retrying in " << peer.backoffMs << " ms" << endl;
+
+    peer.fd = -1;
+    peer.connected = false;
+    peer.offset = 0; // the receiver discards a partial message when the connection drops
+    peer.inbox.clear();
+    peer.nextAttempt = Clock::now() + chrono::milliseconds(peer.backoffMs);
+}
+
+// Earliest time the front message may be written under the link profile
+Clock::time_point PeerManager::sendableAt(const Peer &peer) const
+{
+    if (peer.queue.empty())
+        return Clock::time_point::max();
+    return max(peer.queue.front().readyAt, peer.nextSendAt);
+}
+
+void PeerManager::flushPeer(Peer &peer)
+{
+    while (!peer.queue.empty() && sendableAt(peer) <= Clock::now())
+    {
+        const string &data = *peer.queue.front().data;
+        size_t chunk = data.size() - peer.offset;
+        if (link.bytesPerSecond > 0)
+            chunk = min(chunk, max<size_t>(512, static_cast<size_t>(link.bytesPerSecond / 100)));
+
+        ssize_t sent = ::send(peer.fd, data.data() + peer.offset, chunk, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                disconnectPeer(peer);
+            return;
+        }
+
+        if (link.bytesPerSecond > 0)
+            peer.nextSendAt = Clock::now() + chrono::microseconds(static_cast<long>(sent * 1e6 / link.bytesPerSecond));
+
+        peer.offset += sent;
+        if (peer.offset == data.size())
+        {
+            cout << "[LOG] Sent Tangle update to " << peer.node << " using TCP/IP" << endl;
+            peer.queue.pop_front();
+            peer.offset = 0;
+        }
+    }
+}
+
+// Reads replies into the inbox and collects complete frames; false when the connection is gone
+bool PeerManager::readPeer(Peer &peer, vector<pair<string, Frame>> &received)
+{
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(peer.fd, buffer, sizeof(buffer))) > 0)
+    {
+        peer.inbox.append(buffer, n);
+    }
+    bool open = (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+
+    size_t consumed = 0;
+    while (true)
+    {
+        Frame frame;
+        size_t frameSize = 0;
+        FrameStatus status = decodeFrame(peer.inbox.data() + consumed, peer.inbox.size() - consumed,
+                                         MAX_INBOUND, frame, frameSize);
+        if (status == FRAME_INCOMPLETE)
+            break;
+        if (status == FRAME_INVALID)
+        {
+            cerr << "[ERROR] Corrupt frame from " << peer.node << endl;
+            return false;
+        }
+        received.emplace_back(peer.node, move(frame));
+        consumed += frameSize;
+    }
+    peer.inbox.erase(0, consumed);
+    return open;
+}
+
+// Interest follows state: connect completion, then reads plus writes while the queue is non-empty
+void PeerManager::watchPeer(Peer &peer)
+{
+    epoll_event ev{};
+    ev.data.u32 = static_cast<uint32_t>(&peer - peers.data());
+    ev.events = peer.connected ? (EPOLLIN | EPOLLRDHUP) : EPOLLOUT;
+    if (peer.connected && sendableAt(peer) <= Clock::now())
+        ev.events |= EPOLLOUT;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, peer.fd, &ev);
+}
+
+void PeerManager::run()
+{
+    epoll_event events[64];
+
+    while (running)
+    {
+        int timeoutMs = 1000;
+        {
+            lock_guard<mutex> lock(queueMutex);
+            auto now = Clock::now();
+            for (auto &peer : peers)
+            {
+                if (peer.fd >= 0)
+                    continue;
+                if (now >= peer.nextAttempt)
+                {
+                    connectPeer(peer);
+                }
+                else
+                {
+                    auto wait = chrono::duration_cast<chrono::milliseconds>(peer.nextAttempt - now).count();
+                    timeoutMs = min<int>(timeoutMs, wait + 1);
+                }
+            }
+
+            // Messages held back by simulated latency or bandwidth: flush the due ones, wake for the next
+            for (auto &peer : peers)
+            {
+                if (!peer.connected || peer.queue.empty())
+                    continue;
+                auto due = sendableAt(peer);
+                if (due <= now)
+                {
+                    flushPeer(peer);
+                    if (peer.fd >= 0)
+                        watchPeer(peer);
+                    due = sendableAt(peer);
+                }
+                if (due != Clock::time_point::max() && due > now)
+                {
+                    auto wait = chrono::duration_cast<chrono::milliseconds>(due - now).count();
+                    timeoutMs = min<int>(timeoutMs, wait + 1);
+                }
+            }
+        }
+
+        int ready = epoll_wait(epollFd, events, 64, timeoutMs);
+
+        vector<pair<string, Frame>> received;
+        FrameHandler handler;
+        {
+            lock_guard<mutex> lock(queueMutex);
+            handler = frameHandler;
+            for (int i = 0; i < ready; i++)
+            {
+                if (events[i].data.u32 == WAKE_EVENT)
+                {
+                    uint64_t count;
+                    // Only clears the counter; nothing to read (EAGAIN) just means another wake-up got here first
+                    if (read(wakeFd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+                    {
+                        cerr << "[ERROR] Failed to read the peer loop wake-up" << endl;
+                    }
+                    for (auto &peer : peers)
+                    {
+                        if (peer.connected)
+                            watchPeer(peer);
+                    }
+                    continue;
+                }
+
+                Peer &peer = peers[events[i].data.u32];
+                if (peer.fd < 0)
+                    continue;
+
+                if (!peer.connected)
+                {
+                    int err = 0;
+                    socklen_t len = sizeof(err);
+                    getsockopt(peer.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                    if (err != 0)
+                    {
+                        disconnectPeer(peer);
+                        continue;
+                    }
+                    peer.connected = true;
+                    peer.backoffMs = 0;
+                    cout << "[LOG] Connected to peer " << peer.node << endl;
+                }
+
+                if ((events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) && !readPeer(peer, received))
+                {
+                    disconnectPeer(peer);
+                    continue;
+                }
+
+                flushPeer(peer);
+                if (peer.fd >= 0)
+                    watchPeer(peer);
+            }
+        }
+
+        // Handlers run without the lock so they can broadcast
+        for (const auto &[node, frame] : received)
+        {
+            if (handler)
+                handler(node, frame);
+        }
+    }
+}
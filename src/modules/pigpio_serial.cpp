@@ -0,0 +1,86 @@
+// pigpio_serial.cpp
+//
+// SerialTransport for the Waveshare SX1268 HAT on a Raspberry Pi.
+// Link against libpigpio (e.g., `-lpigpio -lrt -lpthread`).
+
+#include "serial.h"
+
+#include <iostream>
+#include <thread>
+#include <cstdlib>
+#include <atomic>
+
+extern "C" {
+    #include <pigpio.h>
+}
+
+// GPIO pin numbers (BCM numbering)
+static constexpr int M0 = 22;
+static constexpr int M1 = 27;
+
+class PigpioSerial : public SerialTransport {
+public:
+    PigpioSerial(const std::string& device, uint32_t baudrate) {
+        gpioSetMode(M0, PI_OUTPUT);
+        gpioSetMode(M1, PI_OUTPUT);
+        handle = serOpen(const_cast<char*>(device.c_str()), baudrate, 0);
+        if (handle < 0) {
+            std::cerr << "Failed to open serial port " << device << std::endl;
+        }
+    }
+
+    ~PigpioSerial() override {
+        if (handle >= 0) {
+            serClose(handle);
+        }
+    }
+
+    bool is_open() const override { return handle >= 0; }
+
+    void set_mode(bool m0, bool m1) override {
+        gpioWrite(M0, m0 ? PI_HIGH : PI_LOW);
+        gpioWrite(M1, m1 ? PI_HIGH : PI_LOW);
+    }
+
+    int write(const uint8_t* data, size_t length) override {
+        return serWrite(handle, const_cast<char*>(reinterpret_cast<const char*>(data)), length);
+    }
+
+    int available() override { return serDataAvailable(handle); }
+
+    int read(uint8_t* data, size_t length) override {
+        return serRead(handle, reinterpret_cast<char*>(data), length);
+    }
+
+    // pigpio has no readiness notification, so this polls the UART every millisecond
+    bool wait_readable(std::chrono::milliseconds timeout) override {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!woken.exchange(false)) {
+            if (serDataAvailable(handle) > 0) {
+                return true;
+            }
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return serDataAvailable(handle) > 0;
+    }
+
+    void wake() override { woken = true; }
+
+    void sleep(std::chrono::milliseconds duration) override { std::this_thread::sleep_for(duration); }
+
+private:
+    int handle;
+    std::atomic<bool> woken{false};
+};
+
+std::unique_ptr<SerialTransport> openPigpioSerial(const std::string& device, uint32_t baudrate) {
+    static bool initialised = gpioInitialise() >= 0 && std::atexit(gpioTerminate) == 0;
+    if (!initialised) {
+        std::cerr << "pigpio initialization failed" << std::endl;
+        return nullptr;
+    }
+    return std::make_unique<PigpioSerial>(device, baudrate);
+}
@@ -0,0 +1,461 @@
+#include "radio.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static constexpr auto RX_WAIT = std::chrono::milliseconds(1000); // longest idle block on the UART
+static constexpr size_t MAX_RX_QUEUE = 256;                    // oldest packets are dropped beyond this
+static constexpr double DEFAULT_DUTY_CYCLE = 0.01;              // EU868 g1 sub-band limit
+static constexpr double DUTY_CYCLE_WINDOW = 3600;               // seconds
+static constexpr double BULK_SHARE = 0.8;                       // of the budget bulk sync may use
+static constexpr double NOISE_INTERVAL = 15;                    // seconds between idle noise samples
+static constexpr size_t NOISE_SAMPLES = 4;                      // the floor is the quietest of these
+static constexpr double LBT_BUSY_DB = 6;                        // above the floor means someone is sending
+static constexpr int LBT_QUIET_FLOOR = -115;                    // dBm, until the floor has been sampled
+static constexpr int LBT_MIN_WINDOW = 4;                        // backoff slots after the first busy reading
+static constexpr int LBT_MAX_WINDOW = 64;
+static constexpr int LBT_MAX_ATTEMPTS = 7;                      // busy readings before sending regardless
+static constexpr size_t LBT_SLOT_BYTES = 32;                    // a slot is the airtime of a packet this long
+static constexpr auto REOPEN_MIN_WAIT = std::chrono::milliseconds(1000); // after a failed open; doubles each time
+static constexpr auto REOPEN_MAX_WAIT = std::chrono::milliseconds(10000);
+
+bool RadioConfig::operator==(const RadioConfig& other) const {
+    return serial == other.serial && freq == other.freq && addr == other.addr && power == other.power &&
+           rssi == other.rssi && airSpeed == other.airSpeed && netId == other.netId &&
+           bufferSize == other.bufferSize && crypt == other.crypt && relay == other.relay &&
+           lbt == other.lbt && wor == other.wor;
+}
+
+static TransportFactory defaultTransport;
+
+void LoraRadio::setDefaultTransport(TransportFactory factory) {
+    defaultTransport = std::move(factory);
+}
+
+LoraRadio& LoraRadio::instance() {
+    static LoraRadio radio(defaultTransport);
+    return radio;
+}
+
+// -------------------- DutyCycle --------------------
+
+DutyCycle::DutyCycle(double fraction, double window) : fraction(fraction), window(window) {}
+
+double DutyCycle::availableAt(double now, double airtime, double share) const {
+    if (fraction >= 1) {
+        return now;
+    }
+    double budget = fraction * window * share;
+    double spent = 0;
+    for (const auto& entry : history) {
+        if (entry.first > now - window) {
+            spent += entry.second;
+        }
+    }
+    if (airtime > budget) {
+        return std::numeric_limits<double>::infinity(); // would break the limit even on an idle channel
+    }
+    if (spent + airtime <= budget) {
+        return now;
+    }
+    // Wait for the oldest transmissions to leave the window until this one fits
+    for (const auto& entry : history) {
+        if (entry.first <= now - window) {
+            continue;
+        }
+        spent -= entry.second;
+        if (spent + airtime <= budget) {
+            return entry.first + window;
+        }
+    }
+    return now;
+}
+
+void DutyCycle::record(double start, double airtime) {
+    history.emplace_back(start, airtime);
+    while (!history.empty() && history.front().first <= start - window) {
+        history.pop_front();
+    }
+}
+
+double DutyCycle::used(double now) const {
+    double spent = 0;
+    for (const auto& entry : history) {
+        if (entry.first > now - window) {
+            spent += entry.second;
+        }
+    }
+    return spent / window;
+}
+
+// -------------------- LoraRadio --------------------
+
+LoraRadio::LoraRadio(TransportFactory factory)
+    : openTransport(std::move(factory)),
+      reconfigure(true),
+      epoch(std::chrono::steady_clock::now()),
+      nextTx(0),
+      clockRate(1.0),
+      budget(DEFAULT_DUTY_CYCLE, DUTY_CYCLE_WINDOW),
+      nextNoiseSample(0),
+      holdUntil(0),
+      backoffUntil(0),
+      listenBeforeTalk(true),
+      rng(std::random_device{}()),
+      running(true) {
+    owner = std::thread(&LoraRadio::run, this);
+}
+
+LoraRadio::~LoraRadio() {
+    running = false;
+    {
+        std::lock_guard<std::mutex> lock(radioMutex);
+        if (radio) {
+            radio->wake();
+        }
+    }
+    txReady.notify_all();
+    owner.join();
+}
+
+void LoraRadio::configure(const RadioConfig& config) {
+    std::lock_guard<std::mutex> lock(radioMutex);
+    if (config == wanted) {
+        return;
+    }
+    wanted = config;
+    reconfigure = true;
+    if (radio) {
+        radio->wake();
+    }
+    txReady.notify_one();
+}
+
+RadioConfig LoraRadio::config() const {
+    std::lock_guard<std::mutex> lock(radioMutex);
+    return wanted;
+}
+
+double LoraRadio::speedup() const {
+    std::lock_guard<std::mutex> lock(radioMutex);
+    return clockRate;
+}
+
+void LoraRadio::setDutyCycle(double fraction, std::chrono::seconds window) {
+    std::lock_guard<std::mutex> lock(radioMutex);
+    budget = DutyCycle(fraction, static_cast<double>(window.count()));
+    if (radio) {
+        radio->wake();
+    }
+}
+
+TxStats LoraRadio::txStats() const {
+    std::lock_guard<std::mutex> lock(radioMutex);
+    TxStats out = counters;
+    out.dutyCycle = budget.used(radioNow());
+    return out;
+}
+
+int LoraRadio::noiseFloor() const {
+    std::lock_guard<std::mutex> lock(radioMutex);
+    return noiseSamples.empty() ? 0 : *std::min_element(noiseSamples.begin(), noiseSamples.end());
+}
+
+void LoraRadio::setListenBeforeTalk(bool enabled) {
+    std::lock_guard<std::mutex> lock(radioMutex);
+    listenBeforeTalk = enabled;
+}
+
+void LoraRadio::holdTraffic(std::chrono::milliseconds duration) {
+    std::lock_guard<std::mutex> lock(radioMutex);
+    holdUntil = radioNow() + std::chrono::duration<double>(duration).count();
+    if (radio) {
+        radio->wake();
+    }
+}
+
+double LoraRadio::radioNow() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - epoch).count() * clockRate;
+}
+
+bool LoraRadio::transmit(std::vector<std::vector<uint8_t>> packets, TxPriority priority) {
+    if (packets.empty()) {
+        return true;
+    }
+    auto job = std::make_unique<TxJob>();
+    job->packets = std::move(packets);
+    std::future<bool> done = job->done.get_future();
+    {
+        std::lock_guard<std::mutex> lock(radioMutex);
+        txQueues[static_cast<size_t>(priority)].push_back(std::move(job));
+        if (radio) {
+            radio->wake();
+        }
+    }
+    txReady.notify_one();
+    return done.get();
+}
+
+bool LoraRadio::receive(LoraPacket& packet, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(radioMutex);
+    if (!rxReady.wait_for(lock, timeout, [this] { return !rxQueue.empty(); })) {
+        return false;
+    }
+    packet = std::move(rxQueue.front());
+    rxQueue.pop_front();
+    return true;
+}
+
+bool LoraRadio::receive(std::string& payload, std::chrono::milliseconds timeout) {
+    LoraPacket packet;
+    if (!receive(packet, timeout)) {
+        return false;
+    }
+    payload.assign(packet.payload.begin(), packet.payload.end());
+    return true;
+}
+
+// Opens the UART on first use, when the serial device changes or when the port is not open; otherwise
+// set() only if needed
+bool LoraRadio::applyConfig() {
+    RadioConfig config;
+    {
+        std::lock_guard<std::mutex> lock(radioMutex);
+        config = wanted;
+        reconfigure = false;
+    }
+
+    if (!openTransport) {
+        std::cerr << "[ERROR] No LoRa transport configured" << std::endl;
+        return false;
+    }
+    if (!radio || !radio->is_open() || config.serial != applied.serial) {
+        auto opened = std::make_unique<sx126x>(openTransport(config.serial, 9600), config.freq, config.addr,
+                                               config.power, config.rssi, config.airSpeed, config.netId,
+                                               config.bufferSize, config.crypt, config.relay, config.lbt,
+                                               config.wor);
+        opened->on_packet([this](const LoraPacket& packet) {
+            {
+                std::lock_guard<std::mutex> lock(radioMutex);
+                if (rxQueue.size() >= MAX_RX_QUEUE) {
+                    rxQueue.pop_front();
+                }
+                rxQueue.push_back(packet);
+            }
+            rxReady.notify_all();
+        });
+        std::lock_guard<std::mutex> lock(radioMutex);
+        if (!radio) {
+            epoch = std::chrono::steady_clock::now(); // the radio clock starts with the first radio
+            clockRate = opened->speedup();
+        }
+        radio = std::move(opened);
+    } else if (config != applied) {
+        radio->set(config.freq, config.addr, config.power, config.rssi, config.airSpeed, config.netId,
+                   config.bufferSize, config.crypt, config.relay, config.lbt, config.wor);
+    }
+    applied = config;
+
+    if (!radio->is_open()) {
+        std::cerr << "[ERROR] LoRa radio unavailable on " << config.serial << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool LoraRadio::channelClear(TxJob& job, double now) {
+    {
+        std::lock_guard<std::mutex> lock(radioMutex);
+        if (!listenBeforeTalk) {
+            return true;
+        }
+    }
+    int noise;
+    if (!radio->get_channel_rssi(noise)) {
+        return true; // no reading; send as without carrier sense
+    }
+
+    std::lock_guard<std::mutex> lock(radioMutex);
+    int floor = noiseSamples.empty() ? LBT_QUIET_FLOOR : *std::min_element(noiseSamples.begin(), noiseSamples.end());
+    if (noise <= floor + LBT_BUSY_DB) {
+        job.busyReadings = 0;
+        return true;
+    }
+    counters.busy++;
+    if (++job.busyReadings > LBT_MAX_ATTEMPTS) {
+        counters.forced++;
+        job.busyReadings = 0;
+        return true;
+    }
+    int window = std::min(LBT_MIN_WINDOW << (job.busyReadings - 1), LBT_MAX_WINDOW);
+    double wait = std::uniform_int_distribution<int>(1, window)(rng) * radio->time_on_air(LBT_SLOT_BYTES);
+    backoffUntil = now + wait;
+    counters.backoff += wait;
+    return false;
+}
+
+LoraRadio::TxJob* LoraRadio::nextJob(size_t& priority, double now) {
+    size_t allowed = now < holdUntil ? 1 : PRIORITIES;
+    for (priority = 0; priority < allowed; priority++) {
+        if (!txQueues[priority].empty()) {
+            return txQueues[priority].front().get();
+        }
+    }
+    return nullptr;
+}
+
+void LoraRadio::finishJob(size_t priority, bool sent) {
+    std::unique_ptr<TxJob> finished;
+    {
+        std::lock_guard<std::mutex> lock(radioMutex);
+        finished = std::move(txQueues[priority].front());
+        txQueues[priority].pop_front();
+    }
+    finished->done.set_value(sent);
+}
+
+void LoraRadio::run() {
+    bool ready = false;
+    // While the radio is unavailable the open is retried, waiting longer after each failure
+    auto reopenAt = std::chrono::steady_clock::now();
+    auto reopenWait = REOPEN_MIN_WAIT;
+    while (running) {
+        if (ready && !radio->is_open()) {
+            std::cerr << "[ERROR] LoRa radio on " << applied.serial << " closed; reopening" << std::endl;
+            ready = false;
+        }
+        bool pendingConfig;
+        {
+            std::lock_guard<std::mutex> lock(radioMutex);
+            // Not while the module is still sending the last packet, which a mode switch would cut off
+            pendingConfig = reconfigure && (!ready || radioNow() >= nextTx);
+        }
+        bool attempted = false;
+        if (pendingConfig || (!ready && std::chrono::steady_clock::now() >= reopenAt)) {
+            attempted = !ready;
+            ready = applyConfig();
+            if (ready) {
+                reopenWait = REOPEN_MIN_WAIT;
+            } else {
+                reopenAt = std::chrono::steady_clock::now() + reopenWait;
+                reopenWait = std::min(reopenWait * 2, REOPEN_MAX_WAIT);
+            }
+        }
+
+        // Next packet of the highest-priority job, once the module is free and the budget has room
+        TxJob* job;
+        size_t priority;
+        double now, sendAt = 0, airtime = 0, busy = 0;
+        {
+            std::lock_guard<std::mutex> lock(radioMutex);
+            now = radioNow();
+            job = nextJob(priority, now);
+            if (job && ready) {
+                size_t length = job->packets[job->next].size();
+                airtime = radio->time_on_air(length);
+                busy = radio->send_time(length);
+                double share = priority == static_cast<size_t>(TxPriority::Bulk) ? BULK_SHARE : 1.0;
+                double budgetAt = budget.availableAt(now, airtime, share);
+                if (budgetAt > now && job->heldSince < 0) {
+                    job->heldSince = now;
+                }
+                sendAt = std::max({nextTx, budgetAt, backoffUntil});
+            }
+            if (reconfigure) {
+                sendAt = std::max(sendAt, now + 1e-3); // the new settings go first
+            }
+        }
+        // A job queued while the radio is down waits for the next open and fails only if that fails too
+        if (job && !ready && attempted) {
+            finishJob(priority, false);
+            continue;
+        }
+        if (job && std::isinf(sendAt)) {
+            std::cerr << "[ERROR] LoRa packet of " << job->packets[job->next].size() << " bytes needs " << airtime
+                      << " s on air, more than the duty-cycle budget allows; not sent" << std::endl;
+            finishJob(priority, false);
+            continue;
+        }
+        if (!job && ready && now >= nextNoiseSample && now >= nextTx) {
+            int noise;
+            bool sampled = radio->get_channel_rssi(noise);
+            std::lock_guard<std::mutex> lock(radioMutex);
+            if (sampled) {
+                // A sample taken while a packet is on the air reads the packet, not the floor
+                if (noiseSamples.size() == NOISE_SAMPLES) {
+                    noiseSamples.pop_front();
+                }
+                noiseSamples.push_back(noise);
+            }
+            nextNoiseSample = now + NOISE_INTERVAL;
+            continue;
+        }
+        if (job && ready && now >= sendAt) {
+            if (!channelClear(*job, now)) {
+                continue;
+            }
+            radio->send(job->packets[job->next]);
+            {
+                std::lock_guard<std::mutex> lock(radioMutex);
+                if (job->heldSince >= 0) {
+                    counters.deferred += now - std::max(nextTx, job->heldSince); // waited on the budget, not the module
+                    job->heldSince = -1;
+                }
+                nextTx = now + busy;
+                budget.record(now, airtime);
+                counters.packets++;
+                counters.airtime += airtime;
+            }
+            if (++job->next == job->packets.size()) {
+                finishJob(priority, true);
+            }
+            continue;
+        }
+
+        // Idle, or waiting for the module or the budget: block on the UART until a packet, a wake or the next send
+        auto wait = RX_WAIT;
+        {
+            std::lock_guard<std::mutex> lock(radioMutex);
+            if (job && ready) {
+                auto untilSend = std::chrono::duration<double>((sendAt - now) / clockRate);
+                wait = std::min(wait, std::chrono::duration_cast<std::chrono::milliseconds>(untilSend) +
+                                          std::chrono::milliseconds(1));
+            }
+            if (holdUntil > now) {
+                auto untilRelease = std::chrono::duration<double>((holdUntil - now) / clockRate);
+                wait = std::min(wait, std::chrono::duration_cast<std::chrono::milliseconds>(untilRelease) +
+                                          std::chrono::milliseconds(1));
+            }
+            if (reconfigure) {
+                // Requested while the radio was being opened, so not woken, or once the module is free
+                auto untilFree = std::chrono::duration<double>(std::max(ready ? nextTx - now : 0.0, 0.0) / clockRate);
+                wait = std::min(wait, std::chrono::duration_cast<std::chrono::milliseconds>(untilFree));
+            }
+        }
+        if (ready) {
+            radio->poll(std::max(wait, std::chrono::milliseconds(0)));
+            continue;
+        }
+        auto untilReopen =
+            std::chrono::duration_cast<std::chrono::milliseconds>(reopenAt - std::chrono::steady_clock::now());
+        wait = std::min(wait, untilReopen + std::chrono::milliseconds(1));
+
+        std::unique_lock<std::mutex> lock(radioMutex);
+        txReady.wait_for(lock, std::max(wait, std::chrono::milliseconds(0)), [this, job] {
+            size_t queued;
+            // A job already waiting for the reopen does not cut the wait short
+            return !running || reconfigure || (!job && nextJob(queued, radioNow()) != nullptr);
+        });
+    }
+
+    // Fail whatever is still queued
+    std::lock_guard<std::mutex> lock(radioMutex);
+    for (auto& queue : txQueues) {
+        for (auto& job : queue) {
+            job->done.set_value(false);
+        }
+        queue.clear();
+    }
+}
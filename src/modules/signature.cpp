@@ -0,0 +1,372 @@
+#include "../headers/signature.h"
+#include "../headers/codec.h"
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <iostream>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+using namespace std;
+
+static const size_t KEY_BYTES = 32;
+static const size_t SIGNATURE_BYTES = 64;
+static const size_t NONCE_BYTES = 16;
+static const size_t INLINE_BATCH = 16; // smaller batches are verified on the calling thread
+static const size_t CHUNK = 8;         // transactions a worker takes at a time
+static const size_t MAX_CACHED_KEYS = 1024;
+
+static string toHex(const string& raw) {
+    static const char HEX[] = "0123456789abcdef";
+    string out;
+    out.reserve(raw.size() * 2);
+    for (unsigned char c : raw) {
+        out += HEX[c >> 4];
+        out += HEX[c & 0x0F];
+    }
+    return out;
+}
+
+// Empty unless hex is exactly `bytes` bytes of hex digits
+static string fromHex(const string& hex, size_t bytes) {
+    if (hex.size() != bytes * 2) {
+        return "";
+    }
+    auto nibble = [](char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+    string raw(bytes, '\0');
+    for (size_t i = 0; i < bytes; i++) {
+        int hi = nibble(hex[2 * i]), lo = nibble(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return "";
+        }
+        raw[i] = static_cast<char>(hi << 4 | lo);
+    }
+    return raw;
+}
+
+static double threadCpuSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Fetched once rather than looked up by name on every digest
+static const EVP_MD* sha3() {
+    static EVP_MD* md = EVP_MD_fetch(nullptr, "SHA3-256", nullptr);
+    return md;
+}
+
+// -------------------- Per-thread contexts --------------------
+
+namespace {
+struct CryptoContext {
+    EVP_MD_CTX* digest = EVP_MD_CTX_new();
+    EVP_MD_CTX* verify = EVP_MD_CTX_new();
+    unordered_map<string, EVP_PKEY*> keys; // hex public key -> parsed
+
+    ~CryptoContext() {
+        EVP_MD_CTX_free(digest);
+        EVP_MD_CTX_free(verify);
+        clearKeys();
+    }
+
+    void clearKeys() {
+        for (auto& entry : keys) {
+            EVP_PKEY_free(entry.second);
+        }
+        keys.clear();
+    }
+
+    EVP_PKEY* publicKey(const string& hex) {
+        auto it = keys.find(hex);
+        if (it != keys.end()) {
+            return it->second;
+        }
+        string raw = fromHex(hex, KEY_BYTES);
+        if (raw.empty()) {
+            return nullptr;
+        }
+        EVP_PKEY* key = EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, nullptr,
+                                                    reinterpret_cast<const unsigned char*>(raw.data()), raw.size());
+        if (!key) {
+            return nullptr;
+        }
+        if (keys.size() >= MAX_CACHED_KEYS) {
+            clearKeys();
+        }
+        keys.emplace(hex, key);
+        return key;
+    }
+
+    string hash(const Transaction& tx) {
+        // Length-prefixed fields, so no two bodies run together into the same bytes
+        string body;
+        auto field = [&](const string& value) {
+            body += to_string(value.size());
+            body += ':';
+            body += value;
+        };
+        field(tx.transaction_id);
+        field(tx.timestamp);
+        field(tx.sender);
+        field(tx.receiver);
+        field(to_string(llround(tx.amount * AMOUNT_SCALE)));
+        field(tx.unit);
+        field(to_string(llround(tx.price_per_unit * PRICE_SCALE)));
+        field(tx.currency);
+        field(to_string(tx.previous_transactions.size()));
+        for (const auto& parent : tx.previous_transactions) {
+            field(parent);
+        }
+        field(tx.sender_key);
+        return sha3Of(body);
+    }
+
+    ContentHash contentHash(const Transaction& tx) {
+        string content = hash(tx);
+        for (const string* value : {&tx.proof_of_work, &tx.sender_signature, &tx.receiver_key,
+                                    &tx.receiver_nonce, &tx.receiver_signature}) {
+            content += to_string(value->size());
+            content += ':';
+            content += *value;
+        }
+        ContentHash out{};
+        string digested = sha3Of(content);
+        copy_n(digested.begin(), min(digested.size(), out.size()), out.begin());
+        return out;
+    }
+
+    string sha3Of(const string& data) {
+        unsigned char out[EVP_MAX_MD_SIZE];
+        unsigned int length = 0;
+        if (!sha3() || EVP_DigestInit_ex(digest, sha3(), nullptr) != 1 ||
+            EVP_DigestUpdate(digest, data.data(), data.size()) != 1 ||
+            EVP_DigestFinal_ex(digest, out, &length) != 1) {
+            return "";
+        }
+        return string(reinterpret_cast<char*>(out), length);
+    }
+
+    bool check(EVP_PKEY* key, const string& message, const string& signature) {
+        EVP_MD_CTX_reset(verify);
+        return EVP_DigestVerifyInit(verify, nullptr, nullptr, nullptr, key) == 1 &&
+               EVP_DigestVerify(verify, reinterpret_cast<const unsigned char*>(signature.data()), signature.size(),
+                                reinterpret_cast<const unsigned char*>(message.data()), message.size()) == 1;
+    }
+
+    bool verifyTransaction(const Transaction& tx) {
+        EVP_PKEY* sender = publicKey(tx.sender_key);
+        EVP_PKEY* receiver = publicKey(tx.receiver_key);
+        string senderSignature = fromHex(tx.sender_signature, SIGNATURE_BYTES);
+        string receiverSignature = fromHex(tx.receiver_signature, SIGNATURE_BYTES);
+        string nonce = fromHex(tx.receiver_nonce, NONCE_BYTES);
+        if (!sender || !receiver || senderSignature.empty() || receiverSignature.empty() || nonce.empty()) {
+            return false;
+        }
+        string h = hash(tx);
+        return !h.empty() && check(sender, h, senderSignature) && check(receiver, h + nonce, receiverSignature);
+    }
+};
+
+CryptoContext& cryptoContext() {
+    thread_local CryptoContext context;
+    return context;
+}
+}
+
+// -------------------- Signing --------------------
+
+SigningKey SigningKey::generate() {
+    SigningKey out;
+    EVP_PKEY* key = nullptr;
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_ED25519, nullptr);
+    if (!ctx || EVP_PKEY_keygen_init(ctx) != 1 || EVP_PKEY_keygen(ctx, &key) != 1) {
+        cerr << "[ERROR] Ed25519 key generation failed" << endl;
+    }
+    EVP_PKEY_CTX_free(ctx);
+    out.key.reset(key, EVP_PKEY_free);
+    return out;
+}
+
+SigningKey SigningKey::fromSeed(const string& seed) {
+    SigningKey out;
+    EVP_PKEY* key = EVP_PKEY_new_raw_private_key(EVP_PKEY_ED25519, nullptr,
+                                                 reinterpret_cast<const unsigned char*>(seed.data()), seed.size());
+    if (!key) {
+        cerr << "[ERROR] Invalid Ed25519 private key" << endl;
+    }
+    out.key.reset(key, EVP_PKEY_free);
+    return out;
+}
+
+string SigningKey::publicKey() const {
+    unsigned char raw[KEY_BYTES];
+    size_t length = sizeof(raw);
+    if (!key || EVP_PKEY_get_raw_public_key(key.get(), raw, &length) != 1) {
+        return "";
+    }
+    return toHex(string(reinterpret_cast<char*>(raw), length));
+}
+
+string SigningKey::sign(const string& message) const {
+    unsigned char signature[SIGNATURE_BYTES];
+    size_t length = sizeof(signature);
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    bool ok = key && ctx && EVP_DigestSignInit(ctx, nullptr, nullptr, nullptr, key.get()) == 1 &&
+              EVP_DigestSign(ctx, signature, &length, reinterpret_cast<const unsigned char*>(message.data()),
+                             message.size()) == 1;
+    EVP_MD_CTX_free(ctx);
+    return ok ? string(reinterpret_cast<char*>(signature), length) : "";
+}
+
+string transactionHash(const Transaction& tx) {
+    return cryptoContext().hash(tx);
+}
+
+void signAsSender(Transaction& tx, const SigningKey& key) {
+    tx.amount = llround(tx.amount * AMOUNT_SCALE) / AMOUNT_SCALE;
+    tx.price_per_unit = llround(tx.price_per_unit * PRICE_SCALE) / PRICE_SCALE;
+    tx.sender_key = key.publicKey();
+    tx.sender_signature = toHex(key.sign(transactionHash(tx)));
+}
+
+void signAsReceiver(Transaction& tx, const SigningKey& key) {
+    unsigned char nonce[NONCE_BYTES];
+    if (RAND_bytes(nonce, sizeof(nonce)) != 1) {
+        cerr << "[ERROR] Could not draw the receiver nonce" << endl;
+        return;
+    }
+    string raw(reinterpret_cast<char*>(nonce), sizeof(nonce));
+    tx.receiver_key = key.publicKey();
+    tx.receiver_nonce = toHex(raw);
+    tx.receiver_signature = toHex(key.sign(transactionHash(tx) + raw));
+}
+
+bool verifyTransaction(const Transaction& tx) {
+    return cryptoContext().verifyTransaction(tx);
+}
+
+ContentHash contentHash(const Transaction& tx) {
+    return cryptoContext().contentHash(tx);
+}
+
+// -------------------- SignatureVerifier --------------------
+
+SignatureVerifier::SignatureVerifier(size_t workers, ValidationCache* cache) : outcomes(cache) {
+    for (size_t i = 0; i < max<size_t>(workers, 1); i++) {
+        threads.emplace_back(&SignatureVerifier::work, this);
+    }
+}
+
+SignatureVerifier::~SignatureVerifier() {
+    {
+        lock_guard<mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobReady.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+SignatureVerifier& SignatureVerifier::shared() {
+    static ValidationCache cache(DEFAULT_VALIDATION_CACHE_ENTRIES);
+    static SignatureVerifier verifier(max(thread::hardware_concurrency(), 1u), &cache);
+    return verifier;
+}
+
+double SignatureVerifier::verifyChunks(uint64_t& cached) {
+    double begin = threadCpuSeconds();
+    CryptoContext& context = cryptoContext();
+    const auto& txs = *batch;
+    for (size_t from = next.fetch_add(CHUNK); from < txs.size(); from = next.fetch_add(CHUNK)) {
+        for (size_t i = from; i < min(from + CHUNK, txs.size()); i++) {
+            if (!outcomes) {
+                (*results)[i] = context.verifyTransaction(*txs[i]);
+                continue;
+            }
+            ContentHash key = context.contentHash(*txs[i]);
+            uint8_t outcome = 0;
+            if (outcomes->lookup(key, outcome) && (outcome & (SIGNATURES_VALID | REJECTED))) {
+                (*results)[i] = (outcome & SIGNATURES_VALID) != 0;
+                cached++;
+                continue;
+            }
+            bool valid = context.verifyTransaction(*txs[i]);
+            outcomes->record(key, valid ? SIGNATURES_VALID : REJECTED);
+            (*results)[i] = valid;
+        }
+    }
+    return threadCpuSeconds() - begin;
+}
+
+void SignatureVerifier::work() {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            unique_lock<mutex> lock(jobMutex);
+            jobReady.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+        uint64_t cached = 0;
+        double spent = verifyChunks(cached);
+        {
+            lock_guard<mutex> lock(jobMutex);
+            counters.cpuSeconds += spent;
+            counters.cached += cached;
+            busy--;
+        }
+        jobDone.notify_one();
+    }
+}
+
+vector<bool> SignatureVerifier::verify(const vector<const Transaction*>& txs) {
+    vector<char> valid(txs.size(), 0);
+    lock_guard<mutex> call(callMutex);
+    {
+        unique_lock<mutex> lock(jobMutex);
+        batch = &txs;
+        results = &valid;
+        next = 0;
+        if (txs.size() < INLINE_BATCH) {
+            uint64_t cached = 0;
+            lock.unlock();
+            double spent = verifyChunks(cached);
+            lock.lock();
+            counters.cpuSeconds += spent;
+            counters.cached += cached;
+        } else {
+            busy = threads.size();
+            generation++;
+            jobReady.notify_all();
+            jobDone.wait(lock, [&] { return busy == 0; });
+        }
+        size_t passed = count(valid.begin(), valid.end(), 1);
+        counters.verified += passed;
+        counters.rejected += txs.size() - passed;
+        counters.batches++;
+    }
+    return vector<bool>(valid.begin(), valid.end());
+}
+
+vector<bool> SignatureVerifier::verify(const vector<Transaction>& txs) {
+    vector<const Transaction*> pointers;
+    pointers.reserve(txs.size());
+    for (const auto& tx : txs) {
+        pointers.push_back(&tx);
+    }
+    return verify(pointers);
+}
+
+VerifierStats SignatureVerifier::stats() const {
+    lock_guard<mutex> lock(jobMutex);
+    return counters;
+}
@@ -0,0 +1,287 @@
+#include "simradio.h"
+#include "sx126x.h"
+
+#include <cmath>
+#include <thread>
+#include <algorithm>
+
+static constexpr double KEEP_SETTLED = 10.0;    // seconds a settled packet is kept for overlap checks
+
+static const int AIR_SPEEDS[8] = {2400, 1200, 2400, 4800, 9600, 19200, 38400, 62500}; // by register code
+static const int POWERS_DBM[4] = {22, 17, 13, 10};
+
+// -------------------- SimSerial --------------------
+
+class SimSerial : public SerialTransport {
+public:
+    SimSerial(SimChannel& channel, size_t module) : channel(channel), module(module) {}
+
+    bool is_open() const override { return true; }
+    void set_mode(bool m0, bool m1) override { channel.setMode(module, m0, m1); }
+    int write(const uint8_t* data, size_t length) override { return channel.write(module, data, length); }
+    int available() override { return channel.available(module); }
+    int read(uint8_t* data, size_t length) override { return channel.read(module, data, length); }
+
+    bool wait_readable(std::chrono::milliseconds timeout) override {
+        return channel.waitReadable(module, timeout);
+    }
+
+    void wake() override { channel.wake(module); }
+
+    void sleep(std::chrono::milliseconds duration) override {
+        std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(duration.count() / speedup()));
+    }
+
+    double speedup() const override { return channel.config.speedup; }
+
+private:
+    SimChannel& channel;
+    size_t module;
+};
+
+// -------------------- SimChannel --------------------
+
+SimChannel::SimChannel(const SimRadioParams& params)
+    : config(params), epoch(std::chrono::steady_clock::now()), rng(params.seed) {}
+
+std::unique_ptr<SerialTransport> SimChannel::attach(double x, double y) {
+    std::lock_guard<std::mutex> lock(channelMutex);
+    auto m = std::make_unique<Module>();
+    m->x = x;
+    m->y = y;
+    modules.push_back(std::move(m));
+    return std::make_unique<SimSerial>(*this, modules.size() - 1);
+}
+
+TransportFactory SimChannel::factory(double x, double y) {
+    return [this, x, y](const std::string&, uint32_t) { return attach(x, y); };
+}
+
+double SimChannel::now() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - epoch).count() * config.speedup;
+}
+
+SimRadioStats SimChannel::stats() const {
+    std::lock_guard<std::mutex> lock(channelMutex);
+    return counters;
+}
+
+double SimChannel::airtime(size_t bytes, int airSpeed) {
+    return sx126x::air_time(bytes, airSpeed);
+}
+
+void SimChannel::setMode(size_t module, bool m0, bool m1) {
+    std::lock_guard<std::mutex> lock(channelMutex);
+    modules[module]->m0 = m0;
+    modules[module]->m1 = m1;
+}
+
+// Registers 0x00..0x08 as written after the C2 00 09 command
+void SimChannel::configure(Module& m, const uint8_t* regs) {
+    std::copy(regs, regs + m.regs.size(), m.regs.begin());
+    m.addr = static_cast<uint16_t>(regs[0] << 8 | regs[1]);
+    m.airSpeed = AIR_SPEEDS[regs[3] & 0x07];
+    m.powerDbm = POWERS_DBM[regs[4] & 0x03];
+    m.freqOffset = regs[5];
+    m.rssiByte = (regs[6] & 0x80) != 0;
+}
+
+int SimChannel::write(size_t module, const uint8_t* data, size_t length) {
+    std::lock_guard<std::mutex> lock(channelMutex);
+    Module& m = *modules[module];
+    double t = now();
+    settle(t);
+
+    if (m.m1 && !m.m0) {
+        // Configuration mode: set registers (C2) or read them back (C1); both answer C1 00 09 + registers
+        if (length >= 3 + m.regs.size() && data[0] == 0xC2 && data[1] == 0x00 && data[2] == 0x09) {
+            configure(m, data + 3);
+        } else if (!(length >= 3 && data[0] == 0xC1 && data[1] == 0x00 && data[2] == 0x09)) {
+            return static_cast<int>(length);
+        }
+        m.rx.insert(m.rx.end(), {0xC1, 0x00, 0x09});
+        m.rx.insert(m.rx.end(), m.regs.begin(), m.regs.end());
+        return static_cast<int>(length);
+    }
+    if (m.m0 || m.m1) {
+        return static_cast<int>(length); // WOR and sleep modes are not modelled
+    }
+
+    static const uint8_t RSSI_COMMAND[6] = {0xC0, 0xC1, 0xC2, 0xC3, 0x00, 0x02};
+    if (length == sizeof(RSSI_COMMAND) && std::equal(data, data + length, RSSI_COMMAND)) {
+        int noise = static_cast<int>(std::lround(channelRssi(module, t)));
+        m.rx.insert(m.rx.end(), {0xC1, 0x00, 0x02, static_cast<uint8_t>(256 + noise),
+                                 static_cast<uint8_t>(256 + m.lastRssi)});
+        return static_cast<int>(length);
+    }
+    if (length > 3) {
+        transmit(module, data, length, t);
+    }
+    return static_cast<int>(length);
+}
+
+// Queues the packet behind the module's own transmission in progress, then puts it on the air
+void SimChannel::transmit(size_t module, const uint8_t* data, size_t length, double now) {
+    Module& m = *modules[module];
+    Transmission tx;
+    tx.src = module;
+    tx.dest = static_cast<uint16_t>(data[0] << 8 | data[1]);
+    tx.freqOffset = data[2];
+    tx.airSpeed = m.airSpeed;
+    tx.payload.assign(data + 3, data + length);
+    tx.start = std::max(now, m.busyUntil);
+    tx.end = tx.start + airtime(tx.payload.size(), tx.airSpeed);
+    m.busyUntil = tx.end;
+
+    std::normal_distribution<double> fading(0.0, config.shadowingDb);
+    tx.rssiAt.resize(modules.size());
+    for (size_t r = 0; r < modules.size(); r++) {
+        double distance = std::max(1.0, std::hypot(modules[r]->x - m.x, modules[r]->y - m.y));
+        tx.rssiAt[r] = m.powerDbm - config.referenceLossDb - 10 * config.pathLossExponent * std::log10(distance);
+        if (config.shadowingDb > 0) {
+            tx.rssiAt[r] += fading(rng);
+        }
+    }
+
+    counters.sent++;
+    counters.airtime += tx.end - tx.start;
+    air.push_back(std::move(tx));
+    channelChanged.notify_all();
+}
+
+bool SimChannel::overlapsTransmission(size_t module, double start, double end) const {
+    for (const auto& other : air) {
+        if (other.src == module && other.start < end && start < other.end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Strongest signal on the module's channel right now, or the noise floor
+double SimChannel::channelRssi(size_t module, double now) const {
+    const Module& m = *modules[module];
+    double strongest = config.noiseFloorDbm;
+    for (const auto& tx : air) {
+        if (tx.src != module && tx.freqOffset == m.freqOffset && tx.start <= now && now < tx.end &&
+            module < tx.rssiAt.size()) {
+            strongest = std::max(strongest, tx.rssiAt[module]);
+        }
+    }
+    return strongest;
+}
+
+// Decides the fate of every packet that has finished by `now`, at every module
+void SimChannel::settle(double now) {
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+    for (auto& tx : air) {
+        if (tx.settled || tx.end > now) {
+            continue;
+        }
+        tx.settled = true;
+
+        for (size_t r = 0; r < modules.size() && r < tx.rssiAt.size(); r++) {
+            Module& m = *modules[r];
+            if (r == tx.src || m.m0 || m.m1 || m.freqOffset != tx.freqOffset || m.airSpeed != tx.airSpeed ||
+                (tx.dest != m.addr && tx.dest != 0xFFFF)) {
+                continue;
+            }
+
+            double rssi = tx.rssiAt[r];
+            double sensitivity = config.sensitivityDbm + 10 * std::log10(tx.airSpeed / 2400.0);
+            if (rssi < sensitivity) {
+                counters.weak++;
+                continue;
+            }
+            if (overlapsTransmission(r, tx.start, tx.end)) {
+                counters.deaf++;
+                continue;
+            }
+
+            bool collided = false;
+            for (const auto& other : air) {
+                if (&other != &tx && other.src != r && other.freqOffset == tx.freqOffset &&
+                    other.start < tx.end && tx.start < other.end && r < other.rssiAt.size() &&
+                    other.rssiAt[r] >= sensitivity && rssi - other.rssiAt[r] < config.captureDb) {
+                    collided = true;
+                    break;
+                }
+            }
+            if (collided) {
+                counters.collided++;
+                continue;
+            }
+            if (chance(rng) < config.lossRate) {
+                counters.dropped++;
+                continue;
+            }
+
+            int rssiDbm = static_cast<int>(std::lround(rssi));
+            m.rx.insert(m.rx.end(), tx.payload.begin(), tx.payload.end());
+            if (m.rssiByte) {
+                m.rx.push_back(static_cast<uint8_t>(256 + std::max(rssiDbm, -255)));
+            }
+            m.lastRssi = rssiDbm;
+            counters.delivered++;
+        }
+    }
+
+    while (!air.empty() && air.front().settled && air.front().end < now - KEEP_SETTLED) {
+        air.pop_front();
+    }
+}
+
+int SimChannel::available(size_t module) {
+    std::lock_guard<std::mutex> lock(channelMutex);
+    settle(now());
+    return static_cast<int>(modules[module]->rx.size());
+}
+
+int SimChannel::read(size_t module, uint8_t* data, size_t length) {
+    std::lock_guard<std::mutex> lock(channelMutex);
+    settle(now());
+    auto& rx = modules[module]->rx;
+    size_t n = std::min(length, rx.size());
+    std::copy(rx.begin(), rx.begin() + n, data);
+    rx.erase(rx.begin(), rx.begin() + n);
+    return static_cast<int>(n);
+}
+
+// Sleeps until the next packet on the air ends (it may be for this module), a new one starts, or a wake
+bool SimChannel::waitReadable(size_t module, std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::unique_lock<std::mutex> lock(channelMutex);
+    Module& m = *modules[module];
+    while (true) {
+        double t = now();
+        settle(t);
+        if (!m.rx.empty() || m.woken) {
+            m.woken = false;
+            return !m.rx.empty();
+        }
+
+        double nextEnd = -1;
+        for (const auto& tx : air) {
+            if (!tx.settled && (nextEnd < 0 || tx.end < nextEnd)) {
+                nextEnd = tx.end;
+            }
+        }
+        auto wakeAt = deadline;
+        if (nextEnd >= 0) {
+            auto untilEnd = std::chrono::duration<double>((nextEnd - t) / config.speedup);
+            wakeAt = std::min(wakeAt, std::chrono::steady_clock::now() +
+                                          std::chrono::duration_cast<std::chrono::steady_clock::duration>(untilEnd));
+        }
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        channelChanged.wait_until(lock, wakeAt);
+    }
+}
+
+void SimChannel::wake(size_t module) {
+    std::lock_guard<std::mutex> lock(channelMutex);
+    modules[module]->woken = true;
+    channelChanged.notify_all();
+}
@@ -1,13 +1,10 @@
 // sx126x_driver.cpp
 //
 // C++ rewrite of the Python SX1268 driver code.
-// This implementation uses the pigpio library for GPIO and serial operations.
-// Make sure to link against libpigpio (e.g., compile with `-lpigpio -lrt -lpthread`).
+// UART and mode-pin access goes through a SerialTransport (serial.h), so the
+// same driver runs against the pigpio HAT backend or the simulated radio.
 //
-// Before using any sx126x instance, call `gpioInitialise()` in your main()
-// (and call `gpioTerminate()` before exiting your program).
-//
-// Note: Error checking (e.g., return codes from pigpio functions) is minimal
+// Note: Error checking (e.g., return codes from the transport) is minimal
 //       for clarity. In production code, you should check for failures and handle them.
 
 #include "sx126x.h"
@@ -15,20 +12,28 @@
 #include <iostream>
 #include <thread>
 #include <chrono>
-
-// #include <pigpio.h>    // pigpio for GPIO + UART
-extern "C" {
-    #include <pigpio.h>
-}
-
-void serialFlush(int handle) {
-    while (serDataAvailable(handle) > 0) {
-        serReadByte(handle); // discard incoming data
+#include <algorithm>
+#include <cmath>
+
+static constexpr uint8_t LINK_SYNC = 0xA5;  // marks the start of a packet's length field
+static constexpr size_t FRAME_PREFIX = 5;   // src_high, src_low, freq_offset, sync, length
+static constexpr size_t AIR_OVERHEAD = 13;  // preamble, sync word, header and CRC, in byte times
+static constexpr int UART_BITS_PER_BYTE = 10; // 8N1
+static constexpr size_t RSSI_REPLY_SIZE = 5;  // 0xC1 0x00 0x02 noise last_packet
+static constexpr auto RSSI_REPLY_WAIT = std::chrono::milliseconds(100);
+static constexpr double REFERENCE_SENSITIVITY = -124.0; // dBm at 2400 bps
+
+static void serialFlush(SerialTransport& port) {
+    uint8_t discard[64];
+    while (port.available() > 0) {
+        if (port.read(discard, sizeof(discard)) <= 0) { // discard incoming data
+            break;
+        }
     }
 }
 // -------------------- Constructor & Destructor --------------------
 
-sx126x::sx126x(const std::string& serial_num,
+sx126x::sx126x(std::unique_ptr<SerialTransport> transport,
                int freq,
                uint16_t addr,
                int power,
@@ -42,11 +47,17 @@ sx126x::sx126x(const std::string& serial_num,
                bool wor)
     : rssi(rssi),
       addr(addr),
-      serial_n(serial_num),
+      port(std::move(transport)),
+      baudrate(9600),
       power(power),
       freq(freq),
-      baudrate(9600),
+      air_speed(air_speed),
+      normal_mode(false),
+      rssi_pending(false),
       cfg_reg{ 0xC2,0x00,0x09,0x00,0x00,0x00,0x62,0x00,0x12,0x43,0x00,0x00 },
+      cfg_applied(false),
+      rx_head(0),
+      rx_size(0),
       // initialize dictionaries:
       lora_air_speed_dic{
         {1200, 0x01},
@@ -70,30 +81,43 @@ sx126x::sx126x(const std::string& serial_num,
         {32,  SX126X_PACKAGE_SIZE_32_BYTE}
       }
 {
-    // Initialize GPIO (M0 / M1) to output mode
-    gpioSetMode(M0, PI_OUTPUT);
-    gpioSetMode(M1, PI_OUTPUT);
-
-    // Ensure M0=LOW, M1=HIGH to enter “configuration” mode initially
-    gpioWrite(M0, PI_LOW);
-    gpioWrite(M1, PI_HIGH);
-
-    // Open UART at 9600 baud (for initial config)
-    serial_handle = serOpen(const_cast<char*>(serial_n.c_str()), baudrate, 0);
-    if (serial_handle < 0) {
-        std::cerr << "Failed to open serial port " << serial_n << std::endl;
+    if (!is_open()) {
+        std::cerr << "Failed to open serial port" << std::endl;
         return;
     }
-    serialFlush(serial_handle);
+    // Ensure M0=LOW, M1=HIGH to enter “configuration” mode initially
+    set_mode(false, true);
+    serialFlush(*port);
 
     // Apply initial settings
     set(freq, addr, power, rssi, air_speed, net_id, buffer_size, crypt, relay, lbt, wor);
 }
 
-sx126x::~sx126x() {
-    if (serial_handle >= 0) {
-        serClose(serial_handle);
-    }
+sx126x::~sx126x() = default;
+
+bool sx126x::is_open() const {
+    return port && port->is_open();
+}
+
+double sx126x::speedup() const {
+    return port ? port->speedup() : 1.0;
+}
+
+double sx126x::air_time(size_t bytes, int air_speed) {
+    return (bytes + AIR_OVERHEAD) * 8.0 / air_speed;
+}
+
+double sx126x::time_on_air(size_t length) const {
+    return air_time(length - std::min<size_t>(length, 3) + FRAME_PREFIX, air_speed);
+}
+
+double sx126x::send_time(size_t length) const {
+    return static_cast<double>(length + FRAME_PREFIX) * UART_BITS_PER_BYTE / baudrate + time_on_air(length);
+}
+
+void sx126x::set_mode(bool m0, bool m1) {
+    port->set_mode(m0, m1);
+    normal_mode = !m0 && !m1;
 }
 
 // -------------------- set(...) Method --------------------
@@ -115,11 +139,7 @@ void sx126x::set(int freq,
     this->power = power;
     this->freq = freq;
     this->rssi = rssi;
-
-    // Enter “configuration” mode: M0=0, M1=1
-    gpioWrite(M0, PI_LOW);
-    gpioWrite(M1, PI_HIGH);
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    this->air_speed = lora_air_speed_dic.count(air_speed) ? air_speed : 2400;
 
     // Split address into high / low byte
     uint8_t low_addr  = static_cast<uint8_t>(addr & 0x00FF);
@@ -162,6 +182,8 @@ void sx126x::set(int freq,
 
     // RSSI bit (0x80 if we want packet-RSSI appended; 0x00 otherwise)
     uint8_t rssi_temp = (rssi ? 0x80 : 0x00);
+    // LBT bit (0x10): the module itself waits for a quiet channel before sending
+    uint8_t lbt_temp = (lbt ? 0x10 : 0x00);
 
     // Split 16-bit crypt key into high / low byte
     uint8_t h_crypt = static_cast<uint8_t>((crypt >> 8) & 0x00FF);
@@ -175,41 +197,53 @@ void sx126x::set(int freq,
         // Byte 7: buffer_size + power + 0x20 (enable noise RSSI read)
         cfg_reg[7]  = static_cast<uint8_t>(buffer_size_temp + power_temp + 0x20);
         cfg_reg[8]  = freq_temp;
-        // Byte 9: base=0x43, plus rssi_temp if packet-RSSI is desired
-        cfg_reg[9]  = static_cast<uint8_t>(0x43 + rssi_temp);
+        // Byte 9: base=0x43, plus rssi_temp if packet-RSSI is desired and lbt_temp for module LBT
+        cfg_reg[9]  = static_cast<uint8_t>(0x43 + rssi_temp + lbt_temp);
         cfg_reg[10] = h_crypt;
         cfg_reg[11] = l_crypt;
     }
     else {
-        // Relay mode uses fixed addresses 0x01,0x02,0x03 (example)
-        cfg_reg[3]  = 0x01;
-        cfg_reg[4]  = 0x02;
-        cfg_reg[5]  = 0x03;
+        // Relay mode (REG3 bit 5): the module repeats every packet between the network in net_id and
+        // the one in the low address byte, and has no address of its own. It cannot route, so
+        // multi-hop traffic goes through the mesh layer (mesh.h) in normal mode; this suits a fixed
+        // repeater between two networks. Fixed transmission stays on so packets keep their
+        // addressing bytes.
+        cfg_reg[3]  = net_id_temp;
+        cfg_reg[4]  = low_addr;
+        cfg_reg[5]  = net_id_temp;
         cfg_reg[6]  = SX126X_UART_BAUDRATE_9600 + air_speed_temp;
         cfg_reg[7]  = static_cast<uint8_t>(buffer_size_temp + power_temp + 0x20);
         cfg_reg[8]  = freq_temp;
-        cfg_reg[9]  = static_cast<uint8_t>(0x03 + rssi_temp);
+        cfg_reg[9]  = static_cast<uint8_t>(0x43 + 0x20 + rssi_temp + lbt_temp);
         cfg_reg[10] = h_crypt;
         cfg_reg[11] = l_crypt;
     }
 
-    serialFlush(serial_handle);
+    // Registers already hold exactly this configuration: skip the mode switch and round trip
+    if (!is_open() || (cfg_applied && cfg_reg == applied_reg)) {
+        return;
+    }
+
+    // Enter “configuration” mode: M0=0, M1=1
+    set_mode(false, true);
+    port->sleep(std::chrono::milliseconds(100));
+
+    serialFlush(*port);
+    rx_head = rx_size = 0;
 
     // Try sending configuration up to 2 times if needed
     for (int attempt = 0; attempt < 2; ++attempt) {
-        serWrite(serial_handle,
-                    reinterpret_cast<char*>(cfg_reg.data()),
-                    cfg_reg.size());
-        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        port->write(cfg_reg.data(), cfg_reg.size());
+        port->sleep(std::chrono::milliseconds(200));
 
-        int available = serDataAvailable(serial_handle);
+        int available = port->available();
         if (available > 0) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            port->sleep(std::chrono::milliseconds(100));
             std::vector<uint8_t> r_buff(available, 0);
-            int read_bytes = serRead(serial_handle,
-                                       reinterpret_cast<char*>(r_buff.data()),
-                                       available);
+            int read_bytes = port->read(r_buff.data(), available);
             if (read_bytes > 0 && r_buff[0] == 0xC1) {
+                applied_reg = cfg_reg;
+                cfg_applied = true;
                 std::cout << "Parameters setting is: ";
                 for (auto byte : cfg_reg) {
                     std::cout << std::hex << static_cast<int>(byte) << " ";
@@ -233,8 +267,8 @@ void sx126x::set(int freq,
         }
         else {
             std::cout << "Setting fail, setting again..." << std::endl;
-            serialFlush(serial_handle);
-            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            serialFlush(*port);
+            port->sleep(std::chrono::milliseconds(200));
             if (attempt == 1) {
                 std::cout << "Setting fail, press Esc to exit and run again." << std::endl;
             }
@@ -242,30 +276,27 @@ void sx126x::set(int freq,
     }
 
     // Return to normal UART mode: M0=0, M1=0
-    gpioWrite(M0, PI_LOW);
-    gpioWrite(M1, PI_LOW);
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    set_mode(false, false);
+    port->sleep(std::chrono::milliseconds(100));
 }
 
 // -------------------- get_settings() --------------------
 
 void sx126x::get_settings() {
     // Enter “get setting” mode: M1=HIGH
-    gpioWrite(M1, PI_HIGH);
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    set_mode(false, true);
+    port->sleep(std::chrono::milliseconds(100));
 
     // Send the “get setting” command (3 bytes)
     uint8_t cmd[3] = { 0xC1, 0x00, 0x09 };
-    serWrite(serial_handle, reinterpret_cast<char*>(cmd), 3);
+    port->write(cmd, 3);
 
     // Wait and read response
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    int available = serDataAvailable(serial_handle);
+    port->sleep(std::chrono::milliseconds(100));
+    int available = port->available();
     if (available > 0) {
         get_reg.resize(available);
-        serRead(serial_handle,
-                   reinterpret_cast<char*>(get_reg.data()),
-                   available);
+        port->read(get_reg.data(), available);
     }
 
     // Parse & print if the response is valid
@@ -301,131 +332,176 @@ void sx126x::get_settings() {
         std::cout << "Power is " << power_dbm << " dBm" << std::endl;
 
         // Exit “get setting” mode
-        gpioWrite(M1, PI_LOW);
+        set_mode(false, false);
     }
     else {
         std::cout << "Failed to get settings or invalid response." << std::endl;
-        gpioWrite(M1, PI_LOW);
+        set_mode(false, false);
     }
 }
 
 // -------------------- send(...) --------------------
 
 void sx126x::send(const std::vector<uint8_t>& data) {
-    // Ensure normal TX mode: M0=0, M1=0
-    gpioWrite(M0, PI_LOW);
-    gpioWrite(M1, PI_LOW);
-    std::this_thread::sleep_for(std::chrono::milliseconds(50));
-
-    if (!data.empty()) {
-        serWrite(serial_handle,
-                    const_cast<char*>(reinterpret_cast<const char*>(data.data())),
-                    data.size());
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    if (data.size() < 3 || data.size() - 3 > MAX_PACKET_PAYLOAD) {
+        std::cerr << "Packet of " << data.size() << " bytes not sent" << std::endl;
+        return;
+    }
+
+    // Ensure normal TX mode: M0=0, M1=0; settle only after an actual switch
+    if (!normal_mode) {
+        set_mode(false, false);
+        port->sleep(std::chrono::milliseconds(50));
+    }
+
+    // [dest_high, dest_low, freq_offset] + [src_high, src_low, src_freq_offset, sync, length] + payload
+    std::vector<uint8_t> frame(data.begin(), data.begin() + 3);
+    frame.push_back(static_cast<uint8_t>(addr >> 8));
+    frame.push_back(static_cast<uint8_t>(addr & 0xFF));
+    frame.push_back(static_cast<uint8_t>(offset_freq));
+    frame.push_back(LINK_SYNC);
+    frame.push_back(static_cast<uint8_t>(data.size() - 3));
+    frame.insert(frame.end(), data.begin() + 3, data.end());
+
+    // No settle delay: the caller paces packets by send_time(), so the next write waits for this one
+    port->write(frame.data(), frame.size());
+}
+
+// -------------------- receive path --------------------
+
+void sx126x::on_packet(std::function<void(const LoraPacket&)> handler) {
+    packet_handler = std::move(handler);
+}
+
+void sx126x::wake() {
+    if (port) {
+        port->wake();
     }
 }
 
-// -------------------- receive() --------------------
+uint8_t sx126x::ring_at(size_t index) const {
+    return rx_ring[(rx_head + index) % RX_RING_SIZE];
+}
 
-std::string sx126x::receive() {
-    int available = serDataAvailable(serial_handle);
-    if (available > 0) {
-        // Give the module time to finish sending bytes
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
-        int new_available = serDataAvailable(serial_handle);
-        if (new_available <= 0) return "";
-
-        std::vector<uint8_t> r_buff(new_available, 0);
-        int read_bytes = serRead(serial_handle,
-                                   reinterpret_cast<char*>(r_buff.data()),
-                                   new_available);
-        if (read_bytes <= 0) return "";
-
-        // First two bytes = source address
-        uint16_t src_addr = (static_cast<uint16_t>(r_buff[0]) << 8)
-                          | static_cast<uint16_t>(r_buff[1]);
-        // Third byte = frequency offset
-        int freq_mhz = static_cast<int>(r_buff[2]) + start_freq;
-
-        std::cout << "Received message from node address with frequency "
-                  << src_addr << "," << freq_mhz << ".125 MHz" << std::endl;
-
-        // Payload = bytes [3 .. (len-2)] (last byte is packet RSSI)
-        if (r_buff.size() > 4) {
-            std::vector<uint8_t> payload(r_buff.begin() + 3,
-                                         r_buff.end() - 1);
-            std::string payload_str(payload.begin(), payload.end());
-            std::cout << "Message is " << payload_str << std::endl;
-
-            return payload_str;
-        }
+void sx126x::ring_drop(size_t count) {
+    rx_head = (rx_head + count) % RX_RING_SIZE;
+    rx_size -= count;
+}
 
-        // If RSSI mode is on, interpret last byte
-        // if (rssi) {
-        //     uint8_t packet_rssi = r_buff.back();
-        //     std::cout << "The packet RSSI value: -"
-        //               << static_cast<int>(256 - packet_rssi)
-        //               << " dBm" << std::endl;
-        //     get_channel_rssi();
-        // }
+// Moves everything the UART holds into the ring, in at most two contiguous reads per pass
+void sx126x::fill_ring() {
+    while (rx_size < RX_RING_SIZE && port->available() > 0) {
+        size_t tail = (rx_head + rx_size) % RX_RING_SIZE;
+        size_t space = std::min(RX_RING_SIZE - rx_size, RX_RING_SIZE - tail);
+        int n = port->read(rx_ring.data() + tail, space);
+        if (n <= 0) {
+            break;
+        }
+        rx_size += n;
     }
 }
 
-// -------------------- get_channel_rssi() --------------------
+// Each packet arrives as [src_high, src_low, freq_offset, sync, length, payload…, rssi?]
+int sx126x::deliver_packets() {
+    int delivered = 0;
+    while (rx_size >= FRAME_PREFIX) {
+        if (rssi_pending && ring_at(0) == 0xC1 && ring_at(1) == 0x00 && ring_at(2) == 0x02) {
+            break; // get_channel_rssi() takes it
+        }
+        size_t length = ring_at(4);
+        if (ring_at(3) != LINK_SYNC || length > MAX_PACKET_PAYLOAD) {
+            ring_drop(1); // not a packet boundary: resynchronise
+            continue;
+        }
+        size_t total = FRAME_PREFIX + length + (rssi ? 1 : 0);
+        if (rx_size < total) {
+            break;
+        }
 
-void sx126x::get_channel_rssi() {
-    // Ensure normal mode: M0=0, M1=0
-    gpioWrite(M0, PI_LOW);
-    gpioWrite(M1, PI_LOW);
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        LoraPacket packet;
+        packet.src = static_cast<uint16_t>(ring_at(0) << 8 | ring_at(1));
+        packet.freq = static_cast<int>(ring_at(2)) + start_freq;
+        packet.payload.resize(length);
+        for (size_t i = 0; i < length; i++) {
+            packet.payload[i] = ring_at(FRAME_PREFIX + i);
+        }
+        packet.rssi = rssi ? -(256 - static_cast<int>(ring_at(total - 1))) : 0;
+        ring_drop(total);
 
-    serialFlush(serial_handle);
+        if (packet_handler) {
+            packet_handler(packet);
+        }
+        delivered++;
+    }
+    return delivered;
+}
 
-    // Send “get RSSI” command (6 bytes)
-    uint8_t cmd[6] = { 0xC0, 0xC1, 0xC2, 0xC3, 0x00, 0x02 };
-    serWrite(serial_handle, reinterpret_cast<char*>(cmd), 6);
+int sx126x::poll(std::chrono::milliseconds timeout) {
+    if (!is_open()) {
+        return 0;
+    }
+    if (port->available() <= 0 && !port->wait_readable(timeout)) {
+        return 0;
+    }
+    fill_ring();
+    return deliver_packets();
+}
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+// -------------------- get_channel_rssi() --------------------
 
-    int available = serDataAvailable(serial_handle);
-    if (available > 0) {
-        std::vector<uint8_t> re_temp(available, 0);
-        serRead(serial_handle,
-                   reinterpret_cast<char*>(re_temp.data()),
-                   available);
-
-        // Expect at least 4 bytes: [0xC1, 0x00, 0x02, noise_rssi, packet_rssi?]
-        if (re_temp.size() >= 4
-            && re_temp[0] == 0xC1
-            && re_temp[1] == 0x00
-            && re_temp[2] == 0x02)
-        {
-            uint8_t noise_rssi = re_temp[3];
-            std::cout << "Current noise RSSI value: -"
-                      << static_cast<int>(256 - noise_rssi)
-                      << " dBm" << std::endl;
-            // re_temp[4] (if present) is the last packet’s RSSI
+// The reply [0xC1, 0x00, 0x02, noise, last_packet] arrives in the same UART stream as packets, so
+// packets already buffered are delivered first and the reply is then picked off the head of the ring
+bool sx126x::get_channel_rssi(int& noise_dbm) {
+    if (!is_open()) {
+        return false;
+    }
+    if (!normal_mode) {
+        set_mode(false, false);
+        port->sleep(std::chrono::milliseconds(100));
+    }
+    fill_ring();
+    deliver_packets();
+
+    static const uint8_t cmd[6] = { 0xC0, 0xC1, 0xC2, 0xC3, 0x00, 0x02 };
+    rssi_pending = true;
+    port->write(cmd, sizeof(cmd));
+
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::duration_cast<std::chrono::steady_clock::duration>(RSSI_REPLY_WAIT / speedup());
+    bool replied = false;
+    while (true) {
+        fill_ring();
+        deliver_packets(); // stops at the reply
+        if (rx_size >= RSSI_REPLY_SIZE && ring_at(0) == 0xC1 && ring_at(1) == 0x00 && ring_at(2) == 0x02) {
+            noise_dbm = -(256 - static_cast<int>(ring_at(3)));
+            ring_drop(RSSI_REPLY_SIZE);
+            replied = true;
+            break;
         }
-        else {
-            std::cout << "Receive RSSI value fail" << std::endl;
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            break;
         }
+        port->wait_readable(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now) +
+                            std::chrono::milliseconds(1));
     }
-    else {
-        std::cout << "No RSSI response received" << std::endl;
+    rssi_pending = false;
+    if (!replied) {
+        std::cerr << "[ERROR] No RSSI response received" << std::endl;
     }
+    return replied;
+}
+
+double sx126x::sensitivity_dbm(int air_speed) {
+    return REFERENCE_SENSITIVITY + 10 * std::log10(static_cast<double>(air_speed) / 2400);
 }
 ; // end class sx126x
 
 
 // Example usage:
 // int main() {
-//     if (gpioInitialise() < 0) {
-//         std::cerr << "pigpio initialization failed" << std::endl;
-//         return 1;
-//     }
-//
 //     // Create SX126X instance (e.g., freq=868 MHz, address=0x1234, power=22dBm, rssi enabled)
-//     sx126x lora("/dev/ttyS0", 868, 0x1234, 22, true, 2400, 0, 240, 0, false, false, false);
+//     sx126x lora(openPigpioSerial("/dev/ttyS0", 9600), 868, 0x1234, 22, true, 2400, 0, 240, 0, false, false, false);
 //
 //     // Send a test packet (dest addr high, dest addr low, freq offset, payload)
 //     std::vector<uint8_t> packet;
@@ -436,12 +512,12 @@ void sx126x::get_channel_rssi() {
 //     packet.insert(packet.end(), msg.begin(), msg.end());
 //     lora.send(packet);
 //
-//     // Periodically call receive()
+//     // Print packets as they arrive
+//     lora.on_packet([](const LoraPacket& p) {
+//         std::cout << "From " << p.src << ": " << std::string(p.payload.begin(), p.payload.end()) << std::endl;
+//     });
 //     while (true) {
-//         lora.receive();
-//         std::this_thread::sleep_for(std::chrono::milliseconds(200));
+//         lora.poll(std::chrono::milliseconds(1000));
 //     }
-//
-//     gpioTerminate();
 //     return 0;
 // }
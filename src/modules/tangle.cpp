@@ -2,53 +2,211 @@
 #include "../headers/transaction.h"
 #include <iostream>
 #include <sstream>
+#include <atomic>
+#include <algorithm>
+#include <iomanip>
 
 using namespace std;
 
+static atomic<uint64_t> nextVersion{1};
+
 void Tangle::addTransaction(const Transaction& tx) {
-    transactions[tx.transaction_id] = tx;
+    addTransaction(tx, TipPool::Clock::now());
+}
+
+void Tangle::addTransaction(const Transaction& tx, TipPool::Clock::time_point arrivedAt) {
+    auto it = entries.find(tx.transaction_id);
+    if (it == entries.end()) {
+        entries.emplace(tx.transaction_id, tx);
+        indexApprovals(tx, arrivedAt);
+        inserted++;
+        encodeRecord(tx);
+        return;
+    }
+    // Known: the content stays as first accepted, when its signatures were checked. Only the weight,
+    // which grows as approvers arrive, is taken from a peer that has counted more of them
+    if (tx.cumulative_weight > it->second.cumulative_weight) {
+        it->second.cumulative_weight = tx.cumulative_weight;
+        touchParents(it->second);
+        auto record = records.find(tx.transaction_id);
+        if (record != records.end()) {
+            record->second.weight = to_string(tx.cumulative_weight);
+        }
+    }
+}
+
+void Tangle::indexApprovals(const Transaction& tx, TipPool::Clock::time_point arrivedAt) {
+    size_t height = 0;
+    for (const auto& parent : tx.previous_transactions) {
+        approvers[parent].push_back(tx.transaction_id);
+        versions[parent] = nextVersion++;
+        tipPool.approved(parent);
+        auto known = heights.find(parent);
+        if (known != heights.end()) {
+            height = max(height, known->second + 1);
+        }
+    }
+    setHeight(tx.transaction_id, height);
+    if (approversOf(tx.transaction_id).empty()) {
+        tipPool.arrived(tx.transaction_id, arrivedAt); // unless its approvers arrived first
+    }
+
+    // Children that arrived first were counted from a lower base; raise them and their own approvers
+    vector<string> raised{tx.transaction_id};
+    while (!raised.empty()) {
+        string id = move(raised.back());
+        raised.pop_back();
+        size_t above = heights[id] + 1;
+        for (const auto& child : approversOf(id)) {
+            auto known = heights.find(child);
+            if (known != heights.end() && known->second < above) {
+                setHeight(child, above);
+                raised.push_back(child);
+            }
+        }
+    }
 }
+
+void Tangle::setHeight(const string& id, size_t height) {
+    auto known = heights.find(id);
+    if (known != heights.end()) {
+        auto& level = levels[known->second];
+        level.erase(find(level.begin(), level.end(), id));
+        known->second = height;
+    } else {
+        heights.emplace(id, height);
+    }
+    if (levels.size() <= height) {
+        levels.resize(height + 1);
+    }
+    levels[height].push_back(id);
+}
+
+void Tangle::touchParents(const Transaction& tx) {
+    for (const auto& parent : tx.previous_transactions) {
+        versions[parent] = nextVersion++;
+    }
+}
+
+const vector<string>& Tangle::approversOf(const string& id) const {
+    static const vector<string> none;
+    auto it = approvers.find(id);
+    return it != approvers.end() ? it->second : none;
+}
+
+uint64_t Tangle::approvalVersion(const string& id) const {
+    auto it = versions.find(id);
+    return it != versions.end() ? it->second : 0;
+}
+
+size_t Tangle::heightOf(const string& id) const {
+    auto it = heights.find(id);
+    return it != heights.end() ? it->second : 0;
+}
+
+const vector<string>& Tangle::entryPoints() const {
+    static const vector<string> none;
+    if (levels.empty()) {
+        return none;
+    }
+    size_t top = levels.size() - 1;
+    return levels[top > walkDepth ? top - walkDepth : 0];
+}
+
+void Tangle::setEntryDepth(size_t depth) {
+    walkDepth = depth;
+}
+
 void Tangle::updateCumulativeWeight(const std::string& transaction_id) {
-    transactions[transaction_id].cumulative_weight++;
+    auto tx = entries.find(transaction_id);
+    if (tx == entries.end()) {
+        return;
+    }
+    int weight = ++tx->second.cumulative_weight;
+    touchParents(tx->second);
+
+    // Patch the weight slice of the cached record in place
+    auto it = records.find(transaction_id);
+    if (it != records.end()) {
+        it->second.weight = to_string(weight);
+    }
+}
+
+// Formats a transaction once; serialize() only copies the cached slices afterwards
+void Tangle::encodeRecord(const Transaction& tx) {
+    EncodedRecord& rec = records[tx.transaction_id];
+    stringstream ss;
+
+    // Amount and price at full precision: they are signed (signature.h)
+    ss << setprecision(15)
+       << tx.transaction_id << ","
+       << tx.timestamp << ","
+       << tx.sender << ","
+       << tx.receiver << ","
+       << tx.amount << ","
+       << tx.unit << ","
+       << tx.price_per_unit << ","
+       << tx.currency << ",";
+    rec.head = ss.str();
+    rec.weight = to_string(tx.cumulative_weight);
+
+    ss.str("");
+    ss << "," << tx.proof_of_work;
+
+    // Serialize previous transactions
+    ss << ",[";
+    for (size_t i = 0; i < tx.previous_transactions.size(); i++) {
+        ss << tx.previous_transactions[i];
+        if (i < tx.previous_transactions.size() - 1) ss << ";";
+    }
+    ss << "]";
+
+    // Serialize validating transactions
+    ss << ",[";
+    for (size_t i = 0; i < tx.validating_transactions.size(); i++) {
+        ss << tx.validating_transactions[i];
+        if (i < tx.validating_transactions.size() - 1) ss << ";";
+    }
+    ss << "]";
+
+    ss << "," << tx.sender_key << "," << tx.sender_signature << "," << tx.receiver_key << ","
+       << tx.receiver_nonce << "," << tx.receiver_signature << "\n";
+    rec.tail = ss.str();
 }
 
 // Serializes the Tangle's transactions into a string format
 string Tangle::serialize() const {
-    stringstream ss;
+    // The records are already encoded: one pass to size the output, one to copy them in
+    size_t total = 0;
+    for (const auto& [txID, rec] : records) {
+        total += rec.head.size() + rec.weight.size() + rec.tail.size();
+    }
 
-    for (const auto& [txID, tx] : transactions) { // transactions is the Tangle's storage map
-        ss << tx.transaction_id << ","
-           << tx.timestamp << ","
-           << tx.sender << ","
-           << tx.receiver << ","
-           << tx.amount << ","
-           << tx.unit << ","
-           << tx.price_per_unit << ","
-           << tx.currency << ","
-           << tx.cumulative_weight << ","
-           << tx.proof_of_work;
-
-        // Serialize previous transactions
-        ss << ",[";
-        for (size_t i = 0; i < tx.previous_transactions.size(); i++) {
-            ss << tx.previous_transactions[i];
-            if (i < tx.previous_transactions.size() - 1) ss << ";";
-        }
-        ss << "]";
+    string out;
+    out.reserve(total);
+    for (const auto& [txID, rec] : records) {
+        out += rec.head;
+        out += rec.weight;
+        out += rec.tail;
+    }
+    return out;
+}
 
-        // Serialize validating transactions
-        ss << ",[";
-        for (size_t i = 0; i < tx.validating_transactions.size(); i++) {
-            ss << tx.validating_transactions[i];
-            if (i < tx.validating_transactions.size() - 1) ss << ";";
-        }
-        ss << "]\n";
+string Tangle::serialize(const vector<string>& ids) const {
+    string out;
+    for (const auto& id : ids) {
+        auto it = records.find(id);
+        if (it == records.end()) continue;
+        out += it->second.head;
+        out += it->second.weight;
+        out += it->second.tail;
     }
-    return ss.str();
+    return out;
 }
 
-// Updates the Tangle from a serialized string
-void Tangle::updateFromSerialized(const string& data) {
+// Parses serialized transactions without touching the Tangle
+vector<Transaction> Tangle::parseSerialized(const string& data) {
+    vector<Transaction> parsed;
     stringstream ss(data);
     string line;
 
@@ -94,10 +252,25 @@ void Tangle::updateFromSerialized(const string& data) {
             newTx.validating_transactions.push_back(validTx);
         }
 
+        // Signatures; absent from lines written before they were
+        getline(linestream, newTx.sender_key, ',');
+        getline(linestream, newTx.sender_signature, ',');
+        getline(linestream, newTx.receiver_key, ',');
+        getline(linestream, newTx.receiver_nonce, ',');
+        getline(linestream, newTx.receiver_signature, ',');
+
+        parsed.push_back(move(newTx));
+    }
+    return parsed;
+}
+
+// Updates the Tangle from a serialized string
+void Tangle::updateFromSerialized(const string& data) {
+    for (const auto& tx : parseSerialized(data)) {
         // Add the new transaction to the Tangle
-        transactions[newTx.transaction_id] = newTx;
+        addTransaction(tx);
     }
-    
+
     cout << "[LOG] Tangle updated from received data." << endl;
 }
 
@@ -0,0 +1,129 @@
+#include "../headers/tippool.h"
+#include <algorithm>
+using namespace std;
+
+TipPool::TipPool(TipPoolConfig config) : settings(config), wheel(max<size_t>(config.slots, 1)) {
+    if (settings.tick <= Clock::duration::zero()) {
+        settings.tick = chrono::seconds(1);
+    }
+}
+
+uint64_t TipPool::tickOf(Clock::time_point t) const {
+    return t <= epoch ? 0 : static_cast<uint64_t>((t - epoch) / settings.tick);
+}
+
+void TipPool::arrived(const string& id, Clock::time_point now) {
+    if (!started) {
+        started = true;
+        epoch = now;
+    }
+    advance(now);
+    if (tips.count(id)) {
+        return;
+    }
+    uint64_t seq = nextSeq++;
+    tips[id] = {seq, now, false, fresh.size()};
+    fresh.push_back(id);
+    schedule(id, seq, now + settings.demoteAfter);
+    counters.arrived++;
+}
+
+void TipPool::approved(const string& id) {
+    auto it = tips.find(id);
+    if (it == tips.end()) {
+        return;
+    }
+    if (it->second.lazy) {
+        lazy.erase({it->second.seq, id});
+    } else {
+        removeFresh(it->second);
+    }
+    tips.erase(it);
+    counters.approved++; // its timer finds it gone and does nothing
+}
+
+// Swaps the last fresh tip into its place
+void TipPool::removeFresh(Tip& tip) {
+    if (tip.slot + 1 != fresh.size()) {
+        fresh[tip.slot] = move(fresh.back());
+        tips[fresh[tip.slot]].slot = tip.slot;
+    }
+    fresh.pop_back();
+}
+
+bool TipPool::isLazy(const string& id) const {
+    auto it = tips.find(id);
+    return it != tips.end() && it->second.lazy;
+}
+
+void TipPool::schedule(const string& id, uint64_t seq, Clock::time_point deadline) {
+    // Rounds up: a timer never fires early
+    uint64_t due = max(tickOf(deadline), current) + 1;
+    wheel[due % wheel.size()].push_back({id, seq, due});
+}
+
+void TipPool::fire(const Timer& timer, uint64_t now) {
+    auto it = tips.find(timer.id);
+    if (it == tips.end() || it->second.seq != timer.seq) {
+        return; // approved meanwhile
+    }
+    Tip& tip = it->second;
+    if (!tip.lazy) {
+        removeFresh(tip);
+        lazy.insert({tip.seq, timer.id});
+        tip.lazy = true;
+        counters.demoted++;
+        Clock::time_point evictAt = tip.arrivedAt + settings.evictAfter;
+        if (tickOf(evictAt) >= now) {
+            schedule(timer.id, tip.seq, evictAt);
+            return;
+        }
+        // Overdue as well, after a long gap between advances
+    }
+    lazy.erase({tip.seq, timer.id});
+    tips.erase(it);
+    counters.evicted++;
+}
+
+void TipPool::advance(Clock::time_point now) {
+    if (!started) {
+        return;
+    }
+    uint64_t target = tickOf(now);
+    // After a gap longer than a turn, one pass over every slot fires all that is due
+    uint64_t steps = min<uint64_t>(target > current ? target - current : 0, wheel.size());
+    for (uint64_t step = 1; step <= steps; step++) {
+        auto& slot = wheel[(current + step) % wheel.size()];
+        vector<Timer> due;
+        auto keep = partition(slot.begin(), slot.end(), [&](const Timer& t) { return t.due > target; });
+        due.assign(make_move_iterator(keep), make_move_iterator(slot.end()));
+        slot.erase(keep, slot.end());
+        for (const auto& timer : due) {
+            fire(timer, target);
+        }
+    }
+    current = max(current, target);
+}
+
+vector<string> TipPool::select(Clock::time_point now) {
+    advance(now);
+    vector<string> parents;
+    if (fresh.size() <= settings.maxParents) {
+        parents = fresh;
+    } else {
+        // Rejection is cheap while maxParents is small next to the pool
+        vector<size_t> picked;
+        uniform_int_distribution<size_t> any(0, fresh.size() - 1);
+        while (picked.size() < settings.maxParents) {
+            size_t slot = any(rng);
+            if (find(picked.begin(), picked.end(), slot) == picked.end()) {
+                picked.push_back(slot);
+                parents.push_back(fresh[slot]);
+            }
+        }
+    }
+    for (auto it = lazy.begin(); it != lazy.end() && parents.size() < settings.maxParents; ++it) {
+        parents.push_back(it->second);
+    }
+    return parents;
+}
@@ -0,0 +1,90 @@
+#include "../headers/tipservice.h"
+#include <utility>
+using namespace std;
+
+TipService::TipService(Tangle& tangle, mutex& tangleMutex, TipSelector selector, TipServiceConfig config)
+    : tangle(tangle), tangleMutex(tangleMutex), selector(move(selector)), config(config) {}
+
+TipService::~TipService() {
+    stop();
+}
+
+void TipService::start() {
+    if (worker.joinable()) {
+        return;
+    }
+    stopping = false;
+    worker = thread(&TipService::run, this);
+}
+
+void TipService::stop() {
+    {
+        lock_guard<mutex> lock(poolMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+bool TipService::fresh(const Selection& s, Clock::time_point now, uint64_t insertions, double share) const {
+    return now - s.selectedAt <= config.maxAge * share && insertions - s.insertions <= config.maxInserts * share;
+}
+
+vector<string> TipService::selectTips() {
+    auto now = Clock::now();
+    uint64_t insertions = tangle.insertions();
+    {
+        lock_guard<mutex> lock(poolMutex);
+        while (!pool.empty()) {
+            Selection s = move(pool.front());
+            pool.pop_front();
+            if (fresh(s, now, insertions, 1.0)) {
+                counters.handedOut++;
+                wake.notify_one(); // refill
+                return move(s.tips);
+            }
+            counters.expired++;
+        }
+        counters.selectedInline++;
+    }
+    wake.notify_one();
+    return selector(tangle);
+}
+
+void TipService::run() {
+    while (true) {
+        {
+            unique_lock<mutex> lock(poolMutex);
+            wake.wait_for(lock, config.refreshInterval, [&] { return stopping || pool.size() < config.poolSize; });
+            if (stopping) {
+                return;
+            }
+        }
+
+        // One selection per pass, so writers get the Tangle in between
+        lock_guard<mutex> tangleLock(tangleMutex);
+        auto now = Clock::now();
+        uint64_t insertions = tangle.insertions();
+        {
+            lock_guard<mutex> lock(poolMutex);
+            while (!pool.empty() && !fresh(pool.front(), now, insertions, 0.5)) {
+                pool.pop_front();
+                counters.expired++;
+            }
+            if (pool.size() >= config.poolSize) {
+                continue;
+            }
+        }
+        Selection s{selector(tangle), Clock::now(), insertions};
+        lock_guard<mutex> lock(poolMutex);
+        pool.push_back(move(s));
+        counters.selectedAhead++;
+    }
+}
+
+TipServiceStats TipService::stats() const {
+    lock_guard<mutex> lock(poolMutex);
+    return counters;
+}
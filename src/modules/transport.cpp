@@ -0,0 +1,115 @@
+#include "transport.h"
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+const double SMOOTHING = 0.25;          // weight of a new measurement
+const size_t SMALL_MESSAGE = 1024;      // bytes; delivery time of smaller messages is latency
+const int MAX_HOLD_S = 60;              // longest a failing path is held back
+
+const char *pathName(PathKind kind)
+{
+    return kind == PathKind::Tcp ? "TCP" : "LoRa";
+}
+
+PathSelector::PathSelector()
+{
+    // A LAN link and a 2400 bps radio, until told otherwise
+    priors[static_cast<size_t>(PathKind::Tcp)].latency = 0.05;
+    priors[static_cast<size_t>(PathKind::Tcp)].bytesPerSecond = 1e6;
+    priors[static_cast<size_t>(PathKind::Lora)].latency = 1;
+    priors[static_cast<size_t>(PathKind::Lora)].bytesPerSecond = 150;
+}
+
+void PathSelector::setPrior(PathKind kind, double latency, double bytesPerSecond)
+{
+    lock_guard<mutex> lock(selectorMutex);
+    PathState &prior = priors[static_cast<size_t>(kind)];
+    prior.latency = latency;
+    prior.bytesPerSecond = bytesPerSecond;
+}
+
+PathSelector::Entries &PathSelector::entries(const string &peer)
+{
+    auto it = routes.find(peer);
+    if (it == routes.end())
+        it = routes.emplace(peer, priors).first;
+    return it->second;
+}
+
+void PathSelector::setAvailable(const string &peer, PathKind kind, bool available)
+{
+    lock_guard<mutex> lock(selectorMutex);
+    entries(peer)[static_cast<size_t>(kind)].available = available;
+}
+
+void PathSelector::delivered(const string &peer, PathKind kind, size_t bytes, double seconds)
+{
+    lock_guard<mutex> lock(selectorMutex);
+    PathState &path = entries(peer)[static_cast<size_t>(kind)];
+    if (bytes <= SMALL_MESSAGE)
+    {
+        path.latency += SMOOTHING * (seconds - path.latency);
+    }
+    else
+    {
+        // Whatever the latency does not explain went into moving the bytes
+        double transfer = max(seconds - path.latency, 1e-6);
+        path.bytesPerSecond += SMOOTHING * (bytes / transfer - path.bytesPerSecond);
+    }
+    path.delivered++;
+    path.failures = 0;
+    path.heldUntil = Clock::time_point();
+}
+
+void PathSelector::failed(const string &peer, PathKind kind, Clock::time_point now)
+{
+    lock_guard<mutex> lock(selectorMutex);
+    PathState &path = entries(peer)[static_cast<size_t>(kind)];
+    path.failed++;
+    path.failures++;
+    int hold = min(MAX_HOLD_S, 1 << min(path.failures - 1, 6));
+    path.heldUntil = now + chrono::seconds(hold);
+}
+
+double PathSelector::transferTime(const PathState &path, size_t bytes)
+{
+    return path.latency + bytes / max(path.bytesPerSecond, 1e-9);
+}
+
+double PathSelector::cost(const string &peer, PathKind kind, size_t bytes, Clock::time_point now) const
+{
+    lock_guard<mutex> lock(selectorMutex);
+    auto it = routes.find(peer);
+    const PathState &path = it != routes.end() ? it->second[static_cast<size_t>(kind)] : priors[static_cast<size_t>(kind)];
+    if (!path.available || now < path.heldUntil)
+        return numeric_limits<double>::infinity();
+    return transferTime(path, bytes);
+}
+
+vector<PathKind> PathSelector::rank(const string &peer, size_t bytes, Clock::time_point now) const
+{
+    lock_guard<mutex> lock(selectorMutex);
+    auto it = routes.find(peer);
+    vector<pair<pair<bool, double>, PathKind>> candidates; // (held back, cost), path
+    for (size_t k = 0; k < PATH_KINDS; k++)
+    {
+        const PathState &path = it != routes.end() ? it->second[k] : priors[k];
+        if (path.available)
+            candidates.push_back({{now < path.heldUntil, transferTime(path, bytes)}, static_cast<PathKind>(k)});
+    }
+    sort(candidates.begin(), candidates.end());
+
+    vector<PathKind> out;
+    for (const auto &candidate : candidates)
+        out.push_back(candidate.second);
+    return out;
+}
+
+PathState PathSelector::state(const string &peer, PathKind kind) const
+{
+    lock_guard<mutex> lock(selectorMutex);
+    auto it = routes.find(peer);
+    return it != routes.end() ? it->second[static_cast<size_t>(kind)] : priors[static_cast<size_t>(kind)];
+}
@@ -4,8 +4,9 @@
 #include <string>
 #include <unordered_map>
 #include <random>
-#include <numeric>
-#include <ctime>
+#include <mutex>
+#include <cmath>
+#include <algorithm>
 using namespace std;
 
 //TSA checklist
@@ -15,306 +16,327 @@ using namespace std;
 //selectTipsURW for Unweighted Random Walk
 //selectTipsWRW for Weighted Random Walk
 
-vector<string> selectTips(Tangle& tangle) {
-    vector<std::string> tips;
-    int min_weight = INT_MAX;
-    string weakest_tx = "";
+// -------------------- WalkRng --------------------
 
-    for (const auto& pair : tangle.transactions) {
-        if (pair.second.validating_transactions.empty()) {
-            tips.push_back(pair.first);
-        } else if (pair.second.cumulative_weight < min_weight) {
-            min_weight = pair.second.cumulative_weight;
-            weakest_tx = pair.first;
-        }
-    }
-    
-    if (tips.empty() && !weakest_tx.empty()) {
-        tips.push_back(weakest_tx);
-    }
-    return tips;
+static uint64_t splitmix64(uint64_t& x) {
+    uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
 }
 
-vector<string> selectTipsMCMC(Tangle& tangle, double alpha = 0.1) {
-    srand(time(nullptr));
-    
-    // Handle empty tangle case
-    if (tangle.transactions.empty()) {
-        return {};
-    }
+static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
 
-    // 1. Build children mapping (transaction -> its direct approvers)
-    unordered_map<string, vector<string>> children_map;
-    for (const auto& pair : tangle.transactions) {
-        const string& child = pair.first;
-        for (const string& parent : pair.second.validating_transactions) {
-            children_map[parent].push_back(child);
-        }
+WalkRng::WalkRng(uint64_t seed) {
+    for (auto& word : state) {
+        word = splitmix64(seed);
     }
+}
 
-    // 2. Find genesis transaction (no parents)
-    string genesis;
-    for (const auto& pair : tangle.transactions) {
-        if (pair.second.validating_transactions.empty()) {
-            genesis = pair.first;
-            break;
-        }
-    }
+WalkRng::result_type WalkRng::operator()() {
+    uint64_t result = rotl(state[1] * 5, 7) * 9;
+    uint64_t t = state[1] << 17;
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= t;
+    state[3] = rotl(state[3], 45);
+    return result;
+}
 
-    // Fallback if no genesis found
-    if (genesis.empty()) {
-        return {"genesis_fallback"};
-    }
+double WalkRng::uniform() {
+    return ((*this)() >> 11) * 0x1.0p-53;
+}
 
-    // 3. Perform two independent MCMC random walks
-    vector<string> tips;
-    for (int i = 0; i < 2; ++i) {  // Always select 2 tips
-        string current = genesis;
-        
-        while (true) {
-            // Get direct approvers of current transaction
-            auto it = children_map.find(current);
-            vector<string> approvers;
-            if (it != children_map.end()) {
-                approvers = it->second;
-            }
+// Lemire's multiply-shift; the bias for n far below 2^64 is negligible for walks
+size_t WalkRng::below(size_t n) {
+    return static_cast<size_t>((static_cast<unsigned __int128>((*this)()) * n) >> 64);
+}
 
-            // Terminate walk if no approvers (reached tip)
-            if (approvers.empty()) {
-                break;
+void WalkRng::jump() {
+    static const uint64_t JUMP[] = {0x180EC6D33CFD0ABAull, 0xD5A61266F0C9392Cull, 0xA9582618E03FC9AAull,
+                                    0x39ABDC4529B1661Cull};
+    uint64_t jumped[4] = {0, 0, 0, 0};
+    for (uint64_t word : JUMP) {
+        for (int b = 0; b < 64; b++) {
+            if (word & (1ull << b)) {
+                for (int i = 0; i < 4; i++) {
+                    jumped[i] ^= state[i];
+                }
             }
+            (*this)();
+        }
+    }
+    for (int i = 0; i < 4; i++) {
+        state[i] = jumped[i];
+    }
+}
 
-            // 4. Calculate selection probabilities with numerical stability
-            double max_weight = -1e300;
-            for (const auto& tx : approvers) {
-                double cw = tangle.transactions[tx].cumulative_weight;
-                if (cw > max_weight) max_weight = cw;
-            }
+WalkRng& walkRng() {
+    thread_local WalkRng rng((static_cast<uint64_t>(random_device{}()) << 32) ^ random_device{}());
+    return rng;
+}
 
-            double total_weight = 0.0;
-            vector<double> weights;
-            for (const auto& tx : approvers) {
-                // Exponential bias toward higher weights
-                double w = exp(alpha * (tangle.transactions[tx].cumulative_weight - max_weight));
-                weights.push_back(w);
-                total_weight += w;
-            }
+// -------------------- AliasTable --------------------
 
-            // 5. Probabilistic selection (roulette wheel)
-            double r = static_cast<double>(rand()) / RAND_MAX * total_weight;
-            double cumulative = 0.0;
-            for (int j = 0; j < approvers.size(); ++j) {
-                cumulative += weights[j];
-                if (r <= cumulative) {
-                    current = approvers[j];
-                    break;
-                }
-            }
+void AliasTable::build(const vector<double>& weights) {
+    size_t n = weights.size();
+    probability.assign(n, 1.0);
+    alias.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        alias[i] = static_cast<uint32_t>(i);
+    }
+    double total = 0;
+    for (double w : weights) {
+        total += max(w, 0.0);
+    }
+    if (n == 0 || !(total > 0) || !isfinite(total)) {
+        return; // uniform
+    }
+
+    // Scale to mean 1, then pair each under-full column with an over-full one (Vose)
+    vector<double> scaled(n);
+    vector<uint32_t> small, large;
+    for (size_t i = 0; i < n; i++) {
+        scaled[i] = max(weights[i], 0.0) * n / total;
+        (scaled[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+    }
+    while (!small.empty() && !large.empty()) {
+        uint32_t s = small.back(), l = large.back();
+        small.pop_back();
+        probability[s] = scaled[s];
+        alias[s] = l;
+        scaled[l] -= 1.0 - scaled[s];
+        if (scaled[l] < 1.0) {
+            large.pop_back();
+            small.push_back(l);
         }
-        tips.push_back(current);
     }
-    return tips;
+    // Whatever is left is full up to rounding
+    for (uint32_t i : small) probability[i] = 1.0;
+    for (uint32_t i : large) probability[i] = 1.0;
 }
 
-vector<string> selectTipsGWW(Tangle& tangle) {
-    // Initialize random number generator
-    random_device rd;
-    mt19937 rng(rd());
-    
-    // Handle empty tangle case
-    if (tangle.transactions.empty()) {
-        return {};
+size_t AliasTable::sample(WalkRng& rng) const {
+    size_t column = rng.below(probability.size());
+    return rng.uniform() < probability[column] ? column : alias[column];
+}
+
+// -------------------- WalkCache --------------------
+
+WalkCache& WalkCache::of(const Tangle& tangle) {
+    static mutex attachMutex; // walks may run side by side on a Tangle nobody is changing
+    lock_guard<mutex> lock(attachMutex);
+    if (!tangle.walkCache) {
+        tangle.walkCache = make_shared<WalkCache>();
     }
+    return *tangle.walkCache;
+}
 
-    // 1. Build children mapping (transaction -> its direct approvers)
-    unordered_map<string, vector<string>> children_map;
-    for (const auto& pair : tangle.transactions) {
-        const string& child = pair.first;
-        for (const string& parent : pair.second.validating_transactions) {
-            children_map[parent].push_back(child);
+shared_ptr<const AliasTable> WalkCache::table(const Tangle& tangle, const string& id, WalkBias bias, double alpha) {
+    uint64_t version = tangle.approvalVersion(id);
+    auto& tables = bias == WalkBias::Weight ? weighted : exponential;
+    {
+        shared_lock<shared_mutex> lock(cacheMutex);
+        auto it = tables.find(id);
+        if (it != tables.end() && it->second.version == version &&
+            (bias == WalkBias::Weight || exponentialAlpha == alpha)) {
+            return it->second.table;
         }
     }
 
-    // 2. Find genesis transaction (no parents)
-    string genesis;
-    for (const auto& pair : tangle.transactions) {
-        if (pair.second.validating_transactions.empty()) {
-            genesis = pair.first;
-            break;
-        }
+    const vector<string>& approvers = tangle.approversOf(id);
+    vector<double> weights;
+    weights.reserve(approvers.size());
+    double heaviest = -1e300;
+    for (const auto& tx : approvers) {
+        auto it = tangle.transactions().find(tx);
+        double cw = it != tangle.transactions().end() ? it->second.cumulative_weight : 0;
+        weights.push_back(cw);
+        heaviest = max(heaviest, cw);
     }
-    if (genesis.empty()) {
-        return {"genesis_fallback"};
+    if (bias == WalkBias::Exponential) {
+        // Relative to the heaviest approver, for numerical stability
+        for (double& w : weights) {
+            w = exp(alpha * (w - heaviest));
+        }
     }
+    auto built = make_shared<AliasTable>();
+    built->build(weights);
 
-    // 3. Perform two independent weighted random walks
-    vector<string> tips;
-    for (int i = 0; i < 2; ++i) {
-        string current = genesis;
-        
-        while (true) {
-            auto it = children_map.find(current);
-            if (it == children_map.end() || it->second.empty()) {
-                break;  // Reached a tip
-            }
-            
-            const vector<string>& approvers = it->second;
-            
-            // Special case: single approver
-            if (approvers.size() == 1) {
-                current = approvers[0];
-                continue;
-            }
+    unique_lock<shared_mutex> lock(cacheMutex);
+    if (bias == WalkBias::Exponential && exponentialAlpha != alpha) {
+        exponential.clear();
+        exponentialAlpha = alpha;
+    }
+    tables[id] = {version, built};
+    return built;
+}
 
-            // Calculate total cumulative weight
-            double total_weight = 0.0;
-            for (const auto& tx : approvers) {
-                total_weight += tangle.transactions[tx].cumulative_weight;
-            }
+// -------------------- Walks --------------------
 
-            // Generate random number in [0, total_weight)
-            uniform_real_distribution<double> dist(0.0, total_weight);
-            double r = dist(rng);
-            
-            // Select approver proportional to its weight
-            double cumulative = 0.0;
-            for (const auto& tx : approvers) {
-                cumulative += tangle.transactions[tx].cumulative_weight;
-                if (r <= cumulative) {
-                    current = tx;
-                    break;
-                }
-            }
+string walkToTip(const Tangle& tangle, const string& start, WalkBias bias, double alpha, WalkRng& rng) {
+    WalkCache& cache = WalkCache::of(tangle);
+    string current = start;
+    while (true) {
+        const vector<string>& approvers = tangle.approversOf(current);
+        if (approvers.empty()) {
+            return current; // reached a tip
         }
-        tips.push_back(current);
+        size_t next = 0;
+        if (approvers.size() > 1) {
+            next = bias == WalkBias::Uniform ? rng.below(approvers.size())
+                                             : cache.table(tangle, current, bias, alpha)->sample(rng);
+        }
+        current = approvers[next];
     }
-    return tips;
 }
 
-vector<string> selectTipsURW(Tangle& tangle) {
-    // Initialize random engine -L> This makes the randomness unpredictable and is suitable for a DAG
-    random_device rd;
-    mt19937 rng(rd()); // the rng is used later to generate random numbers
-    
-    // Handle empty tangle
-    if (tangle.transactions.empty()) {
-        return {};
-    }
+// -------------------- WalkExecutor --------------------
 
-    // Build children mapping (parent -> direct approvers)
-    unordered_map<string, vector<string>> children_map;
-    for (const auto& pair : tangle.transactions) {
-        const string& child = pair.first;
-        for (const string& parent : pair.second.validating_transactions) {
-            children_map[parent].push_back(child);
-        }
+WalkExecutor::WalkExecutor(size_t workers, uint64_t seed) {
+    workers = max<size_t>(workers, 1);
+    if (seed == 0) {
+        seed = (static_cast<uint64_t>(random_device{}()) << 32) ^ random_device{}();
+    }
+    WalkRng stream(seed);
+    for (size_t i = 0; i < workers; i++) {
+        rngs.push_back(stream);
+        stream.jump();
     }
+    // A single worker walks on the calling thread
+    for (size_t i = 0; workers > 1 && i < workers; i++) {
+        threads.emplace_back(&WalkExecutor::work, this, i);
+    }
+}
 
-    // Find genesis transaction (no parents)
-    string genesis;
-    for (const auto& pair : tangle.transactions) {
-        if (pair.second.validating_transactions.empty()) {
-            genesis = pair.first;
-            break;
-        }
+WalkExecutor::~WalkExecutor() {
+    {
+        lock_guard<mutex> lock(jobMutex);
+        stopping = true;
     }
-    if (genesis.empty()) {
-        return {"genesis_fallback"}; //reminder to check what exception to raise for genesis fallback
+    jobReady.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
     }
+}
 
-    // Perform two independent unweighted random walks
-    vector<string> tips;
-    for (int i = 0; i < 2; ++i) {
-        string current = genesis;
-        
-        while (true) {
-            auto it = children_map.find(current);
-            if (it == children_map.end() || it->second.empty()) {
-                break;  // Reached tip
+WalkExecutor& WalkExecutor::shared() {
+    static WalkExecutor executor(min<size_t>(max(thread::hardware_concurrency(), 1u), 8));
+    return executor;
+}
+
+void WalkExecutor::work(size_t index) {
+    uint64_t seen = 0;
+    while (true) {
+        Job current;
+        {
+            unique_lock<mutex> lock(jobMutex);
+            jobReady.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
             }
-            
-            // Uniform random selection
-            const vector<string>& approvers = it->second;
-            uniform_int_distribution<size_t> dist(0, approvers.size() - 1);
-            size_t idx = dist(rng); //rng used to generate a random index
-            current = approvers[idx];
+            seen = generation;
+            current = job;
+        }
+        // Walks index, index + workers, ... of this job, in order, on this worker's own stream
+        vector<string>& tips = *current.tips;
+        for (size_t j = index; j < tips.size(); j += rngs.size()) {
+            const string& start = (*current.starts)[rngs[index].below(current.starts->size())];
+            tips[j] = walkToTip(*current.tangle, start, current.bias, current.alpha, rngs[index]);
         }
-        tips.push_back(current);
+        {
+            lock_guard<mutex> lock(jobMutex);
+            busy--;
+        }
+        jobDone.notify_one();
     }
-    return tips;
 }
 
-vector<string> selectTipsWRW(Tangle& tangle) {
-    // 1. Initialize random number generator
-    random_device rd;
-    mt19937 rng(rd());
-
-    // 2. Handle empty tangle case
-    if (tangle.transactions.empty()) {
+vector<string> WalkExecutor::walk(const Tangle& tangle, size_t k, WalkBias bias, double alpha) {
+    // Handle empty tangle case
+    const vector<string>& starts = tangle.entryPoints();
+    if (starts.empty()) {
         return {};
     }
+    WalkCache::of(tangle); // attached before the workers race for it
 
-    // 3. Build parent->children mapping for forward traversal
-    unordered_map<string, vector<string>> children_map;
-    for (const auto& pair : tangle.transactions) {
-        const string& child = pair.first;
-        for (const string& parent : pair.second.validating_transactions) {
-            children_map[parent].push_back(child);
+    vector<string> tips(k);
+    lock_guard<mutex> call(callMutex);
+    if (threads.empty()) {
+        for (auto& tip : tips) {
+            tip = walkToTip(tangle, starts[rngs[0].below(starts.size())], bias, alpha, rngs[0]);
         }
+        return tips;
     }
+    unique_lock<mutex> lock(jobMutex);
+    job = {&tangle, &starts, bias, alpha, &tips};
+    busy = threads.size();
+    generation++;
+    jobReady.notify_all();
+    jobDone.wait(lock, [&] { return busy == 0; });
+    return tips;
+}
 
-    // 4. Find genesis transaction (no parents)
-    string genesis;
-    for (const auto& pair : tangle.transactions) {
-        if (pair.second.validating_transactions.empty()) {
-            genesis = pair.first;
-            break;
-        }
-    }
-    if (genesis.empty()) {
-        return {"genesis_fallback"};
+vector<pair<string, size_t>> WalkExecutor::rank(const Tangle& tangle, size_t k, WalkBias bias, double alpha) {
+    unordered_map<string, size_t> hits;
+    for (const auto& tip : walk(tangle, k, bias, alpha)) {
+        hits[tip]++;
     }
+    vector<pair<string, size_t>> ranked(hits.begin(), hits.end());
+    sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    return ranked;
+}
 
-    // 5. Perform two independent weighted random walks
-    vector<string> tips;
-    for (int i = 0; i < 2; ++i) {
-        string current = genesis;
-        
-        while (true) {
-            // 5a. Get direct approvers (children)
-            auto it = children_map.find(current);
-            if (it == children_map.end() || it->second.empty()) {
-                break;  // Reached a tip
-            }
-            
-            const vector<string>& approvers = it->second;
-            
-            // 5b. Special case: single approver
-            if (approvers.size() == 1) {
-                current = approvers[0];
-                continue;
-            }
+// -------------------- TSA --------------------
 
-            // 5c. Calculate total weight of approvers
-            double total_weight = 0.0;
-            for (const auto& tx : approvers) {
-                total_weight += tangle.transactions[tx].cumulative_weight;
-            }
+vector<string> selectTips(Tangle& tangle) {
+    return selectTips(tangle, TipPool::Clock::now());
+}
 
-            // 5d. Weighted random selection (roulette wheel)
-            uniform_real_distribution<double> dist(0.0, total_weight);
-            double r = dist(rng);
-            
-            double cumulative = 0.0;
-            for (const auto& tx : approvers) {
-                cumulative += tangle.transactions[tx].cumulative_weight;
-                if (r <= cumulative) {
-                    current = tx;
-                    break;
-                }
-            }
+vector<string> selectTips(Tangle& tangle, TipPool::Clock::time_point now) {
+    // Tips not given up on yet, at most maxParents of them
+    vector<string> tips = tangle.tips().select(now);
+    if (!tips.empty()) {
+        return tips;
+    }
+
+    // Every tip was approved or evicted: approve the lightest transaction
+    int min_weight = INT_MAX;
+    string weakest_tx = "";
+    for (const auto& pair : tangle.transactions()) {
+        if (pair.second.cumulative_weight < min_weight) {
+            min_weight = pair.second.cumulative_weight;
+            weakest_tx = pair.first;
         }
-        tips.push_back(current);
+    }
+    if (!weakest_tx.empty()) {
+        tips.push_back(weakest_tx);
     }
     return tips;
-}
\ No newline at end of file
+}
+
+vector<string> selectTipsMCMC(Tangle& tangle, double alpha) {
+    // Exponential bias toward higher weights
+    return WalkExecutor::shared().walk(tangle, 2, WalkBias::Exponential, alpha);
+}
+
+vector<string> selectTipsGWW(Tangle& tangle) {
+    // Select approver proportional to its weight
+    return WalkExecutor::shared().walk(tangle, 2, WalkBias::Weight);
+}
+
+vector<string> selectTipsURW(Tangle& tangle) {
+    // Uniform random selection
+    return WalkExecutor::shared().walk(tangle, 2, WalkBias::Uniform);
+}
+
+vector<string> selectTipsWRW(Tangle& tangle) {
+    // Weighted random selection
+    return WalkExecutor::shared().walk(tangle, 2, WalkBias::Weight);
+}
@@ -0,0 +1,81 @@
+#include "../headers/validationcache.h"
+#include <algorithm>
+using namespace std;
+
+ValidationCache::ValidationCache(size_t capacity, size_t shards)
+    : shardCount(max<size_t>(min(shards, capacity), 1)) {
+    perShard = max<size_t>((capacity + shardCount - 1) / shardCount, 1);
+    this->shards.reset(new Shard[shardCount]);
+    for (size_t i = 0; i < shardCount; i++) {
+        this->shards[i].slots.reserve(perShard);
+        this->shards[i].index.reserve(perShard);
+    }
+}
+
+ValidationCache::Shard& ValidationCache::shardFor(const ContentHash& hash) {
+    // Bytes the index does not hash on, so the shards do not skew its buckets
+    uint64_t h;
+    memcpy(&h, hash.data() + sizeof(size_t), sizeof(h));
+    return shards[h % shardCount];
+}
+
+bool ValidationCache::lookup(const ContentHash& hash, uint8_t& outcome) {
+    Shard& shard = shardFor(hash);
+    lock_guard<mutex> lock(shard.mutex);
+    auto it = shard.index.find(hash);
+    if (it == shard.index.end()) {
+        shard.misses++;
+        return false;
+    }
+    Slot& slot = shard.slots[it->second];
+    slot.referenced = true;
+    outcome = slot.outcome;
+    shard.hits++;
+    return true;
+}
+
+void ValidationCache::record(const ContentHash& hash, uint8_t outcome) {
+    Shard& shard = shardFor(hash);
+    lock_guard<mutex> lock(shard.mutex);
+    auto it = shard.index.find(hash);
+    if (it != shard.index.end()) {
+        shard.slots[it->second].outcome |= outcome;
+        return;
+    }
+
+    if (shard.slots.size() < perShard) {
+        shard.index.emplace(hash, shard.slots.size());
+        shard.slots.push_back({hash, outcome, false});
+        return;
+    }
+    // A full sweep clears every mark, so this stops within two turns
+    while (shard.slots[shard.hand].referenced) {
+        shard.slots[shard.hand].referenced = false;
+        shard.hand = (shard.hand + 1) % perShard;
+    }
+    Slot& victim = shard.slots[shard.hand];
+    shard.index.erase(victim.key);
+    shard.evictions++;
+    victim = {hash, outcome, false};
+    shard.index.emplace(hash, shard.hand);
+    shard.hand = (shard.hand + 1) % perShard;
+}
+
+ValidationCacheStats ValidationCache::stats() const {
+    // One node per entry: the key, the slot number and the next pointer
+    const size_t NODE_BYTES = sizeof(pair<const ContentHash, uint32_t>) + sizeof(void*);
+    ValidationCacheStats out{};
+    out.capacity = perShard * shardCount;
+    out.memoryBytes = sizeof(*this) + shardCount * sizeof(Shard);
+    for (size_t i = 0; i < shardCount; i++) {
+        const Shard& shard = shards[i];
+        lock_guard<mutex> lock(shard.mutex);
+        out.hits += shard.hits;
+        out.misses += shard.misses;
+        out.evictions += shard.evictions;
+        out.entries += shard.slots.size();
+        out.memoryBytes += shard.slots.capacity() * sizeof(Slot) + shard.index.bucket_count() * sizeof(void*) +
+                           shard.index.size() * NODE_BYTES;
+    }
+    return out;
+}